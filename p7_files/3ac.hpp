@@ -2,12 +2,15 @@
 #define CMINUSMINUS_3AC_HPP
 
 #include <assert.h>
+#include <cstdint>
 #include <list>
 #include <map>
 #include <set>
 #include <string.h>
+#include <vector>
 #include "symbol_table.hpp"
 #include "types.hpp"
+#include "x64.hpp"
 
 namespace cminusminus{
 
@@ -15,6 +18,8 @@ class TypeAnalysis;
 class Procedure;
 class IRProgram;
 class ControlFlowGraph;
+class ObjectFile;
+class Bytecode;
 
 class Label{
 public:
@@ -32,7 +37,7 @@ private:
 };
 
 enum Register{
-	A, B, C, D, DI
+	A, B, C, D, DI, SI, R8, R9, R10, R11, R12, R13, R14, R15
 };
 
 class RegUtils{
@@ -44,7 +49,17 @@ public:
 			case C: return "c";
 			case D: return "d";
 			case DI: return "di";
+			case SI: return "si";
+			case R8: return "r8";
+			case R9: return "r9";
+			case R10: return "r10";
+			case R11: return "r11";
+			case R12: return "r12";
+			case R13: return "r13";
+			case R14: return "r14";
+			case R15: return "r15";
 		}
+		throw new InternalError("no such register");
 	}
 
 	static std::string reg64(Register reg){
@@ -54,6 +69,15 @@ public:
 			case C: return "%rcx";
 			case D: return "%rdx";
 			case DI: return "%rdi";
+			case SI: return "%rsi";
+			case R8: return "%r8";
+			case R9: return "%r9";
+			case R10: return "%r10";
+			case R11: return "%r11";
+			case R12: return "%r12";
+			case R13: return "%r13";
+			case R14: return "%r14";
+			case R15: return "%r15";
 		}
 		throw new InternalError("no such register");
 	}
@@ -65,21 +89,82 @@ public:
 			case C: return "%cl";
 			case D: return "%dl";
 			case DI: return "%dil";
+			case SI: return "%sil";
+			case R8: return "%r8b";
+			case R9: return "%r9b";
+			case R10: return "%r10b";
+			case R11: return "%r11b";
+			case R12: return "%r12b";
+			case R13: return "%r13b";
+			case R14: return "%r14b";
+			case R15: return "%r15b";
+		}
+		throw new InternalError("no such register");
+	}
+
+	//The register's number in the instruction encoding
+	static X64Reg x64Reg(Register reg){
+		switch(reg){
+			case A: return X64Reg::RAX;
+			case B: return X64Reg::RBX;
+			case C: return X64Reg::RCX;
+			case D: return X64Reg::RDX;
+			case DI: return X64Reg::RDI;
+			case SI: return X64Reg::RSI;
+			case R8: return X64Reg::R8;
+			case R9: return X64Reg::R9;
+			case R10: return X64Reg::R10;
+			case R11: return X64Reg::R11;
+			case R12: return X64Reg::R12;
+			case R13: return X64Reg::R13;
+			case R14: return X64Reg::R14;
+			case R15: return X64Reg::R15;
 		}
 		throw new InternalError("no such register");
 	}
+
+	//The register used to pass the given (1-based) argument
+	// under the SysV calling convention. Only the first 
+	// REG_ARGS arguments are passed in registers; the rest
+	// go on the stack.
+	static const size_t REG_ARGS = 6;
+	static Register argReg(size_t index){
+		switch(index){
+			case 1: return DI;
+			case 2: return SI;
+			case 3: return D;
+			case 4: return C;
+			case 5: return R8;
+			case 6: return R9;
+		}
+		throw new InternalError("argument is not passed in a register");
+	}
+
+	static bool isCalleeSaved(Register reg){
+		switch(reg){
+			case B: case R12: case R13: case R14: case R15:
+				return true;
+			default:
+				return false;
+		}
+	}
 };
 
+class SymOpd;
+class AuxOpd;
+class AddrOpd;
+class LitOpd;
+
 class Opd{
 public:
 	Opd(size_t widthIn) : myWidth(widthIn){}
 	virtual std::string valString() = 0;
 	virtual std::string locString() = 0;
 	virtual size_t getWidth(){ return myWidth; }
-	virtual void genLoadAddr(std::ostream& out, Register reg) = 0;
-	virtual void genStoreAddr(std::ostream& out, Register reg) = 0;
-	virtual void genLoadVal(std::ostream& out, Register reg) = 0;
-	virtual void genStoreVal(std::ostream& out, Register reg) = 0;
+	virtual void genLoadAddr(X64Code& code, Register reg) = 0;
+	virtual void genStoreAddr(X64Code& code, Register reg) = 0;
+	virtual void genLoadVal(X64Code& code, Register reg) = 0;
+	virtual void genStoreVal(X64Code& code, Register reg) = 0;
 	static size_t width(const DataType * type){
 		if (const BasicType * basic = type->asBasic()){
 			return 8;
@@ -103,7 +188,11 @@ public:
 		}
 		throw new InternalError("Bad getReg width");
 	}
-	virtual std::string getMemoryLoc() = 0;
+	virtual X64Opd getMemoryLoc() = 0;
+	virtual SymOpd * asSym(){ return nullptr; }
+	virtual AuxOpd * asAux(){ return nullptr; }
+	virtual AddrOpd * asAddr(){ return nullptr; }
+	virtual LitOpd * asLit(){ return nullptr; }
 private:
 	size_t myWidth;
 };
@@ -120,18 +209,19 @@ public:
 		return mySym->getName();
 	}
 	const SemSymbol * getSym(){ return mySym; }
-	virtual void genLoadVal(std::ostream& out, Register reg) override; 
-	virtual void genStoreVal(std::ostream& out, Register reg) override; 
-	virtual void genLoadAddr(std::ostream& out, Register reg) override; 
-	virtual void genStoreAddr(std::ostream& out, Register reg) override{ 
+	virtual void genLoadVal(X64Code& code, Register reg) override; 
+	virtual void genStoreVal(X64Code& code, Register reg) override; 
+	virtual void genLoadAddr(X64Code& code, Register reg) override; 
+	virtual void genStoreAddr(X64Code& code, Register reg) override{ 
 		throw new InternalError("Cannot change the addr of a symOpd");
 	}
-	virtual void setMemoryLoc(std::string loc){
+	virtual void setMemoryLoc(const X64Opd& loc){
 		myLoc = loc;
 	}
-	virtual std::string getMemoryLoc() override{
+	virtual X64Opd getMemoryLoc() override{
 		return myLoc;
 	}
+	virtual SymOpd * asSym() override{ return this; }
 private:
 	//Private Constructor
 	SymOpd(SemSymbol * sym, size_t width)
@@ -139,7 +229,7 @@ private:
 	SemSymbol * mySym;
 	friend class Procedure;
 	friend class IRProgram;
-	std::string myLoc;
+	X64Opd myLoc;
 };
 
 class LitOpd : public Opd{
@@ -168,28 +258,35 @@ public:
 	virtual std::string locString() override{
 		throw InternalError("Tried to get location of a constant");
 	}
-	virtual void genLoadVal(std::ostream& out, Register reg) override; 
-	virtual void genStoreVal(std::ostream& out, Register reg) override{ 
+	virtual void genLoadVal(X64Code& code, Register reg) override; 
+	virtual void genStoreVal(X64Code& code, Register reg) override{ 
 		throw new InternalError("Cannot change value of a literal");
 	}
-	virtual void genLoadAddr(std::ostream& out, Register reg) override{ 
+	virtual void genLoadAddr(X64Code& code, Register reg) override{ 
 		throw new InternalError("Cannot get addr of a literal");
 	}
-	virtual void genStoreAddr(std::ostream& out, Register reg) override{ 
+	virtual void genStoreAddr(X64Code& code, Register reg) override{ 
 		throw new InternalError("Cannot set the addr of a literal");
 	}
 
-	virtual std::string getMemoryLoc() override{
+	virtual X64Opd getMemoryLoc() override{
 		throw InternalError("Tried to get location of a constant");
 	}
+	virtual LitOpd * asLit() override{ return this; }
 private:
 	std::string val;
 };
 
+//Temporaries are identified by their index within the
+// procedure; the printable name is only built on demand
 class AuxOpd : public Opd{
 public:
-	AuxOpd(std::string nameIn, size_t width) 
-	: Opd(width), name(nameIn) { }
+	AuxOpd(size_t idxIn, size_t width) 
+	: Opd(width), idx(idxIn) { }
+	//A temporary standing in for one SSA version of another
+	// operand, printed as that operand's name and version
+	AuxOpd(size_t idxIn, size_t width, std::string nameIn)
+	: Opd(width), idx(idxIn), myName(nameIn) { }
 	virtual std::string valString() override{
 		return "[" + getName() + "]";
 	}
@@ -197,55 +294,59 @@ public:
 		return getName();
 	}
 	std::string getName(){
-		return name;
+		if (!myName.empty()){ return myName; }
+		return "tmp" + std::to_string(idx);
 	}
-	virtual void genLoadVal(std::ostream& out, Register reg) override; 
-	virtual void genStoreVal(std::ostream& out, Register reg) override;
-	virtual void genLoadAddr(std::ostream& out, Register reg) override;
-	virtual void genStoreAddr(std::ostream& out, Register reg) override{ 
+	virtual void genLoadVal(X64Code& code, Register reg) override; 
+	virtual void genStoreVal(X64Code& code, Register reg) override;
+	virtual void genLoadAddr(X64Code& code, Register reg) override;
+	virtual void genStoreAddr(X64Code& code, Register reg) override{ 
 		throw new InternalError("Cannot change the addr of a auxOpd");
 	}
 
-	virtual void setMemoryLoc(std::string loc){
+	virtual void setMemoryLoc(const X64Opd& loc){
 		myLoc = loc;
 	}
-	virtual std::string getMemoryLoc() override{
+	virtual X64Opd getMemoryLoc() override{
 		return myLoc;
 	}
+	virtual AuxOpd * asAux() override{ return this; }
 
 private:
-	std::string name;
-	std::string myLoc = "UNINIT";
+	size_t idx;
+	std::string myName;
+	X64Opd myLoc;
 };
 
 class AddrOpd : public Opd{
 public:
-	AddrOpd(std::string nameIn, size_t width)
-	: Opd(width), name(nameIn) { }
+	AddrOpd(size_t idxIn, size_t width)
+	: Opd(width), idx(idxIn) { }
 	virtual std::string valString() override{
 		return "[[" + getName() + "]]";
 	}
 	virtual std::string locString() override{
 		return "[" + getName() + "]";
 	}
-	virtual void genLoadAddr(std::ostream& out, Register reg) override;
-	virtual void genStoreAddr(std::ostream& out, Register reg) override; 
-	virtual void genLoadVal(std::ostream& out, Register reg) override; 
-	virtual void genStoreVal(std::ostream& out, Register reg) override; 
+	virtual void genLoadAddr(X64Code& code, Register reg) override;
+	virtual void genStoreAddr(X64Code& code, Register reg) override; 
+	virtual void genLoadVal(X64Code& code, Register reg) override; 
+	virtual void genStoreVal(X64Code& code, Register reg) override; 
 
-	virtual void setMemoryLoc(std::string loc){
+	virtual void setMemoryLoc(const X64Opd& loc){
 		myLoc = loc;
 	}
-	virtual std::string getMemoryLoc() override{
+	virtual X64Opd getMemoryLoc() override{
 		return myLoc;
 	}
 	virtual std::string getName(){
-		return name;
+		return "addrTmp" + std::to_string(idx);
 	}
+	virtual AddrOpd * asAddr() override{ return this; }
 private:
 	std::string val;
-	std::string name;
-	std::string myLoc;
+	size_t idx;
+	X64Opd myLoc;
 };
 
 enum BinOp {
@@ -258,18 +359,75 @@ enum UnaryOp{
 	NEG64, NEG8, NOT64, NOT8
 };
 
+class BinOpQuad;
+class UnaryOpQuad;
+class AssignQuad;
+class GotoQuad;
+class IfzQuad;
+class LocQuad;
+class CallQuad;
+class LeaveQuad;
+class SetArgQuad;
+class GetArgQuad;
+class EnterQuad;
+class PhiQuad;
+class SetRetQuad;
+class GetRetQuad;
+class IntrinsicOutputQuad;
+class IntrinsicInputQuad;
+class TailCallQuad;
+
 class Quad{
 public:
 	Quad();
 	void addLabel(Label * label);
 	Label * getLabel(){ return labels.front(); }
+	const std::list<Label *>& getLabels(){ return labels; }
 	void clearLabels(){ labels.clear(); }
+	//The operands whose storage this quad reads and writes. 
+	// Writing through an AddrOpd only reads the address it
+	// holds, so it is a use rather than a def. Literals are
+	// left out.
+	virtual std::list<Opd *> getUses(){ return {}; }
+	virtual std::list<Opd *> getDefs(){ return {}; }
+	//Substitute newOpd for oldOpd wherever the quad uses
+	// (resp. defines) it, in the sense of getUses and getDefs
+	virtual void replaceUses(Opd * oldOpd, Opd * newOpd){ }
+	virtual void replaceDefs(Opd * oldOpd, Opd * newOpd){ }
+	//Whether the code for this quad overwrites the 
+	// caller-saved registers, either by calling out (to 
+	// a procedure or the runtime) or by moving arguments
+	// in or out of the argument registers
+	virtual bool clobbersRegs(){ return false; }
+	//Whether setting the operands in getDefs is all the quad
+	// does, so that it can go if nothing reads them
+	virtual bool isPure(){ return false; }
+	virtual BinOpQuad * asBinOp(){ return nullptr; }
+	virtual UnaryOpQuad * asUnaryOp(){ return nullptr; }
+	virtual AssignQuad * asAssign(){ return nullptr; }
+	virtual GotoQuad * asGoto(){ return nullptr; }
+	virtual IfzQuad * asIfz(){ return nullptr; }
+	virtual LocQuad * asLoc(){ return nullptr; }
+	virtual CallQuad * asCall(){ return nullptr; }
+	virtual LeaveQuad * asLeave(){ return nullptr; }
+	virtual SetArgQuad * asSetArg(){ return nullptr; }
+	virtual GetArgQuad * asGetArg(){ return nullptr; }
+	virtual EnterQuad * asEnter(){ return nullptr; }
+	virtual PhiQuad * asPhi(){ return nullptr; }
+	virtual SetRetQuad * asSetRet(){ return nullptr; }
+	virtual GetRetQuad * asGetRet(){ return nullptr; }
+	virtual IntrinsicOutputQuad * asIntrinsicOutput(){ return nullptr; }
+	virtual IntrinsicInputQuad * asIntrinsicInput(){ return nullptr; }
+	virtual TailCallQuad * asTailCall(){ return nullptr; }
 	virtual std::string repr() = 0;
 	std::string commentStr();
 	virtual std::string toString(bool verbose=false);
 	void setComment(std::string commentIn);
-	virtual void codegenX64(std::ostream& out) = 0;
-	void codegenLabels(std::ostream& out);
+	virtual void codegenX64(X64Code& code) = 0;
+	//A copy of the quad with the same operands, labels and
+	// comment
+	virtual Quad * clone() = 0;
+	void codegenLabels(X64Code& code);
 private:
 	std::string myComment;
 	std::list<Label *> labels;
@@ -280,7 +438,14 @@ public:
 	BinOpQuad(Opd * dstIn, BinOp oprIn, Opd * src1In, Opd * src2In);
 	std::string repr() override;
 	static std::string oprString(BinOp opr);
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new BinOpQuad(*this); }
+	BinOpQuad * asBinOp() override{ return this; }
+	bool isPure() override{ return true; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
+	std::list<Opd *> getDefs() override;
+	void replaceDefs(Opd * oldOpd, Opd * newOpd) override;
 	Opd * getDst(){ return dst; }
 	Opd * getSrc1(){ return src1; }
 	Opd * getSrc2(){ return src2; }
@@ -296,7 +461,14 @@ class UnaryOpQuad : public Quad {
 public:
 	UnaryOpQuad(Opd * dstIn, UnaryOp opIn, Opd * srcIn);
 	std::string repr() override ;
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new UnaryOpQuad(*this); }
+	UnaryOpQuad * asUnaryOp() override{ return this; }
+	bool isPure() override{ return true; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
+	std::list<Opd *> getDefs() override;
+	void replaceDefs(Opd * oldOpd, Opd * newOpd) override;
 	Opd * getDst(){ return dst; }
 	Opd * getSrc(){ return src; }
 	UnaryOp getOp(){ return op; }
@@ -311,7 +483,14 @@ class AssignQuad : public Quad{
 public:
 	AssignQuad(Opd * dstIn, Opd * srcIn, bool isRecord);
 	std::string repr() override;
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new AssignQuad(*this); }
+	AssignQuad * asAssign() override{ return this; }
+	bool isPure() override{ return true; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
+	std::list<Opd *> getDefs() override;
+	void replaceDefs(Opd * oldOpd, Opd * newOpd) override;
 	Opd * getDst(){ return dst; }
 	Opd * getSrc(){ return src; }
 private:
@@ -326,7 +505,18 @@ public:
 	LocQuad(Opd * srcIn, Opd * tgtIn, bool srcLocIn, bool tgtLocIn)
 	: src(srcIn), tgt(tgtIn), srcIsLoc(srcLocIn), tgtIsLoc(tgtLocIn){ }
 	std::string repr() override;
-	void codegenX64(std::ostream& out) override;
+	Opd * getSrc(){ return src; }
+	Opd * getTgt(){ return tgt; }
+	bool isSrcLoc(){ return srcIsLoc; }
+	bool isTgtLoc(){ return tgtIsLoc; }
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new LocQuad(*this); }
+	LocQuad * asLoc() override{ return this; }
+	bool isPure() override{ return true; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
+	std::list<Opd *> getDefs() override;
+	void replaceDefs(Opd * oldOpd, Opd * newOpd) override;
 private:
 	Opd * src;
 	Opd * tgt;
@@ -338,8 +528,11 @@ class GotoQuad : public Quad {
 public:
 	GotoQuad(Label * tgtIn);
 	std::string repr() override;
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new GotoQuad(*this); }
+	GotoQuad * asGoto() override{ return this; }
 	Label * getTarget(){ return tgt; }
+	void setTarget(Label * tgtIn){ tgt = tgtIn; }
 private:
 	Label * tgt;
 };
@@ -347,12 +540,30 @@ private:
 class IfzQuad : public Quad {
 public:
 	IfzQuad(Opd * cndIn, Label * tgtIn);
+	//A fused compare-and-branch: jump unless src1 cmp src2
+	// holds, without storing the boolean anywhere. cmp must
+	// be one of the relational operators.
+	IfzQuad(BinOp cmpIn, Opd * src1In, Opd * src2In, Label * tgtIn);
 	std::string repr() override;
 	Label * getTarget(){ return tgt; }
+	void setTarget(Label * tgtIn){ tgt = tgtIn; }
+	//The condition, or nullptr for a fused comparison
 	Opd * getCnd(){ return cnd; }
-	void codegenX64(std::ostream& out) override;
+	bool isFused(){ return cnd == nullptr; }
+	BinOp getCmp(){ return cmp; }
+	Opd * getSrc1(){ return src1; }
+	Opd * getSrc2(){ return src2; }
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new IfzQuad(*this); }
+	IfzQuad * asIfz() override{ return this; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
+	static bool isRelational(BinOp opr);
 private:
 	Opd * cnd;
+	BinOp cmp;
+	Opd * src1;
+	Opd * src2;
 	Label * tgt;
 };
 
@@ -360,7 +571,33 @@ class NopQuad : public Quad {
 public:
 	NopQuad();
 	std::string repr() override;
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new NopQuad(*this); }
+};
+
+//Only present while a procedure is in SSA form. Takes the
+// value of the argument for whichever predecessor control
+// came from; the arguments line up with the predecessors of
+// the phi's block in the procedure's CFG.
+class PhiQuad : public Quad {
+public:
+	PhiQuad(Opd * dstIn, size_t numArgs);
+	std::string repr() override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new PhiQuad(*this); }
+	PhiQuad * asPhi() override{ return this; }
+	bool isPure() override{ return true; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
+	std::list<Opd *> getDefs() override;
+	void replaceDefs(Opd * oldOpd, Opd * newOpd) override;
+	Opd * getDst(){ return dst; }
+	const std::vector<Opd *>& getArgs(){ return args; }
+	void setArg(size_t pred, Opd * opd){ args[pred] = opd; }
+	void setArgs(const std::vector<Opd *>& argsIn){ args = argsIn; }
+private:
+	Opd * dst;
+	std::vector<Opd *> args;
 };
 
 class IntrinsicOutputQuad : public Quad {
@@ -369,7 +606,12 @@ public:
 	std::string repr() override;
 	Opd * getSrc(){ return myArg; }
 	const DataType * getType(){ return myType; }
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new IntrinsicOutputQuad(*this); }
+	IntrinsicOutputQuad * asIntrinsicOutput() override{ return this; }
+	bool clobbersRegs() override{ return true; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
 private:
 	Opd * myArg;
 	const DataType * myType;
@@ -380,7 +622,15 @@ public:
 	IntrinsicInputQuad(Opd * arg, const DataType * type);
 	std::string repr() override;
 	Opd * getDst(){ return myArg; }
-	void codegenX64(std::ostream& out) override;
+	const DataType * getType(){ return myType; }
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new IntrinsicInputQuad(*this); }
+	IntrinsicInputQuad * asIntrinsicInput() override{ return this; }
+	bool clobbersRegs() override{ return true; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
+	std::list<Opd *> getDefs() override;
+	void replaceDefs(Opd * oldOpd, Opd * newOpd) override;
 private:
 	Opd * myArg;
 	const DataType * myType;
@@ -390,16 +640,41 @@ class CallQuad : public Quad{
 public:
 	CallQuad(SemSymbol * calleeIn);
 	std::string repr() override;
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new CallQuad(*this); }
+	bool clobbersRegs() override{ return true; }
+	CallQuad * asCall() override{ return this; }
+	SemSymbol * getCallee(){ return callee; }
 private:
 	SemSymbol * callee;
 };
 
+//A call in tail position to a procedure taking at most
+// REG_ARGS arguments. The caller's frame is torn down first
+// and the callee is jumped to, so that it returns straight
+// to the caller's caller. A goto to the caller's leave label
+// always follows, to keep the shape of the CFG.
+class TailCallQuad : public Quad{
+public:
+	TailCallQuad(Procedure * procIn, SemSymbol * calleeIn);
+	std::string repr() override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new TailCallQuad(*this); }
+	TailCallQuad * asTailCall() override{ return this; }
+	bool clobbersRegs() override{ return true; }
+	SemSymbol * getCallee(){ return callee; }
+private:
+	Procedure * myProc;
+	SemSymbol * callee;
+};
+
 class EnterQuad : public Quad{
 public:
 	EnterQuad(Procedure * proc);
 	virtual std::string repr() override;
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new EnterQuad(*this); }
+	EnterQuad * asEnter() override{ return this; }
 private:
 	Procedure * myProc;
 };
@@ -408,7 +683,9 @@ class LeaveQuad : public Quad{
 public:
 	LeaveQuad(Procedure * proc);
 	virtual std::string repr() override;
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new LeaveQuad(*this); }
+	LeaveQuad * asLeave() override{ return this; }
 private:
 	Procedure * myProc;
 };
@@ -417,7 +694,12 @@ class SetArgQuad : public Quad{
 public:
 	SetArgQuad(size_t indexIn, Opd * opdIn, const DataType * typeIn);
 	std::string repr() override;
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new SetArgQuad(*this); }
+	bool clobbersRegs() override{ return true; }
+	SetArgQuad * asSetArg() override{ return this; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
 	Opd * getSrc(){ return opd; }
 	size_t getIndex(){ return index; }
 	const DataType * getType(){ return type; }
@@ -431,8 +713,17 @@ class GetArgQuad : public Quad{
 public:
 	GetArgQuad(size_t indexIn, Opd * opdIn, bool isRecord);
 	std::string repr() override;
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new GetArgQuad(*this); }
+	bool clobbersRegs() override{ return true; }
+	GetArgQuad * asGetArg() override{ return this; }
+	bool isPure() override{ return true; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
+	std::list<Opd *> getDefs() override;
+	void replaceDefs(Opd * oldOpd, Opd * newOpd) override;
 	Opd * getDst(){ return opd; }
+	size_t getIndex(){ return index; }
 	bool isRecord(){ return myIsRecord; } 
 private:
 	size_t index;
@@ -446,7 +737,11 @@ public:
 	std::string repr() override;
 	Opd * getSrc(){ return opd; }
 	bool isRecord(){ return myIsRecord; } 
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new SetRetQuad(*this); }
+	SetRetQuad * asSetRet() override{ return this; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
 private:
 	Opd * opd;
 	const bool myIsRecord;
@@ -457,7 +752,14 @@ public:
 	GetRetQuad(Opd * opdIn, bool isRecordIn);
 	std::string repr() override;
 	Opd * getDst(){ return opd; }
-	void codegenX64(std::ostream& out) override;
+	void codegenX64(X64Code& code) override;
+	Quad * clone() override{ return new GetRetQuad(*this); }
+	GetRetQuad * asGetRet() override{ return this; }
+	bool isPure() override{ return true; }
+	std::list<Opd *> getUses() override;
+	void replaceUses(Opd * oldOpd, Opd * newOpd) override;
+	std::list<Opd *> getDefs() override;
+	void replaceDefs(Opd * oldOpd, Opd * newOpd) override;
 	bool isRecord(){ return myIsRecord; } 
 private:
 	Opd * opd;
@@ -466,7 +768,7 @@ private:
 
 class Procedure{
 public:
-	Procedure(IRProgram * prog, std::string name);
+	Procedure(IRProgram * prog, const std::string& name);
 	void addQuad(Quad * quad);
 	Quad * popQuad();
 	IRProgram * getProg();
@@ -483,23 +785,101 @@ public:
 	SymOpd * getSymOpd(SemSymbol * sym);
 	AuxOpd * makeTmp(size_t width);
 	AddrOpd * makeAddrOpd(size_t width);
+	AuxOpd * makeVersion(Opd * base, size_t version);
+	//The formals, locals and temps whose address is never
+	// taken. Nothing but the procedure's own quads can
+	// read or write these.
+	std::vector<Opd *> promotableOpds();
+
+	//Rewrite the body into SSA form over the promotable
+	// operands, and back into phi-free quads
+	void toSSA();
+	void fromSSA();
+	//The versions toSSA created; each has exactly one 
+	// definition. Empty outside of SSA form.
+	const std::vector<Opd *>& ssaVars(){ return versions; }
+	//Sparse conditional constant propagation. Needs SSA form.
+	void propagateConstants();
+	//Reuse the value of an earlier, dominating computation of
+	// the same expression, and forward copies. Needs SSA form.
+	void numberValues();
+	//Drop quads whose results are never read. Needs SSA form.
+	void eliminateDeadCode();
+	//Move computations that give the same result on every
+	// iteration of a loop into a preheader in front of it.
+	// Needs SSA form.
+	void hoistLoopInvariants();
+	//Turn multiplications of a loop's induction variables by
+	// a constant into additions. Needs SSA form.
+	void reduceStrength();
+	//Merge the two sides of each copy that are never live at
+	// the same time, and drop the copy. Needs phi-free quads.
+	void coalesceCopies();
+	//Forget the locals and temps that no quad mentions any
+	// more, so that they get no space in the frame
+	void dropUnusedOpds();
+	//Merge each comparison whose only use is the IFZ that
+	// ends its block into that IFZ. Needs phi-free quads.
+	void fuseCompares();
+	//Replace the call at pos (along with the quads that pass
+	// its arguments and fetch its result) by a copy of the
+	// callee's body, and move pos past the copy. Returns false,
+	// leaving everything as it was, if the call's arguments
+	// are not where they should be. Needs phi-free quads.
+	bool inlineCall(std::list<Quad *>::iterator& pos, Procedure * callee);
+	//Turn calls whose result is returned right away into
+	// jumps: back to the top of the body for the procedure
+	// itself, and into the callee for anyone else. Needs
+	// phi-free quads.
+	void eliminateTailCalls();
 
 	std::string toString(bool verbose=false); 
 	std::string getName();
+	//The assembly label of the function with the given name
+	static std::string entryName(const std::string& fnName);
 
 	cminusminus::Label * getLeaveLabel();
 
-	void toX64(std::ostream& out);
+	//When optimizing, registers are allocated and stack slots
+	// are shared. The result always goes through a peephole
+	// pass.
+	void toX64(std::ostream& out, bool optimize);
+	X64Code toX64Code(bool optimize, bool withComments);
 	size_t arSize() const;
 	size_t numTemps() const;
+	size_t frameBytes() const { return frameSize; }
+	const std::list<Register>& getSavedRegs() const { return savedRegs; }
 
 	std::list<Quad *> * getQuads(){ return bodyQuads; }
 	EnterQuad * getEnter(){ return enter; }
 	LeaveQuad * getLeave(){ return leave; }
 	void replaceQuad(Quad * oldQuad, Quad * newQuad);
+	//The control-flow graph of enter, the body and leave. It is
+	// built on first use and kept until the quads change; code
+	// that edits the list from getQuads() directly has to call
+	// invalidateCFG itself.
+	ControlFlowGraph * getCFG();
+	void invalidateCFG();
 	
 private:
-	void allocLocals();
+	//Swap each quad in the body for its replacement (nullptr
+	// drops it). Blocks not marked live are dropped outright,
+	// but every live block keeps at least one quad, so that
+	// blocks never merge and the remaining edges keep their
+	// order. Dropping a block's first quad moves its labels to
+	// the next one that stays.
+	void rewriteQuads(const HashMap<Quad *, Quad *>& replacements,
+		const std::vector<bool>& liveBlocks);
+	void allocLocals(bool allocRegs);
+	//Write the code for the whole procedure, as is
+	void genX64(X64Code& code, bool optimize);
+	std::set<Opd *> allocRegisters();
+	//Group the operands that are not in registers and not
+	// reachable through memory into sets that can share a
+	// stack slot
+	std::vector<std::vector<Opd *>> colorSlots(
+		const std::set<Opd *>& inRegs);
+	size_t maxStackArgs();
 
 	EnterQuad * enter;
 	LeaveQuad * leave;
@@ -513,6 +893,13 @@ private:
 	std::list<Quad *> * bodyQuads;
 	std::string myName;
 	size_t maxTmp;
+	ControlFlowGraph * cfg = nullptr;
+	std::vector<Opd *> versions;
+	//Callee-saved registers the procedure has to preserve
+	// and the size of its frame (excluding the saved %rbp),
+	// both set up by allocLocals
+	std::list<Register> savedRegs;
+	size_t frameSize = 0;
 };
 
 class IRProgram{
@@ -520,7 +907,7 @@ public:
 	IRProgram(TypeAnalysis * taIn) : ta(taIn){
 		procs = new std::list<Procedure *>();
 	}
-	Procedure * makeProc(std::string name);
+	Procedure * makeProc(const std::string& name);
 	std::list<Procedure *> * getProcs();
 	Label * makeLabel();
 	Opd * makeString(std::string val);
@@ -532,8 +919,33 @@ public:
 
 	std::string toString(bool verbose=false);
 
-	void toX64(std::ostream& out);
+	//Inline calls to procedures of at most maxSize quads
+	// (or up to four times that for a procedure called from
+	// just one place), as long as the caller stays within 64
+	// times maxSize quads. Then drop the procedures main can no
+	// longer reach. A maxSize of 0 turns inlining off.
+	void inlineCalls(size_t maxSize);
+	//Run the machine-independent optimizations over each
+	// procedure
+	void optimize();
+	void toX64(std::ostream& out, bool optimize=false);
+	//Write the same program as an ELF relocatable object
+	void toElf(std::ostream& out, bool optimize=false);
+	//Compile the program into this process and run it, returning
+	// what its main returns
+	int run(bool optimize=false);
+	//Run the program by interpreting its quads, returning what
+	// its main returns
+	int interpret();
+	//Lower the program to bytecode for the VM
+	Bytecode toBytecode();
+	//Run the program's bytecode in the VM, returning what its
+	// main returns
+	int runVM();
 private:
+	ObjectFile toObject(bool optimize);
+	//The bytes of a string literal, as written in the source
+	static std::string stringBytes(const std::string& lit);
 	TypeAnalysis * ta;
 	size_t max_label = 0;
 	size_t str_idx = 0;
@@ -545,6 +957,107 @@ private:
 	void allocGlobals();
 };
 
+class BasicBlock{
+public:
+	static const size_t NONE = SIZE_MAX;
+
+	size_t getID() const { return myID; }
+	//Indices of the block's first and last quads in the
+	// graph's getQuads()
+	size_t getFirst() const { return first; }
+	size_t getLast() const { return last; }
+	const std::vector<size_t>& getPreds() const { return preds; }
+	const std::vector<size_t>& getSuccs() const { return succs; }
+	//The immediate dominator, or NONE for the entry block and
+	// for blocks that cannot be reached from it
+	size_t getIDom() const { return idom; }
+	bool isReachable() const { return reachable; }
+	//The innermost loop containing the block, or NONE
+	size_t getLoop() const { return loop; }
+	size_t getLoopDepth() const { return loopDepth; }
+private:
+	BasicBlock(size_t idIn, size_t firstIn)
+	: myID(idIn), first(firstIn), last(firstIn),
+	  idom(NONE), reachable(false), loop(NONE), loopDepth(0){ }
+	friend class ControlFlowGraph;
+
+	size_t myID;
+	size_t first;
+	size_t last;
+	std::vector<size_t> preds;
+	std::vector<size_t> succs;
+	size_t idom;
+	bool reachable;
+	size_t loop;
+	size_t loopDepth;
+};
+
+//A natural loop: the header and every block that can reach
+// a back edge into it without passing through the header.
+// Loops with the same header are merged.
+class Loop{
+public:
+	size_t getHeader() const { return header; }
+	//The enclosing loop, or BasicBlock::NONE
+	size_t getParent() const { return parent; }
+	size_t getDepth() const { return depth; }
+	//Sorted block ids, including the header
+	const std::vector<size_t>& getBlocks() const { return blocks; }
+	bool contains(size_t block) const;
+private:
+	friend class ControlFlowGraph;
+	size_t header;
+	size_t parent;
+	size_t depth;
+	std::vector<size_t> blocks;
+};
+
+//Basic blocks of a procedure, split at labels and after
+// jumps, along with the dominator tree and loop nest.
+// Block 0 starts with the EnterQuad and the last block
+// ends with the LeaveQuad.
+class ControlFlowGraph{
+public:
+	ControlFlowGraph(Procedure * proc);
+	const std::vector<Quad *>& getQuads() const { return quads; }
+	const std::vector<BasicBlock>& getBlocks() const { return blocks; }
+	const BasicBlock& getBlock(size_t id) const { return blocks[id]; }
+	size_t numBlocks() const { return blocks.size(); }
+	//The block holding the quad at the given index
+	size_t blockOf(size_t quadIdx) const { return quadBlocks[quadIdx]; }
+	//Reachable blocks, each before all of its successors
+	// except along back edges
+	const std::vector<size_t>& reversePostorder() const { return rpo; }
+	bool dominates(size_t a, size_t b) const;
+	const std::vector<size_t>& domChildren(size_t block) const {
+		return children[block];
+	}
+	//The blocks where the dominance of the given block ends
+	const std::vector<size_t>& dominanceFrontier(size_t block) const {
+		return frontiers[block];
+	}
+	const std::vector<Loop>& getLoops() const { return loops; }
+	std::string toString() const;
+private:
+	void buildBlocks();
+	void buildDominators();
+	void buildLoops();
+
+	std::vector<Quad *> quads;
+	std::vector<size_t> quadBlocks;
+	std::vector<BasicBlock> blocks;
+	std::vector<size_t> rpo;
+	//Position of each block in rpo, or NONE if unreachable
+	std::vector<size_t> rpoIndex;
+	//Preorder entry and exit numbers in the dominator tree,
+	// so that dominance checks are two comparisons
+	std::vector<size_t> domIn;
+	std::vector<size_t> domOut;
+	std::vector<std::vector<size_t>> children;
+	std::vector<std::vector<size_t>> frontiers;
+	std::vector<Loop> loops;
+};
+
 }
 
 #endif 
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cstdlib>
+#include "3ac.hpp"
+#include "bytecode.hpp"
+
+namespace cminusminus{
+
+// Lowering to bytecode. Each quad becomes one instruction, so a
+// label resolves to the index of its quad past the procedure's
+// entry. Every operand a procedure mentions gets a register of
+// its own; globals and literals are numbered across the whole
+// program. Phis have to be gone, as for codegen.
+//
+// As in the generated code, every operand is a quadword and a
+// pointer is the real address of one, so the 8- and 64-bit
+// operators lower alike.
+
+//What the procedures share while they are lowered
+struct BytecodeBuilder{
+	HashMap<Opd *, uint32_t> globals;
+	HashMap<Opd *, uint32_t> literals;
+	std::vector<int64_t> consts;
+	std::vector<Bytecode::String> strings;
+	std::map<std::string, uint32_t> procIdxs;
+	std::vector<Bytecode::Proc> procs;
+	std::vector<Bytecode::Inst> code;
+	uint32_t numArgs = 0;
+};
+
+static Bytecode::Op binOpCode(BinOp op){
+	switch (op){
+	case ADD64: case ADD8: return Bytecode::ADD;
+	case SUB64: case SUB8: return Bytecode::SUB;
+	case MULT64: case MULT8: return Bytecode::MULT;
+	case DIV64: case DIV8: return Bytecode::DIV;
+	case EQ64: case EQ8: return Bytecode::EQ;
+	case NEQ64: case NEQ8: return Bytecode::NEQ;
+	case LT64: case LT8: return Bytecode::LT;
+	case GT64: case GT8: return Bytecode::GT;
+	case LTE64: case LTE8: return Bytecode::LTE;
+	case GTE64: case GTE8: return Bytecode::GTE;
+	case OR64: case OR8: return Bytecode::OR;
+	case AND64: case AND8: return Bytecode::AND;
+	}
+	throw new InternalError("Bad BinOp");
+}
+
+//The jump taken unless the comparison holds
+static Bytecode::Op fusedJump(BinOp cmp){
+	switch (cmp){
+	case EQ64: case EQ8: return Bytecode::IFZ_EQ;
+	case NEQ64: case NEQ8: return Bytecode::IFZ_NEQ;
+	case LT64: case LT8: return Bytecode::IFZ_LT;
+	case GT64: case GT8: return Bytecode::IFZ_GT;
+	case LTE64: case LTE8: return Bytecode::IFZ_LTE;
+	case GTE64: case GTE8: return Bytecode::IFZ_GTE;
+	default:
+		throw new InternalError("Fused IFZ on a non-comparison");
+	}
+}
+
+static void lowerProc(Procedure * proc, BytecodeBuilder& prog){
+	std::vector<Quad *> quads;
+	quads.push_back(proc->getEnter());
+	for (Quad * quad : *proc->getQuads()){ quads.push_back(quad); }
+	quads.push_back(proc->getLeave());
+	uint32_t entry = static_cast<uint32_t>(prog.code.size());
+	HashMap<Label *, uint32_t> labels;
+	for (size_t i = 0; i < quads.size(); i++){
+		for (Label * label : quads[i]->getLabels()){
+			labels[label] = entry + static_cast<uint32_t>(i);
+		}
+	}
+	auto target = [&](Label * label){
+		auto found = labels.find(label);
+		if (found == labels.end()){
+			throw new InternalError(("no quad for " + label->getName()).c_str());
+		}
+		return found->second;
+	};
+	auto callee = [&](SemSymbol * sym){
+		auto found = prog.procIdxs.find(sym->getName());
+		if (found == prog.procIdxs.end()){
+			throw new InternalError(("no procedure " + sym->getName()).c_str());
+		}
+		return found->second;
+	};
+
+	HashMap<Opd *, uint32_t> regs;
+	Bytecode::Inst inst;
+	//Set the field to the operand's value, or with asAddr set,
+	// to the address an AddrOpd holds
+	auto field = [&](size_t f, Opd * opd, bool asAddr){
+		uint32_t idx;
+		Bytecode::Kind kind;
+		if (LitOpd * lit = opd->asLit()){
+			auto found = prog.literals.find(lit);
+			if (found == prog.literals.end()){
+				char * end = nullptr;
+				std::string str = lit->valString();
+				int64_t val = std::strtoll(str.c_str(), &end, 10);
+				if (str.empty() || *end != '\0'){
+					throw new InternalError(("bad literal " + str).c_str());
+				}
+				idx = static_cast<uint32_t>(prog.consts.size());
+				prog.consts.push_back(val);
+				prog.literals[lit] = idx;
+			} else {
+				idx = found->second;
+			}
+			kind = Bytecode::CONST;
+		} else if (prog.globals.count(opd) > 0){
+			idx = prog.globals[opd];
+			kind = Bytecode::GLOBAL;
+		} else {
+			auto found = regs.find(opd);
+			if (found == regs.end()){
+				idx = static_cast<uint32_t>(regs.size());
+				regs[opd] = idx;
+			} else {
+				idx = found->second;
+			}
+			bool deref = opd->asAddr() != nullptr && !asAddr;
+			kind = deref ? Bytecode::DEREF : Bytecode::REG;
+		}
+		inst.fields[f] = idx;
+		inst.setKind(f, kind);
+	};
+	auto val = [&](size_t f, Opd * opd){ field(f, opd, false); };
+
+	for (Quad * quad : quads){
+		inst = Bytecode::Inst{Bytecode::NOP, 0, 0, {0, 0, 0}};
+		if (BinOpQuad * binop = quad->asBinOp()){
+			inst.op = binOpCode(binop->getOp());
+			val(0, binop->getDst());
+			val(1, binop->getSrc1());
+			val(2, binop->getSrc2());
+		} else if (UnaryOpQuad * unary = quad->asUnaryOp()){
+			UnaryOp op = unary->getOp();
+			inst.op = op == NEG64 || op == NEG8 ? Bytecode::NEG : Bytecode::NOT;
+			val(0, unary->getDst());
+			val(1, unary->getSrc());
+		} else if (AssignQuad * assign = quad->asAssign()){
+			inst.op = Bytecode::COPY;
+			val(0, assign->getDst());
+			val(1, assign->getSrc());
+		} else if (LocQuad * loc = quad->asLoc()){
+			//Taking the location of an AddrOpd reads the address
+			// it holds, so only other operands need ADDR
+			Opd * src = loc->getSrc();
+			bool addrOf = loc->isSrcLoc() && src->asAddr() == nullptr;
+			inst.op = addrOf ? Bytecode::ADDR : Bytecode::COPY;
+			field(0, loc->getTgt(), loc->isTgtLoc());
+			field(1, src, loc->isSrcLoc());
+		} else if (GotoQuad * jmp = quad->asGoto()){
+			inst.op = Bytecode::GOTO;
+			inst.fields[0] = target(jmp->getTarget());
+		} else if (IfzQuad * ifz = quad->asIfz()){
+			inst.fields[0] = target(ifz->getTarget());
+			if (ifz->isFused()){
+				inst.op = fusedJump(ifz->getCmp());
+				val(1, ifz->getSrc1());
+				val(2, ifz->getSrc2());
+			} else {
+				inst.op = Bytecode::IFZ;
+				val(1, ifz->getCnd());
+			}
+		} else if (IntrinsicOutputQuad * out = quad->asIntrinsicOutput()){
+			const DataType * type = out->getType();
+			inst.op = type->isBool() ? Bytecode::PRINT_BOOL
+				: type->isString() ? Bytecode::PRINT_STRING : Bytecode::PRINT_INT;
+			val(1, out->getSrc());
+		} else if (IntrinsicInputQuad * in = quad->asIntrinsicInput()){
+			if (in->getType()->isString()){
+				throw new InternalError("Cannot read a string");
+			}
+			inst.op = in->getType()->isBool() ? Bytecode::READ_BOOL
+				: Bytecode::READ_INT;
+			val(0, in->getDst());
+		} else if (SetArgQuad * setArg = quad->asSetArg()){
+			inst.op = Bytecode::SET_ARG;
+			inst.fields[0] = static_cast<uint32_t>(setArg->getIndex());
+			val(1, setArg->getSrc());
+			prog.numArgs = std::max(prog.numArgs, inst.fields[0]);
+		} else if (GetArgQuad * getArg = quad->asGetArg()){
+			inst.op = Bytecode::GET_ARG;
+			val(0, getArg->getDst());
+			inst.fields[1] = static_cast<uint32_t>(getArg->getIndex());
+			prog.numArgs = std::max(prog.numArgs, inst.fields[1]);
+		} else if (CallQuad * call = quad->asCall()){
+			inst.op = Bytecode::CALL;
+			inst.fields[0] = callee(call->getCallee());
+		} else if (TailCallQuad * tail = quad->asTailCall()){
+			inst.op = Bytecode::TAIL_CALL;
+			inst.fields[0] = callee(tail->getCallee());
+		} else if (SetRetQuad * setRet = quad->asSetRet()){
+			inst.op = Bytecode::SET_RET;
+			val(1, setRet->getSrc());
+		} else if (GetRetQuad * getRet = quad->asGetRet()){
+			inst.op = Bytecode::GET_RET;
+			val(0, getRet->getDst());
+		} else if (quad->asLeave()){
+			inst.op = Bytecode::LEAVE;
+		} else if (quad->asPhi()){
+			throw new InternalError("Phi left in the procedure (fromSSA not run)");
+		}
+		prog.code.push_back(inst);
+	}
+	prog.procs.push_back(Bytecode::Proc{proc->getName(), entry,
+		static_cast<uint32_t>(regs.size())});
+}
+
+Bytecode IRProgram::toBytecode(){
+	BytecodeBuilder prog;
+	uint32_t numGlobals = 0;
+	for (auto global : globals){ prog.globals[global.second] = numGlobals++; }
+	//A string literal's constant comes to hold the address of
+	// its bytes when the program is loaded
+	for (auto entry : strings){
+		uint32_t idx = static_cast<uint32_t>(prog.consts.size());
+		prog.consts.push_back(0);
+		prog.literals[entry.first] = idx;
+		prog.strings.push_back(Bytecode::String{idx, stringBytes(entry.second)});
+	}
+	for (auto proc : *procs){
+		uint32_t idx = static_cast<uint32_t>(prog.procIdxs.size());
+		prog.procIdxs[proc->getName()] = idx;
+	}
+	for (auto proc : *procs){ lowerProc(proc, prog); }
+	return Bytecode(prog.procs, prog.code, prog.consts, prog.strings,
+		numGlobals, prog.numArgs);
+}
+
+int IRProgram::runVM(){
+	return static_cast<int>(toBytecode().run());
+}
+
+}
@@ -0,0 +1,309 @@
+#include <algorithm>
+#include "3ac.hpp"
+
+namespace cminusminus{
+
+const size_t BasicBlock::NONE;
+
+ControlFlowGraph * Procedure::getCFG(){
+	if (cfg == nullptr){
+		cfg = new ControlFlowGraph(this);
+	}
+	return cfg;
+}
+
+void Procedure::invalidateCFG(){
+	delete cfg;
+	cfg = nullptr;
+}
+
+bool Loop::contains(size_t block) const{
+	return std::binary_search(blocks.begin(), blocks.end(), block);
+}
+
+ControlFlowGraph::ControlFlowGraph(Procedure * proc){
+	quads.push_back(proc->getEnter());
+	for (auto quad : *proc->getQuads()){ quads.push_back(quad); }
+	quads.push_back(proc->getLeave());
+
+	buildBlocks();
+	buildDominators();
+	buildLoops();
+}
+
+//A new block starts at every labeled quad and right after
+// every jump. Blocks are numbered in program order.
+void ControlFlowGraph::buildBlocks(){
+	HashMap<Label *, size_t> labelBlocks;
+	quadBlocks.resize(quads.size());
+	for (size_t i = 0; i < quads.size(); i++){
+		bool leader = i == 0 || !quads[i]->getLabels().empty();
+		if (i > 0){
+			Quad * prev = quads[i-1];
+			if (prev->asGoto() || prev->asIfz() || prev->asLeave()){
+				leader = true;
+			}
+		}
+		if (leader){
+			blocks.push_back(BasicBlock(blocks.size(), i));
+		}
+		blocks.back().last = i;
+		quadBlocks[i] = blocks.size() - 1;
+		for (Label * label : quads[i]->getLabels()){
+			labelBlocks[label] = blocks.size() - 1;
+		}
+	}
+
+	auto addEdge = [&](size_t from, size_t to){
+		std::vector<size_t>& succs = blocks[from].succs;
+		if (std::find(succs.begin(), succs.end(), to) != succs.end()){
+			return;
+		}
+		succs.push_back(to);
+		blocks[to].preds.push_back(from);
+	};
+	for (BasicBlock& block : blocks){
+		Quad * last = quads[block.last];
+		Label * tgt = nullptr;
+		bool fallsThrough = true;
+		if (GotoQuad * jmp = last->asGoto()){
+			tgt = jmp->getTarget();
+			fallsThrough = false;
+		} else if (IfzQuad * ifz = last->asIfz()){
+			tgt = ifz->getTarget();
+		} else if (last->asLeave()){
+			fallsThrough = false;
+		}
+		if (fallsThrough && block.myID + 1 < blocks.size()){
+			addEdge(block.myID, block.myID + 1);
+		}
+		if (tgt != nullptr){
+			auto found = labelBlocks.find(tgt);
+			if (found == labelBlocks.end()){
+				throw new InternalError("Jump to unknown label");
+			}
+			addEdge(block.myID, found->second);
+		}
+	}
+}
+
+//Cooper, Harvey and Kennedy's iterative algorithm: process the
+// blocks in reverse postorder, setting each block's dominator
+// to the common ancestor of its processed predecessors, until
+// nothing changes
+void ControlFlowGraph::buildDominators(){
+	size_t numBlocks = blocks.size();
+	std::vector<size_t> postorder;
+	std::vector<bool> visited(numBlocks, false);
+	//Explicit stack of (block, next successor to visit)
+	std::vector<std::pair<size_t, size_t>> stack;
+	stack.push_back(std::make_pair(0, 0));
+	visited[0] = true;
+	while (!stack.empty()){
+		size_t cur = stack.back().first;
+		size_t& next = stack.back().second;
+		if (next < blocks[cur].succs.size()){
+			size_t succ = blocks[cur].succs[next++];
+			if (!visited[succ]){
+				visited[succ] = true;
+				stack.push_back(std::make_pair(succ, 0));
+			}
+		} else {
+			postorder.push_back(cur);
+			stack.pop_back();
+		}
+	}
+	rpo.assign(postorder.rbegin(), postorder.rend());
+	rpoIndex.assign(numBlocks, BasicBlock::NONE);
+	for (size_t i = 0; i < rpo.size(); i++){
+		rpoIndex[rpo[i]] = i;
+		blocks[rpo[i]].reachable = true;
+	}
+
+	auto intersect = [&](size_t a, size_t b){
+		while (a != b){
+			while (rpoIndex[a] > rpoIndex[b]){ a = blocks[a].idom; }
+			while (rpoIndex[b] > rpoIndex[a]){ b = blocks[b].idom; }
+		}
+		return a;
+	};
+	//The entry temporarily dominates itself so that the
+	// walks in intersect stop there
+	blocks[0].idom = 0;
+	bool changed = true;
+	while (changed){
+		changed = false;
+		for (size_t i = 1; i < rpo.size(); i++){
+			BasicBlock& block = blocks[rpo[i]];
+			size_t newIDom = BasicBlock::NONE;
+			for (size_t pred : block.preds){
+				if (blocks[pred].idom == BasicBlock::NONE){
+					continue;
+				}
+				if (newIDom == BasicBlock::NONE){
+					newIDom = pred;
+				} else {
+					newIDom = intersect(pred, newIDom);
+				}
+			}
+			if (block.idom != newIDom){
+				block.idom = newIDom;
+				changed = true;
+			}
+		}
+	}
+	blocks[0].idom = BasicBlock::NONE;
+
+	//Number the dominator tree
+	children.assign(numBlocks, std::vector<size_t>());
+	for (size_t b : rpo){
+		if (blocks[b].idom != BasicBlock::NONE){
+			children[blocks[b].idom].push_back(b);
+		}
+	}
+	domIn.assign(numBlocks, BasicBlock::NONE);
+	domOut.assign(numBlocks, BasicBlock::NONE);
+	size_t counter = 0;
+	stack.clear();
+	stack.push_back(std::make_pair(0, 0));
+	domIn[0] = counter++;
+	while (!stack.empty()){
+		size_t cur = stack.back().first;
+		size_t& next = stack.back().second;
+		if (next < children[cur].size()){
+			size_t child = children[cur][next++];
+			domIn[child] = counter++;
+			stack.push_back(std::make_pair(child, 0));
+		} else {
+			domOut[cur] = counter++;
+			stack.pop_back();
+		}
+	}
+
+	//A join is in the frontier of every block on the way up
+	// from each of its predecessors to its immediate dominator
+	frontiers.assign(numBlocks, std::vector<size_t>());
+	for (size_t b : rpo){
+		const BasicBlock& block = blocks[b];
+		if (block.preds.size() < 2){ continue; }
+		for (size_t pred : block.preds){
+			if (!blocks[pred].reachable){ continue; }
+			size_t runner = pred;
+			while (runner != block.idom){
+				std::vector<size_t>& df = frontiers[runner];
+				if (df.empty() || df.back() != b){
+					df.push_back(b);
+				}
+				runner = blocks[runner].idom;
+			}
+		}
+	}
+}
+
+bool ControlFlowGraph::dominates(size_t a, size_t b) const{
+	if (!blocks[a].reachable || !blocks[b].reachable){
+		return false;
+	}
+	return domIn[a] <= domIn[b] && domOut[b] <= domOut[a];
+}
+
+//Every edge into a block that dominates its source is a back
+// edge, and the loop it closes is everything that reaches the
+// source without going through the header
+void ControlFlowGraph::buildLoops(){
+	HashMap<size_t, size_t> headerLoops;
+	std::vector<std::vector<bool>> members;
+	for (size_t b : rpo){
+		for (size_t succ : blocks[b].succs){
+			if (!dominates(succ, b)){ continue; }
+
+			size_t loopIdx;
+			auto found = headerLoops.find(succ);
+			if (found == headerLoops.end()){
+				loopIdx = loops.size();
+				headerLoops[succ] = loopIdx;
+				Loop loop;
+				loop.header = succ;
+				loop.parent = BasicBlock::NONE;
+				loop.depth = 0;
+				loop.blocks.push_back(succ);
+				loops.push_back(loop);
+				members.push_back(std::vector<bool>(blocks.size(), false));
+				members.back()[succ] = true;
+			} else {
+				loopIdx = found->second;
+			}
+
+			std::vector<bool>& inLoop = members[loopIdx];
+			std::vector<size_t> work;
+			if (!inLoop[b]){
+				inLoop[b] = true;
+				work.push_back(b);
+			}
+			while (!work.empty()){
+				size_t cur = work.back();
+				work.pop_back();
+				loops[loopIdx].blocks.push_back(cur);
+				for (size_t pred : blocks[cur].preds){
+					if (!blocks[pred].reachable || inLoop[pred]){
+						continue;
+					}
+					inLoop[pred] = true;
+					work.push_back(pred);
+				}
+			}
+		}
+	}
+	for (Loop& loop : loops){
+		std::sort(loop.blocks.begin(), loop.blocks.end());
+	}
+
+	//Natural loops with different headers are either nested or
+	// disjoint, so visiting them from largest to smallest sees
+	// every loop after the ones enclosing it
+	std::vector<size_t> bySize(loops.size());
+	for (size_t i = 0; i < loops.size(); i++){ bySize[i] = i; }
+	std::stable_sort(bySize.begin(), bySize.end(),
+		[&](size_t a, size_t b){
+			return loops[a].blocks.size() > loops[b].blocks.size();
+		});
+	for (size_t idx : bySize){
+		Loop& loop = loops[idx];
+		size_t parent = blocks[loop.header].loop;
+		loop.parent = parent;
+		loop.depth = parent == BasicBlock::NONE ? 1
+			: loops[parent].depth + 1;
+		for (size_t b : loop.blocks){
+			blocks[b].loop = idx;
+			blocks[b].loopDepth = loop.depth;
+		}
+	}
+}
+
+std::string ControlFlowGraph::toString() const{
+	std::string res = "";
+	for (const BasicBlock& block : blocks){
+		res += "BB" + std::to_string(block.myID) + " ["
+			+ std::to_string(block.first) + ", "
+			+ std::to_string(block.last) + "]";
+		if (!block.reachable){
+			res += " unreachable\n";
+			continue;
+		}
+		res += " succs:";
+		for (size_t succ : block.succs){
+			res += " BB" + std::to_string(succ);
+		}
+		if (block.idom != BasicBlock::NONE){
+			res += " idom: BB" + std::to_string(block.idom);
+		}
+		if (block.loop != BasicBlock::NONE){
+			res += " loop: BB" + std::to_string(loops[block.loop].header)
+				+ " depth: " + std::to_string(block.loopDepth);
+		}
+		res += "\n";
+	}
+	return res;
+}
+
+}
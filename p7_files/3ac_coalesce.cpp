@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <numeric>
+#include "3ac.hpp"
+#include "dataflow.hpp"
+
+namespace cminusminus{
+
+// Copy coalescing. Leaving SSA puts a copy on every edge into
+// a phi's block and another where the phi was, and most of
+// them copy between operands that are never live at the same
+// time. Those operands are merged into one, after which the
+// copy moves a value onto itself and goes. This is Chaitin's
+// aggressive coalescing: interference is found as for stack
+// slots (see colorSlots), except that a copy does not make its
+// destination interfere with its source, since both hold the
+// same value, and a merged operand interferes with everything
+// either half did.
+//
+// When a formal or local is merged with temps it is the one
+// kept, so the 3AC keeps its names.
+
+void Procedure::coalesceCopies(){
+	std::vector<Opd *> opds = promotableOpds();
+	HashMap<Opd *, size_t> opdIdx;
+	for (size_t o = 0; o < opds.size(); o++){ opdIdx[opds[o]] = o; }
+	auto index = [&](Opd * opd){
+		auto found = opdIdx.find(opd);
+		return found == opdIdx.end() ? BasicBlock::NONE : found->second;
+	};
+
+	ControlFlowGraph * graph = getCFG();
+	const std::vector<Quad *>& quads = graph->getQuads();
+	Liveness live(graph, opdIdx);
+
+	std::vector<std::set<size_t>> interferes(opds.size());
+	std::vector<std::pair<size_t, size_t>> copies;
+	for (const BasicBlock& block : graph->getBlocks()){
+		BitSet liveNow = live.liveOut(block.getID());
+		size_t i = block.getLast() + 1;
+		while (i-- > block.getFirst()){
+			Quad * quad = quads[i];
+			size_t copySrc = BasicBlock::NONE;
+			if (AssignQuad * assign = quad->asAssign()){
+				copySrc = index(assign->getSrc());
+				size_t copyDst = index(assign->getDst());
+				if (copySrc != BasicBlock::NONE && copyDst != BasicBlock::NONE){
+					copies.push_back(std::make_pair(copyDst, copySrc));
+				}
+			}
+			for (Opd * def : quad->getDefs()){
+				size_t d = index(def);
+				if (d == BasicBlock::NONE){ continue; }
+				liveNow.forEach([&](size_t other){
+					if (other == d || other == copySrc){ return; }
+					interferes[d].insert(other);
+					interferes[other].insert(d);
+				});
+			}
+			for (Opd * def : quad->getDefs()){
+				size_t d = index(def);
+				if (d != BasicBlock::NONE){ liveNow.reset(d); }
+			}
+			for (Opd * use : quad->getUses()){
+				size_t u = index(use);
+				if (u != BasicBlock::NONE){ liveNow.set(u); }
+			}
+		}
+	}
+
+	//Union-find over the operands. Only roots appear in the
+	// interference sets.
+	std::vector<size_t> root(opds.size());
+	std::iota(root.begin(), root.end(), 0);
+	auto find = [&](size_t o){
+		while (root[o] != o){
+			root[o] = root[root[o]];
+			o = root[o];
+		}
+		return o;
+	};
+	bool merged = false;
+	for (auto copy : copies){
+		size_t keep = find(copy.first);
+		size_t gone = find(copy.second);
+		if (keep == gone || interferes[keep].count(gone) > 0){ continue; }
+		if (opds[keep]->asSym() == nullptr && opds[gone]->asSym() != nullptr){
+			std::swap(keep, gone);
+		}
+		root[gone] = keep;
+		for (size_t other : interferes[gone]){
+			interferes[other].erase(gone);
+			interferes[other].insert(keep);
+			interferes[keep].insert(other);
+		}
+		interferes[gone].clear();
+		merged = true;
+	}
+	if (!merged){ return; }
+
+	HashMap<Quad *, Quad *> replacements;
+	for (Quad * quad : quads){
+		for (Opd * use : quad->getUses()){
+			size_t u = index(use);
+			if (u != BasicBlock::NONE && find(u) != u){
+				quad->replaceUses(use, opds[find(u)]);
+			}
+		}
+		for (Opd * def : quad->getDefs()){
+			size_t d = index(def);
+			if (d != BasicBlock::NONE && find(d) != d){
+				quad->replaceDefs(def, opds[find(d)]);
+			}
+		}
+		AssignQuad * assign = quad->asAssign();
+		if (assign != nullptr && assign->getDst() == assign->getSrc()){
+			replacements[quad] = nullptr;
+		}
+	}
+	rewriteQuads(replacements, std::vector<bool>(graph->numBlocks(), true));
+}
+
+}
@@ -0,0 +1,338 @@
+#include <cstdlib>
+#include <limits>
+#include "3ac.hpp"
+
+namespace cminusminus{
+
+// Sparse conditional constant propagation (Wegman & Zadeck).
+// Every SSA variable starts out unknown and only moves down the
+// lattice, and a block is only evaluated once some edge into it
+// is known to be taken, so constants that flow around loops and
+// branches that are never taken are both found.
+//
+// The procedure is then rewritten: uses of constant variables
+// become literals, the quads defining them are dropped, IFZs on
+// constants become gotos (or disappear), and blocks that are
+// never reached are deleted.
+
+namespace{
+
+struct ConstVal{
+	enum Kind { TOP, CONST, BOTTOM };
+	Kind kind;
+	int64_t val;
+
+	static ConstVal top(){ return ConstVal{TOP, 0}; }
+	static ConstVal bottom(){ return ConstVal{BOTTOM, 0}; }
+	static ConstVal constant(int64_t v){ return ConstVal{CONST, v}; }
+	bool isConst() const { return kind == CONST; }
+	bool operator==(const ConstVal& other) const{
+		return kind == other.kind && (kind != CONST || val == other.val);
+	}
+	ConstVal meet(const ConstVal& other) const{
+		if (kind == TOP){ return other; }
+		if (other.kind == TOP){ return *this; }
+		if (*this == other){ return *this; }
+		return bottom();
+	}
+};
+
+}
+
+//The value of a numeric literal. String literals (whose value
+// is a label) are not numbers.
+static bool literalValue(LitOpd * lit, int64_t& res){
+	std::string str = lit->valString();
+	if (str.empty()){ return false; }
+	char * end = nullptr;
+	long long val = std::strtoll(str.c_str(), &end, 10);
+	if (*end != '\0'){ return false; }
+	res = val;
+	return true;
+}
+
+static int64_t wrap(uint64_t val){ return static_cast<int64_t>(val); }
+
+static int64_t toByte(int64_t val){ return static_cast<int8_t>(val); }
+
+static bool isByteOp(BinOp opr){
+	switch(opr){
+	case ADD8: case SUB8: case DIV8: case MULT8: case EQ8: case NEQ8:
+	case LT8: case GT8: case LTE8: case GTE8: case OR8: case AND8:
+		return true;
+	default:
+		return false;
+	}
+}
+
+//Compute opr on two constants the way the generated code would.
+// The 8-bit opcodes work on the low bytes of their operands and
+// produce a byte. Division that would trap is left for runtime.
+static bool foldBinOp(BinOp opr, int64_t a, int64_t b, int64_t& res){
+	bool byteOp = isByteOp(opr);
+	if (byteOp){
+		a = toByte(a);
+		b = toByte(b);
+	}
+	uint64_t ua = static_cast<uint64_t>(a);
+	uint64_t ub = static_cast<uint64_t>(b);
+	switch(opr){
+	case ADD64: case ADD8: res = wrap(ua + ub); break;
+	case SUB64: case SUB8: res = wrap(ua - ub); break;
+	case MULT64: case MULT8: res = wrap(ua * ub); break;
+	case DIV64: case DIV8:
+		if (b == 0){ return false; }
+		if (b == -1){
+			int64_t min = byteOp ? std::numeric_limits<int8_t>::min()
+				: std::numeric_limits<int64_t>::min();
+			if (a == min){ return false; }
+		}
+		res = a / b;
+		break;
+	case AND64: case AND8: res = a & b; break;
+	case OR64: case OR8: res = a | b; break;
+	case EQ64: case EQ8: res = a == b; break;
+	case NEQ64: case NEQ8: res = a != b; break;
+	case LT64: case LT8: res = a < b; break;
+	case GT64: case GT8: res = a > b; break;
+	case LTE64: case LTE8: res = a <= b; break;
+	case GTE64: case GTE8: res = a >= b; break;
+	}
+	if (byteOp){ res = toByte(res); }
+	return true;
+}
+
+static int64_t foldUnaryOp(UnaryOp op, int64_t a){
+	switch(op){
+	case NEG64: return wrap(0 - static_cast<uint64_t>(a));
+	case NEG8: return toByte(wrap(0 - static_cast<uint64_t>(a)));
+	//Booleans are always 0 or 1
+	case NOT64: case NOT8: return a ^ 1;
+	}
+	throw new InternalError("Bad unary op");
+}
+
+void Procedure::propagateConstants(){
+	const std::vector<Opd *>& vars = ssaVars();
+	HashMap<Opd *, size_t> varIdx;
+	for (size_t v = 0; v < vars.size(); v++){ varIdx[vars[v]] = v; }
+
+	ControlFlowGraph * graph = getCFG();
+	const std::vector<Quad *>& quads = graph->getQuads();
+	size_t numBlocks = graph->numBlocks();
+
+	//Only the SSA versions are tracked; anything else (memory,
+	// or the original of a renamed variable, which holds
+	// whatever the procedure was entered with) varies. So does
+	// a version whose definition is gone.
+	std::vector<ConstVal> values(vars.size(), ConstVal::bottom());
+	std::vector<std::vector<size_t>> useSites(vars.size());
+	for (size_t i = 0; i < quads.size(); i++){
+		for (Opd * use : quads[i]->getUses()){
+			auto found = varIdx.find(use);
+			if (found != varIdx.end()){
+				useSites[found->second].push_back(i);
+			}
+		}
+		for (Opd * def : quads[i]->getDefs()){
+			auto found = varIdx.find(def);
+			if (found != varIdx.end()){
+				values[found->second] = ConstVal::top();
+			}
+		}
+	}
+
+	auto valueOf = [&](Opd * opd){
+		if (LitOpd * lit = opd->asLit()){
+			int64_t val;
+			if (literalValue(lit, val)){ return ConstVal::constant(val); }
+			return ConstVal::bottom();
+		}
+		auto found = varIdx.find(opd);
+		if (found == varIdx.end()){ return ConstVal::bottom(); }
+		return values[found->second];
+	};
+
+	//The value an IFZ tests, folding a fused comparison
+	auto condOf = [&](IfzQuad * ifz){
+		if (!ifz->isFused()){ return valueOf(ifz->getCnd()); }
+		ConstVal a = valueOf(ifz->getSrc1());
+		ConstVal c = valueOf(ifz->getSrc2());
+		int64_t res;
+		if (a.kind == ConstVal::BOTTOM || c.kind == ConstVal::BOTTOM){
+			return ConstVal::bottom();
+		} else if (!a.isConst() || !c.isConst()){
+			return ConstVal::top();
+		} else if (foldBinOp(ifz->getCmp(), a.val, c.val, res)){
+			return ConstVal::constant(res);
+		}
+		return ConstVal::bottom();
+	};
+
+	std::vector<bool> visited(numBlocks, false);
+	std::vector<std::vector<bool>> execPreds(numBlocks);
+	for (size_t b = 0; b < numBlocks; b++){
+		execPreds[b].assign(graph->getBlock(b).getPreds().size(), false);
+	}
+	std::vector<size_t> flowWork;
+	std::vector<size_t> ssaWork;
+
+	auto lower = [&](Opd * opd, ConstVal val){
+		auto found = varIdx.find(opd);
+		if (found == varIdx.end()){ return; }
+		size_t v = found->second;
+		ConstVal next = values[v].meet(val);
+		if (next == values[v]){ return; }
+		values[v] = next;
+		for (size_t use : useSites[v]){ ssaWork.push_back(use); }
+	};
+
+	auto markEdge = [&](size_t from, size_t to){
+		const std::vector<size_t>& preds = graph->getBlock(to).getPreds();
+		size_t predIdx = 0;
+		while (preds[predIdx] != from){ predIdx++; }
+		if (execPreds[to][predIdx]){ return; }
+		execPreds[to][predIdx] = true;
+		flowWork.push_back(to);
+	};
+
+	auto evalQuad = [&](size_t i){
+		Quad * quad = quads[i];
+		size_t b = graph->blockOf(i);
+		const BasicBlock& block = graph->getBlock(b);
+		if (PhiQuad * phi = quad->asPhi()){
+			ConstVal val = ConstVal::top();
+			const std::vector<Opd *>& args = phi->getArgs();
+			for (size_t p = 0; p < args.size(); p++){
+				if (execPreds[b][p]){ val = val.meet(valueOf(args[p])); }
+			}
+			lower(phi->getDst(), val);
+		} else if (BinOpQuad * binop = quad->asBinOp()){
+			ConstVal a = valueOf(binop->getSrc1());
+			ConstVal c = valueOf(binop->getSrc2());
+			ConstVal val = ConstVal::top();
+			int64_t res;
+			if (a.kind == ConstVal::BOTTOM || c.kind == ConstVal::BOTTOM){
+				val = ConstVal::bottom();
+			} else if (a.isConst() && c.isConst()){
+				if (foldBinOp(binop->getOp(), a.val, c.val, res)){
+					val = ConstVal::constant(res);
+				} else {
+					val = ConstVal::bottom();
+				}
+			}
+			lower(binop->getDst(), val);
+		} else if (UnaryOpQuad * unop = quad->asUnaryOp()){
+			ConstVal a = valueOf(unop->getSrc());
+			if (a.isConst()){
+				a = ConstVal::constant(foldUnaryOp(unop->getOp(), a.val));
+			}
+			lower(unop->getDst(), a);
+		} else if (AssignQuad * assign = quad->asAssign()){
+			lower(assign->getDst(), valueOf(assign->getSrc()));
+		} else {
+			for (Opd * def : quad->getDefs()){
+				lower(def, ConstVal::bottom());
+			}
+		}
+
+		if (i != block.getLast()){ return; }
+		const std::vector<size_t>& succs = block.getSuccs();
+		IfzQuad * ifz = quad->asIfz();
+		ConstVal cnd = ifz ? condOf(ifz) : ConstVal::bottom();
+		if (!cnd.isConst() || succs.size() < 2){
+			for (size_t succ : succs){ markEdge(b, succ); }
+		} else if (cnd.val == 0){
+			//The block after an IFZ is its fall-through
+			markEdge(b, succs[0] == b + 1 ? succs[1] : succs[0]);
+		} else {
+			markEdge(b, b + 1);
+		}
+	};
+
+	visited[0] = true;
+	for (size_t i = 0; i <= graph->getBlock(0).getLast(); i++){
+		evalQuad(i);
+	}
+	while (!flowWork.empty() || !ssaWork.empty()){
+		if (!flowWork.empty()){
+			size_t b = flowWork.back();
+			flowWork.pop_back();
+			const BasicBlock& block = graph->getBlock(b);
+			for (size_t i = block.getFirst(); i <= block.getLast(); i++){
+				//A block seen before only has new phi inputs
+				if (visited[b] && quads[i]->asPhi() == nullptr){ break; }
+				evalQuad(i);
+			}
+			visited[b] = true;
+		} else {
+			size_t i = ssaWork.back();
+			ssaWork.pop_back();
+			if (visited[graph->blockOf(i)]){ evalQuad(i); }
+		}
+	}
+
+	//Work out the rewrite before touching the list
+	auto isConstVar = [&](Opd * opd){
+		auto found = varIdx.find(opd);
+		return found != varIdx.end() && values[found->second].isConst();
+	};
+	auto literalFor = [&](Opd * opd){
+		int64_t val = values[varIdx[opd]].val;
+		return new LitOpd(std::to_string(val), opd->getWidth());
+	};
+	//nullptr drops the quad
+	HashMap<Quad *, Quad *> replacements;
+	HashMap<PhiQuad *, std::vector<Opd *>> phiArgs;
+	for (size_t i = 1; i + 1 < quads.size(); i++){
+		Quad * quad = quads[i];
+		size_t b = graph->blockOf(i);
+		if (!visited[b]){
+			replacements[quad] = nullptr;
+			continue;
+		}
+
+		bool constDef = false;
+		for (Opd * def : quad->getDefs()){
+			constDef = constDef || isConstVar(def);
+		}
+		if (constDef){
+			replacements[quad] = nullptr;
+			continue;
+		}
+		for (Opd * use : quad->getUses()){
+			if (isConstVar(use)){ quad->replaceUses(use, literalFor(use)); }
+		}
+
+		if (PhiQuad * phi = quad->asPhi()){
+			std::vector<Opd *> args;
+			for (size_t p = 0; p < phi->getArgs().size(); p++){
+				if (execPreds[b][p]){ args.push_back(phi->getArgs()[p]); }
+			}
+			phiArgs[phi] = args;
+		} else if (IfzQuad * ifz = quad->asIfz()){
+			ConstVal cnd = condOf(ifz);
+			if (cnd.kind == ConstVal::CONST && cnd.val == 0){
+				replacements[quad] = new GotoQuad(ifz->getTarget());
+			} else if (cnd.kind == ConstVal::CONST){
+				replacements[quad] = nullptr;
+			}
+		}
+	}
+
+	rewriteQuads(replacements, visited);
+
+	graph = getCFG();
+	for (size_t i = 0; i < graph->getQuads().size(); i++){
+		PhiQuad * phi = graph->getQuads()[i]->asPhi();
+		if (phi == nullptr){ continue; }
+		const std::vector<Opd *>& args = phiArgs[phi];
+		size_t numPreds = graph->getBlock(graph->blockOf(i)).getPreds().size();
+		if (numPreds != args.size()){
+			throw new InternalError("Phi lost track of its predecessors");
+		}
+		phi->setArgs(args);
+	}
+}
+
+}
@@ -0,0 +1,81 @@
+#include "3ac.hpp"
+
+namespace cminusminus{
+
+// Dead code elimination over SSA form. A quad is needed if it
+// does anything besides set promotable variables (a call, I/O,
+// passing arguments or return values, a store to memory or a
+// jump), or if a needed quad reads a variable it sets. Every
+// SSA variable has a single definition, so marking is a walk
+// back along use-def chains from the quads that are needed
+// outright; whatever is left unmarked is dropped.
+
+void Procedure::eliminateDeadCode(){
+	const std::vector<Opd *>& vars = ssaVars();
+	HashMap<Opd *, size_t> varIdx;
+	for (size_t v = 0; v < vars.size(); v++){ varIdx[vars[v]] = v; }
+
+	ControlFlowGraph * graph = getCFG();
+	const std::vector<Quad *>& quads = graph->getQuads();
+	std::vector<size_t> defSites(vars.size(), SIZE_MAX);
+	std::vector<bool> needed(quads.size(), false);
+	std::vector<size_t> work;
+	for (size_t i = 0; i < quads.size(); i++){
+		Quad * quad = quads[i];
+		std::list<Opd *> defs = quad->getDefs();
+		bool removable = quad->isPure() && !defs.empty();
+		for (Opd * def : defs){
+			auto found = varIdx.find(def);
+			if (found == varIdx.end()){
+				removable = false;
+			} else {
+				defSites[found->second] = i;
+			}
+		}
+		if (!removable){
+			needed[i] = true;
+			work.push_back(i);
+		}
+	}
+
+	while (!work.empty()){
+		size_t i = work.back();
+		work.pop_back();
+		for (Opd * use : quads[i]->getUses()){
+			auto found = varIdx.find(use);
+			if (found == varIdx.end()){ continue; }
+			size_t def = defSites[found->second];
+			if (def != SIZE_MAX && !needed[def]){
+				needed[def] = true;
+				work.push_back(def);
+			}
+		}
+	}
+
+	HashMap<Quad *, Quad *> replacements;
+	for (size_t i = 0; i < quads.size(); i++){
+		if (!needed[i]){ replacements[quads[i]] = nullptr; }
+	}
+	if (replacements.empty()){ return; }
+	rewriteQuads(replacements, std::vector<bool>(graph->numBlocks(), true));
+}
+
+void Procedure::dropUnusedOpds(){
+	std::set<Opd *> used;
+	auto mention = [&](Quad * quad){
+		for (Opd * opd : quad->getUses()){ used.insert(opd); }
+		for (Opd * opd : quad->getDefs()){ used.insert(opd); }
+	};
+	mention(enter);
+	for (auto quad : *bodyQuads){ mention(quad); }
+	mention(leave);
+
+	for (auto itr = locals.begin(); itr != locals.end(); ){
+		if (used.count(itr->second) == 0){ itr = locals.erase(itr); }
+		else { ++itr; }
+	}
+	temps.remove_if([&](AuxOpd * tmp){ return used.count(tmp) == 0; });
+	addrOpds.remove_if([&](AddrOpd * addr){ return used.count(addr) == 0; });
+}
+
+}
@@ -0,0 +1,64 @@
+#include "3ac.hpp"
+
+namespace cminusminus{
+
+// Compare-and-branch fusion. A condition like a < b lowers to a
+// comparison into a temp that the IFZ ending the block then
+// tests, so the boolean is set, stored and reloaded just to be
+// compared to zero. When the IFZ is the temp's only reader, the
+// comparison moves into the IFZ itself and codegen emits a
+// single cmp and conditional jump.
+//
+// fromSSA may leave copies into temps between the comparison
+// and the IFZ. Temps cannot be reached through memory, so such
+// copies can be stepped over as long as they do not touch the
+// comparison's operands or result.
+
+void Procedure::fuseCompares(){
+	HashMap<Opd *, size_t> useCounts;
+	for (auto quad : *bodyQuads){
+		for (Opd * use : quad->getUses()){ useCounts[use]++; }
+	}
+
+	bool changed = false;
+	auto itr = bodyQuads->begin();
+	while (itr != bodyQuads->end()){
+		auto cur = itr++;
+		BinOpQuad * binop = (*cur)->asBinOp();
+		if (binop == nullptr || !IfzQuad::isRelational(binop->getOp())){
+			continue;
+		}
+		Opd * res = binop->getDst();
+		if (res->asAux() == nullptr || useCounts[res] != 1){ continue; }
+		Opd * src1 = binop->getSrc1();
+		Opd * src2 = binop->getSrc2();
+
+		auto next = itr;
+		IfzQuad * ifz = nullptr;
+		for (; next != bodyQuads->end(); ++next){
+			if (!(*next)->getLabels().empty()){ break; }
+			ifz = (*next)->asIfz();
+			if (ifz != nullptr){ break; }
+			AssignQuad * copy = (*next)->asAssign();
+			if (copy == nullptr){ break; }
+			Opd * dst = copy->getDst();
+			if (dst->asAux() == nullptr || dst == src1 || dst == src2
+			  || dst == res || copy->getSrc() == res){
+				break;
+			}
+		}
+		if (ifz == nullptr || ifz->isFused() || ifz->getCnd() != res){
+			continue;
+		}
+
+		IfzQuad * fused = new IfzQuad(binop->getOp(), src1, src2,
+			ifz->getTarget());
+		*next = fused;
+		for (Label * label : binop->getLabels()){ (*itr)->addLabel(label); }
+		bodyQuads->erase(cur);
+		changed = true;
+	}
+	if (changed){ invalidateCFG(); }
+}
+
+}
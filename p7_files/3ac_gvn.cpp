@@ -0,0 +1,203 @@
+#include <functional>
+#include <tuple>
+#include <utility>
+#include "3ac.hpp"
+
+namespace cminusminus{
+
+// Dominator-scoped value numbering over SSA form. The lowering
+// gives every occurrence of an expression its own quad and temp,
+// so a*b + a*b multiplies twice and each @p sets up its own
+// AddrOpd. Walking the dominator tree in preorder, a table maps
+// each expression to the operand that first held its value; a
+// quad computing an expression already in the table is dropped,
+// and its result is replaced by the earlier one everywhere. The
+// earlier quad dominates the later, and so every use of it. A
+// copy between SSA versions is dropped the same way.
+//
+// SSA versions are the values being numbered. An AddrOpd that
+// is set only once is treated like one as well, so two of them
+// holding the same pointer become the same AddrOpd, and loads
+// through it can be matched. Expressions that read memory (a
+// global, an escaped local, or through an AddrOpd) are only
+// matched within a block, and not across a call or anything
+// that might store to memory in between.
+
+//What an expression is keyed on: the kind of quad and its
+// operator, the (value numbered) operands, and the memory
+// state it reads, if any
+typedef std::tuple<int, int, Opd *, Opd *, size_t> ExprKey;
+
+enum ExprKind { BIN_EXPR, UNARY_EXPR, LOC_EXPR, LOAD_EXPR };
+
+static bool commutes(BinOp op){
+	switch (op){
+	case ADD64: case MULT64: case EQ64: case NEQ64: case OR64: case AND64:
+	case ADD8: case MULT8: case EQ8: case NEQ8: case OR8: case AND8:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void Procedure::numberValues(){
+	ControlFlowGraph * graph = getCFG();
+	const std::vector<Quad *>& quads = graph->getQuads();
+	std::set<Opd *> ssa(versions.begin(), versions.end());
+	HashMap<Opd *, size_t> addrDefs;
+	for (Quad * quad : quads){
+		for (Opd * def : quad->getDefs()){
+			if (def->asAddr()){ addrDefs[def]++; }
+		}
+	}
+	auto isValue = [&](Opd * opd){
+		return ssa.count(opd) > 0 || (opd->asAddr() && addrDefs[opd] == 1);
+	};
+
+	//The operand standing for each value number. Literals are
+	// numbered by what they say.
+	HashMap<Opd *, Opd *> leaders;
+	HashMap<std::string, Opd *> literals;
+	auto number = [&](Opd * opd) -> Opd * {
+		if (LitOpd * lit = opd->asLit()){
+			std::string key = lit->valString() + ":"
+				+ std::to_string(lit->getWidth());
+			auto found = literals.find(key);
+			if (found != literals.end()){ return found->second; }
+			literals[key] = opd;
+			return opd;
+		}
+		auto found = leaders.find(opd);
+		return found == leaders.end() ? opd : found->second;
+	};
+	//Whether reading the operand's value reads memory
+	auto readsMemory = [&](Opd * opd){
+		return opd->asLit() == nullptr && (opd->asAddr() || ssa.count(opd) == 0);
+	};
+
+	//Memory states count up, starting afresh at each block and
+	// after each quad that might write memory
+	size_t memory = 0;
+	auto writesMemory = [&](Quad * quad){
+		if (quad->asCall()){ return true; }
+		for (Opd * def : quad->getDefs()){
+			if (!isValue(def)){ return true; }
+		}
+		Opd * dst = nullptr;
+		if (BinOpQuad * binop = quad->asBinOp()){ dst = binop->getDst(); }
+		else if (UnaryOpQuad * unary = quad->asUnaryOp()){ dst = unary->getDst(); }
+		else if (AssignQuad * assign = quad->asAssign()){ dst = assign->getDst(); }
+		else if (LocQuad * loc = quad->asLoc()){
+			if (!loc->isTgtLoc()){ dst = loc->getTgt(); }
+		} else if (!quad->isPure()){
+			for (Opd * use : quad->getUses()){
+				if (use->asAddr()){ return true; }
+			}
+		}
+		return dst != nullptr && dst->asAddr() != nullptr;
+	};
+
+	std::map<ExprKey, Opd *> table;
+	HashMap<Quad *, Quad *> dropped;
+	//Number the block's quads, recording the expressions it
+	// adds so they can be taken out once its subtree is done
+	auto numberBlock = [&](size_t b, std::vector<ExprKey>& added){
+		memory++;
+		const BasicBlock& block = graph->getBlock(b);
+		for (size_t i = block.getFirst(); i <= block.getLast(); i++){
+			Quad * quad = quads[i];
+			Opd * dst = nullptr;
+			ExprKey key;
+			bool keyed = false;
+			if (BinOpQuad * binop = quad->asBinOp()){
+				Opd * src1 = number(binop->getSrc1());
+				Opd * src2 = number(binop->getSrc2());
+				if (commutes(binop->getOp()) && std::less<Opd *>()(src2, src1)){
+					std::swap(src1, src2);
+				}
+				bool mem = readsMemory(src1) || readsMemory(src2);
+				dst = binop->getDst();
+				key = ExprKey(BIN_EXPR, binop->getOp(), src1, src2, mem ? memory : 0);
+				keyed = true;
+			} else if (UnaryOpQuad * unary = quad->asUnaryOp()){
+				Opd * src = number(unary->getSrc());
+				dst = unary->getDst();
+				key = ExprKey(UNARY_EXPR, unary->getOp(), src, nullptr,
+					readsMemory(src) ? memory : 0);
+				keyed = true;
+			} else if (LocQuad * loc = quad->asLoc()){
+				//Taking an address reads no memory; the operand
+				// is only read when it is not the one located
+				Opd * src = number(loc->getSrc());
+				bool mem = !loc->isSrcLoc() && readsMemory(src);
+				int flags = (loc->isSrcLoc() ? 1 : 0) + (loc->isTgtLoc() ? 2 : 0);
+				dst = loc->getTgt();
+				key = ExprKey(LOC_EXPR, flags, src, nullptr, mem ? memory : 0);
+				keyed = loc->isTgtLoc() == (dst->asAddr() != nullptr);
+			} else if (AssignQuad * assign = quad->asAssign()){
+				Opd * src = number(assign->getSrc());
+				dst = assign->getDst();
+				bool sameWidth = src->getWidth() == dst->getWidth()
+					&& dst->getWidth() <= 8;
+				if (ssa.count(dst) > 0 && ssa.count(src) > 0 && sameWidth){
+					leaders[dst] = src;
+					dropped[quad] = nullptr;
+					continue;
+				}
+				key = ExprKey(LOAD_EXPR, 0, src, nullptr, memory);
+				keyed = sameWidth && readsMemory(src);
+			}
+
+			if (keyed && isValue(dst)){
+				auto found = table.find(key);
+				if (found != table.end()
+				  && found->second->getWidth() == dst->getWidth()){
+					leaders[dst] = found->second;
+					dropped[quad] = nullptr;
+					continue;
+				}
+				if (found == table.end()){
+					table[key] = dst;
+					added.push_back(key);
+				}
+			}
+			if (writesMemory(quad)){ memory++; }
+		}
+	};
+
+	//Walk the dominator tree, as in toSSA
+	struct Frame{
+		size_t block;
+		size_t nextChild;
+		std::vector<ExprKey> added;
+	};
+	std::vector<Frame> walk;
+	walk.push_back(Frame{0, 0, {}});
+	numberBlock(0, walk.back().added);
+	while (!walk.empty()){
+		Frame& top = walk.back();
+		const std::vector<size_t>& children = graph->domChildren(top.block);
+		if (top.nextChild < children.size()){
+			size_t child = children[top.nextChild++];
+			walk.push_back(Frame{child, 0, {}});
+			numberBlock(child, walk.back().added);
+		} else {
+			for (const ExprKey& key : top.added){ table.erase(key); }
+			walk.pop_back();
+		}
+	}
+	if (dropped.empty()){ return; }
+
+	//Every use of a dropped result, phi arguments included,
+	// now reads its leader
+	for (Quad * quad : *bodyQuads){
+		if (dropped.count(quad) > 0){ continue; }
+		for (Opd * use : quad->getUses()){
+			auto found = leaders.find(use);
+			if (found != leaders.end()){ quad->replaceUses(use, found->second); }
+		}
+	}
+	rewriteQuads(dropped, std::vector<bool>(graph->numBlocks(), true));
+}
+
+}
@@ -0,0 +1,208 @@
+#include <iterator>
+#include "3ac.hpp"
+
+namespace cminusminus{
+
+// Procedure inlining. A call costs its argument moves, the call
+// itself and the callee's whole prologue and epilogue, which
+// for a small helper is more than the work the helper does.
+// Inlining copies the callee's body into the caller instead:
+// every operand of the callee gets a fresh temp in the caller,
+// every label a fresh label, arguments become assignments to
+// the copies of the formals, and returns become an assignment
+// to the result temp and a jump past the copy. The rest of
+// the optimizations then see the callee's code in context.
+//
+// Inlining runs over the unoptimized quads, before SSA. Each
+// call site is inlined at most once, so a recursive procedure
+// is only ever unrolled one level into its callers. A caller
+// only grows so far, since the optimizations that follow take
+// more than linear time in the size of a procedure.
+
+//A caller takes no more inlined code than would grow it past
+// this many times the size limit for callees
+static const size_t CALLER_GROWTH = 64;
+
+bool Procedure::inlineCall(std::list<Quad *>::iterator& pos,
+  Procedure * callee){
+	//The arguments are set right before the call, in order
+	size_t numArgs = callee->formals.size();
+	std::vector<SetArgQuad *> setArgs(numArgs, nullptr);
+	auto first = pos;
+	for (size_t i = numArgs; i > 0; i--){
+		if (first == bodyQuads->begin()){ return false; }
+		--first;
+		SetArgQuad * setArg = (*first)->asSetArg();
+		if (setArg == nullptr || setArg->getIndex() != i){ return false; }
+		setArgs[i - 1] = setArg;
+	}
+	auto last = std::next(pos);
+	GetRetQuad * getRet = nullptr;
+	if (last != bodyQuads->end()){ getRet = (*last)->asGetRet(); }
+	if (getRet != nullptr){ ++last; }
+
+	HashMap<Opd *, Opd *> opds;
+	for (SymOpd * formal : callee->formals){
+		opds[formal] = makeTmp(formal->getWidth());
+	}
+	for (auto local : callee->locals){
+		opds[local.second] = makeTmp(local.second->getWidth());
+	}
+	for (AuxOpd * tmp : callee->temps){
+		opds[tmp] = makeTmp(tmp->getWidth());
+	}
+	for (AddrOpd * addr : callee->addrOpds){
+		opds[addr] = makeAddrOpd(addr->getWidth());
+	}
+	auto mapOpd = [&](Opd * opd){
+		auto found = opds.find(opd);
+		return found == opds.end() ? opd : found->second;
+	};
+
+	//Returns jump to the leave label, which becomes the
+	// label after the copy
+	Label * done = makeLabel();
+	HashMap<Label *, Label *> labels;
+	labels[callee->leaveLabel] = done;
+	auto mapLabel = [&](Label * label){
+		auto found = labels.find(label);
+		if (found != labels.end()){ return found->second; }
+		Label * fresh = makeLabel();
+		labels[label] = fresh;
+		return fresh;
+	};
+
+	//Labels wait for the next quad that is actually emitted,
+	// starting with those of the quads being replaced
+	std::list<Quad *> copy;
+	std::list<Label *> pending;
+	for (auto itr = first; itr != last; ++itr){
+		for (Label * label : (*itr)->getLabels()){ pending.push_back(label); }
+	}
+	auto emit = [&](Quad * quad){
+		for (Label * label : pending){ quad->addLabel(label); }
+		pending.clear();
+		copy.push_back(quad);
+	};
+
+	for (size_t i = 0; i < numArgs; i++){
+		Opd * formal = mapOpd(callee->getFormal(i));
+		Quad * arg = new AssignQuad(formal, setArgs[i]->getSrc(), false);
+		arg->setComment("Inlined arg " + std::to_string(i + 1));
+		emit(arg);
+	}
+	for (Quad * quad : *callee->bodyQuads){
+		for (Label * label : quad->getLabels()){
+			pending.push_back(mapLabel(label));
+		}
+		if (quad->asGetArg()){ continue; }
+		if (SetRetQuad * setRet = quad->asSetRet()){
+			if (getRet != nullptr){
+				emit(new AssignQuad(getRet->getDst(),
+					mapOpd(setRet->getSrc()), false));
+			}
+			continue;
+		}
+		Quad * clone = quad->clone();
+		clone->clearLabels();
+		for (Opd * use : clone->getUses()){
+			clone->replaceUses(use, mapOpd(use));
+		}
+		for (Opd * def : clone->getDefs()){
+			clone->replaceDefs(def, mapOpd(def));
+		}
+		if (GotoQuad * jmp = clone->asGoto()){
+			jmp->setTarget(mapLabel(jmp->getTarget()));
+		} else if (IfzQuad * ifz = clone->asIfz()){
+			ifz->setTarget(mapLabel(ifz->getTarget()));
+		}
+		emit(clone);
+	}
+	pending.push_back(done);
+	emit(new NopQuad());
+
+	bodyQuads->erase(first, last);
+	bodyQuads->splice(last, copy);
+	invalidateCFG();
+	pos = last;
+	return true;
+}
+
+static Procedure * calleeOf(Quad * quad,
+  const HashMap<std::string, Procedure *>& byName){
+	CallQuad * call = quad->asCall();
+	if (call == nullptr){ return nullptr; }
+	auto found = byName.find(call->getCallee()->getName());
+	return found == byName.end() ? nullptr : found->second;
+}
+
+//Add the procedures reachable from proc to order, each after
+// the procedures it calls (as far as recursion allows)
+static void postorder(Procedure * proc,
+  const HashMap<std::string, Procedure *>& byName,
+  std::set<Procedure *>& seen, std::vector<Procedure *>& order){
+	if (!seen.insert(proc).second){ return; }
+	for (Quad * quad : *proc->getQuads()){
+		Procedure * callee = calleeOf(quad, byName);
+		if (callee != nullptr){ postorder(callee, byName, seen, order); }
+	}
+	order.push_back(proc);
+}
+
+void IRProgram::inlineCalls(size_t maxSize){
+	if (maxSize == 0){ return; }
+	HashMap<std::string, Procedure *> byName;
+	for (auto proc : *procs){ byName[proc->getName()] = proc; }
+	auto mainProc = byName.find("main");
+	if (mainProc == byName.end()){ return; }
+
+	//Callees are done before their callers, so code inlined
+	// into a caller has already had its own calls inlined
+	std::set<Procedure *> seen;
+	std::vector<Procedure *> order;
+	postorder(mainProc->second, byName, seen, order);
+
+	HashMap<Procedure *, size_t> numCalls;
+	for (Procedure * proc : order){
+		for (Quad * quad : *proc->getQuads()){
+			Procedure * callee = calleeOf(quad, byName);
+			if (callee != nullptr){ numCalls[callee]++; }
+		}
+	}
+
+	size_t maxCallerSize = CALLER_GROWTH * maxSize;
+	for (Procedure * proc : order){
+		std::list<Quad *> * quads = proc->getQuads();
+		auto itr = quads->begin();
+		while (itr != quads->end()){
+			Procedure * callee = calleeOf(*itr, byName);
+			if (callee == nullptr || callee == proc){
+				++itr;
+				continue;
+			}
+			size_t size = callee->getQuads()->size();
+			bool small = size <= maxSize
+				|| (numCalls[callee] == 1 && size <= 4 * maxSize);
+			bool fits = quads->size() + size <= maxCallerSize;
+			if (!small || !fits || !proc->inlineCall(itr, callee)){
+				++itr;
+				continue;
+			}
+			numCalls[callee]--;
+			for (Quad * quad : *callee->getQuads()){
+				Procedure * inner = calleeOf(quad, byName);
+				if (inner != nullptr){ numCalls[inner]++; }
+			}
+		}
+	}
+
+	//Procedures whose calls were all inlined are never run
+	seen.clear();
+	order.clear();
+	postorder(mainProc->second, byName, seen, order);
+	procs->remove_if([&](Procedure * proc){
+		return seen.count(proc) == 0;
+	});
+}
+
+}
@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include "3ac.hpp"
+#include "stdcminusminus.h"
+
+namespace cminusminus{
+
+// An interpreter for 3AC, to run programs without generating
+// code, and to check optimized quads against unoptimized ones.
+// Each procedure is first translated into a vector of
+// instructions, one per quad, with every label resolved to an
+// instruction index and every operand to a slot: in the
+// running procedure's frame, among the globals, or in a pool
+// of constants. Running is then a loop over those vectors.
+//
+// As in the generated code, every operand is a quadword and a
+// pointer is the real address of one. Frames are carved out of
+// one block that never moves, so pointers into them stay good
+// until the frame is gone. A division the hardware would trap
+// on, or running out of stack, raises the signal the native
+// program would have died of.
+
+enum InterpOp {
+	I_ADD, I_SUB, I_MULT, I_DIV, I_EQ, I_NEQ, I_LT, I_GT, I_LTE, I_GTE,
+	I_OR, I_AND, I_NEG, I_NOT,
+	//Copy a value, or the address of an operand
+	I_COPY, I_ADDR,
+	//Jump, jump if zero, and jump unless a comparison holds
+	I_GOTO, I_IFZ, I_IFZ_CMP,
+	I_PRINT_INT, I_PRINT_BOOL, I_PRINT_STRING, I_READ_INT, I_READ_BOOL,
+	I_SET_ARG, I_GET_ARG, I_CALL, I_TAIL_CALL, I_SET_RET, I_GET_RET,
+	I_LEAVE, I_NOP
+};
+
+//Where an operand lives. An AddrOpd is a DEREF of the frame
+// slot holding the address; where it is used as an address,
+// it is just the FRAME slot.
+struct InterpRef{
+	enum Kind : uint8_t { FRAME, GLOBAL, CONST, DEREF };
+	Kind kind;
+	uint32_t idx;
+};
+
+//target is the instruction jumped to, the procedure called,
+// or the argument's index
+struct InterpInst{
+	InterpOp op;
+	InterpOp cmp;
+	InterpRef dst;
+	InterpRef src1;
+	InterpRef src2;
+	size_t target;
+};
+
+struct InterpProc{
+	std::vector<InterpInst> code;
+	size_t frameSize;
+};
+
+//What the procedures share
+struct InterpProgram{
+	HashMap<Opd *, uint32_t> globals;
+	std::vector<int64_t> consts;
+	std::map<std::string, size_t> procIdxs;
+	std::vector<InterpProc> procs;
+	size_t numArgs = 0;
+};
+
+//Frames all come out of a block of this many quadwords, the
+// same 8MB as the usual native stack
+static const size_t INTERP_STACK_SLOTS = 1 << 20;
+
+static InterpOp binOpInst(BinOp op){
+	switch (op){
+	case ADD64: case ADD8: return I_ADD;
+	case SUB64: case SUB8: return I_SUB;
+	case MULT64: case MULT8: return I_MULT;
+	case DIV64: case DIV8: return I_DIV;
+	case EQ64: case EQ8: return I_EQ;
+	case NEQ64: case NEQ8: return I_NEQ;
+	case LT64: case LT8: return I_LT;
+	case GT64: case GT8: return I_GT;
+	case LTE64: case LTE8: return I_LTE;
+	case GTE64: case GTE8: return I_GTE;
+	case OR64: case OR8: return I_OR;
+	case AND64: case AND8: return I_AND;
+	}
+	throw new InternalError("Bad BinOp");
+}
+
+static InterpProc translate(Procedure * proc, InterpProgram& prog,
+  HashMap<Opd *, uint32_t>& literals){
+	std::vector<Quad *> quads;
+	quads.push_back(proc->getEnter());
+	for (Quad * quad : *proc->getQuads()){ quads.push_back(quad); }
+	quads.push_back(proc->getLeave());
+	HashMap<Label *, size_t> labels;
+	for (size_t i = 0; i < quads.size(); i++){
+		for (Label * label : quads[i]->getLabels()){ labels[label] = i; }
+	}
+	auto target = [&](Label * label){
+		auto found = labels.find(label);
+		if (found == labels.end()){
+			throw new InternalError(("no quad for " + label->getName()).c_str());
+		}
+		return found->second;
+	};
+	auto callee = [&](SemSymbol * sym){
+		auto found = prog.procIdxs.find(sym->getName());
+		if (found == prog.procIdxs.end()){
+			throw new InternalError(("no procedure " + sym->getName()).c_str());
+		}
+		return found->second;
+	};
+
+	HashMap<Opd *, uint32_t> frame;
+	//The operand's value, or with asAddr set, the address an
+	// AddrOpd holds
+	auto ref = [&](Opd * opd, bool asAddr) -> InterpRef {
+		if (LitOpd * lit = opd->asLit()){
+			auto found = literals.find(lit);
+			if (found != literals.end()){
+				return InterpRef{InterpRef::CONST, found->second};
+			}
+			char * end = nullptr;
+			std::string str = lit->valString();
+			int64_t val = std::strtoll(str.c_str(), &end, 10);
+			if (str.empty() || *end != '\0'){
+				throw new InternalError(("bad literal " + str).c_str());
+			}
+			uint32_t idx = static_cast<uint32_t>(prog.consts.size());
+			prog.consts.push_back(val);
+			literals[lit] = idx;
+			return InterpRef{InterpRef::CONST, idx};
+		}
+		auto global = prog.globals.find(opd);
+		if (global != prog.globals.end()){
+			return InterpRef{InterpRef::GLOBAL, global->second};
+		}
+		auto found = frame.find(opd);
+		uint32_t idx;
+		if (found == frame.end()){
+			idx = static_cast<uint32_t>(frame.size());
+			frame[opd] = idx;
+		} else {
+			idx = found->second;
+		}
+		bool deref = opd->asAddr() != nullptr && !asAddr;
+		return InterpRef{deref ? InterpRef::DEREF : InterpRef::FRAME, idx};
+	};
+	auto val = [&](Opd * opd){ return ref(opd, false); };
+
+	InterpProc res;
+	for (Quad * quad : quads){
+		InterpInst inst = {I_NOP, I_NOP, {}, {}, {}, 0};
+		if (BinOpQuad * binop = quad->asBinOp()){
+			inst.op = binOpInst(binop->getOp());
+			inst.dst = val(binop->getDst());
+			inst.src1 = val(binop->getSrc1());
+			inst.src2 = val(binop->getSrc2());
+		} else if (UnaryOpQuad * unary = quad->asUnaryOp()){
+			UnaryOp op = unary->getOp();
+			inst.op = op == NEG64 || op == NEG8 ? I_NEG : I_NOT;
+			inst.dst = val(unary->getDst());
+			inst.src1 = val(unary->getSrc());
+		} else if (AssignQuad * assign = quad->asAssign()){
+			inst.op = I_COPY;
+			inst.dst = val(assign->getDst());
+			inst.src1 = val(assign->getSrc());
+		} else if (LocQuad * loc = quad->asLoc()){
+			//Taking the location of an AddrOpd reads the address
+			// it holds, so only other operands need I_ADDR
+			Opd * src = loc->getSrc();
+			bool addrOf = loc->isSrcLoc() && src->asAddr() == nullptr;
+			inst.op = addrOf ? I_ADDR : I_COPY;
+			inst.src1 = ref(src, loc->isSrcLoc());
+			inst.dst = ref(loc->getTgt(), loc->isTgtLoc());
+		} else if (GotoQuad * jmp = quad->asGoto()){
+			inst.op = I_GOTO;
+			inst.target = target(jmp->getTarget());
+		} else if (IfzQuad * ifz = quad->asIfz()){
+			inst.target = target(ifz->getTarget());
+			if (ifz->isFused()){
+				inst.op = I_IFZ_CMP;
+				inst.cmp = binOpInst(ifz->getCmp());
+				inst.src1 = val(ifz->getSrc1());
+				inst.src2 = val(ifz->getSrc2());
+			} else {
+				inst.op = I_IFZ;
+				inst.src1 = val(ifz->getCnd());
+			}
+		} else if (IntrinsicOutputQuad * out = quad->asIntrinsicOutput()){
+			const DataType * type = out->getType();
+			inst.op = type->isBool() ? I_PRINT_BOOL
+				: type->isString() ? I_PRINT_STRING : I_PRINT_INT;
+			inst.src1 = val(out->getSrc());
+		} else if (IntrinsicInputQuad * in = quad->asIntrinsicInput()){
+			if (in->getType()->isString()){
+				throw new InternalError("Cannot read a string");
+			}
+			inst.op = in->getType()->isBool() ? I_READ_BOOL : I_READ_INT;
+			inst.dst = val(in->getDst());
+		} else if (SetArgQuad * setArg = quad->asSetArg()){
+			inst.op = I_SET_ARG;
+			inst.src1 = val(setArg->getSrc());
+			inst.target = setArg->getIndex();
+		} else if (GetArgQuad * getArg = quad->asGetArg()){
+			inst.op = I_GET_ARG;
+			inst.dst = val(getArg->getDst());
+			inst.target = getArg->getIndex();
+		} else if (CallQuad * call = quad->asCall()){
+			inst.op = I_CALL;
+			inst.target = callee(call->getCallee());
+		} else if (TailCallQuad * tail = quad->asTailCall()){
+			inst.op = I_TAIL_CALL;
+			inst.target = callee(tail->getCallee());
+		} else if (SetRetQuad * setRet = quad->asSetRet()){
+			inst.op = I_SET_RET;
+			inst.src1 = val(setRet->getSrc());
+		} else if (GetRetQuad * getRet = quad->asGetRet()){
+			inst.op = I_GET_RET;
+			inst.dst = val(getRet->getDst());
+		} else if (quad->asLeave()){
+			inst.op = I_LEAVE;
+		} else if (quad->asPhi()){
+			throw new InternalError("Phi left in the procedure (fromSSA not run)");
+		}
+		if (inst.op == I_SET_ARG || inst.op == I_GET_ARG){
+			prog.numArgs = std::max(prog.numArgs, inst.target);
+		}
+		res.code.push_back(inst);
+	}
+	res.frameSize = frame.size();
+	return res;
+}
+
+//Die the way the native program would have
+static void fault(int sig){
+	flushOutput();
+	std::raise(sig);
+	std::abort();
+}
+
+static bool compare(InterpOp cmp, int64_t a, int64_t b){
+	switch (cmp){
+	case I_EQ: return a == b;
+	case I_NEQ: return a != b;
+	case I_LT: return a < b;
+	case I_GT: return a > b;
+	case I_LTE: return a <= b;
+	case I_GTE: return a >= b;
+	default:
+		throw new InternalError("Fused IFZ on a non-comparison");
+	}
+}
+
+static int64_t execute(const InterpProgram& prog, size_t mainIdx){
+	std::unique_ptr<int64_t[]> stack(new int64_t[INTERP_STACK_SLOTS]);
+	int64_t * stackEnd = stack.get() + INTERP_STACK_SLOTS;
+	std::vector<int64_t> globals(prog.globals.size(), 0);
+	std::vector<int64_t> args(prog.numArgs + 1, 0);
+	const int64_t * consts = prog.consts.data();
+
+	struct Return{
+		const InterpProc * proc;
+		size_t pc;
+		int64_t * fp;
+	};
+	std::vector<Return> calls;
+	const InterpProc * proc = &prog.procs[mainIdx];
+	int64_t * fp = stack.get();
+	size_t pc = 0;
+	int64_t ret = 0;
+	auto enterFrame = [&](){
+		if (proc->frameSize > static_cast<size_t>(stackEnd - fp)){
+			fault(SIGSEGV);
+		}
+		std::fill(fp, fp + proc->frameSize, 0);
+	};
+	enterFrame();
+
+	auto addr = [&](const InterpRef& ref) -> int64_t * {
+		switch (ref.kind){
+		case InterpRef::FRAME: return fp + ref.idx;
+		case InterpRef::GLOBAL: return &globals[ref.idx];
+		case InterpRef::DEREF: return reinterpret_cast<int64_t *>(fp[ref.idx]);
+		case InterpRef::CONST: break;
+		}
+		throw new InternalError("Cannot change value of a literal");
+	};
+	auto load = [&](const InterpRef& ref){
+		return ref.kind == InterpRef::CONST ? consts[ref.idx] : *addr(ref);
+	};
+	//Arithmetic wraps, as it does in the generated code
+	auto wrap = [](uint64_t val){ return static_cast<int64_t>(val); };
+	auto bits = [](int64_t val){ return static_cast<uint64_t>(val); };
+
+	while (true){
+		const InterpInst& inst = proc->code[pc++];
+		switch (inst.op){
+		case I_ADD:
+			*addr(inst.dst) = wrap(bits(load(inst.src1)) + bits(load(inst.src2)));
+			break;
+		case I_SUB:
+			*addr(inst.dst) = wrap(bits(load(inst.src1)) - bits(load(inst.src2)));
+			break;
+		case I_MULT:
+			*addr(inst.dst) = wrap(bits(load(inst.src1)) * bits(load(inst.src2)));
+			break;
+		case I_DIV: {
+			int64_t a = load(inst.src1);
+			int64_t b = load(inst.src2);
+			if (b == 0 || (a == INT64_MIN && b == -1)){ fault(SIGFPE); }
+			*addr(inst.dst) = a / b;
+			break;
+		}
+		case I_EQ: case I_NEQ: case I_LT: case I_GT: case I_LTE: case I_GTE:
+			*addr(inst.dst) = compare(inst.op, load(inst.src1), load(inst.src2));
+			break;
+		case I_OR:
+			*addr(inst.dst) = load(inst.src1) | load(inst.src2);
+			break;
+		case I_AND:
+			*addr(inst.dst) = load(inst.src1) & load(inst.src2);
+			break;
+		case I_NEG:
+			*addr(inst.dst) = wrap(0 - bits(load(inst.src1)));
+			break;
+		case I_NOT:
+			//Booleans are always 0 or 1
+			*addr(inst.dst) = load(inst.src1) ^ 1;
+			break;
+		case I_COPY:
+			*addr(inst.dst) = load(inst.src1);
+			break;
+		case I_ADDR:
+			*addr(inst.dst) = reinterpret_cast<int64_t>(addr(inst.src1));
+			break;
+		case I_GOTO:
+			pc = inst.target;
+			break;
+		case I_IFZ:
+			if (load(inst.src1) == 0){ pc = inst.target; }
+			break;
+		case I_IFZ_CMP:
+			if (!compare(inst.cmp, load(inst.src1), load(inst.src2))){
+				pc = inst.target;
+			}
+			break;
+		case I_PRINT_INT:
+			printInt(load(inst.src1));
+			break;
+		case I_PRINT_BOOL:
+			printBool(load(inst.src1));
+			break;
+		case I_PRINT_STRING:
+			printString(reinterpret_cast<const char *>(load(inst.src1)));
+			break;
+		case I_READ_INT:
+			*addr(inst.dst) = getInt();
+			break;
+		case I_READ_BOOL:
+			*addr(inst.dst) = getBool();
+			break;
+		case I_SET_ARG:
+			args[inst.target] = load(inst.src1);
+			break;
+		case I_GET_ARG:
+			*addr(inst.dst) = args[inst.target];
+			break;
+		case I_CALL:
+			calls.push_back(Return{proc, pc, fp});
+			fp += proc->frameSize;
+			proc = &prog.procs[inst.target];
+			pc = 0;
+			enterFrame();
+			break;
+		case I_TAIL_CALL:
+			//The callee takes over the frame, and returns to
+			// wherever this procedure would have
+			proc = &prog.procs[inst.target];
+			pc = 0;
+			enterFrame();
+			break;
+		case I_SET_RET:
+			ret = load(inst.src1);
+			break;
+		case I_GET_RET:
+			*addr(inst.dst) = ret;
+			break;
+		case I_LEAVE:
+			if (calls.empty()){ return ret; }
+			proc = calls.back().proc;
+			pc = calls.back().pc;
+			fp = calls.back().fp;
+			calls.pop_back();
+			break;
+		case I_NOP:
+			break;
+		}
+	}
+}
+
+int IRProgram::interpret(){
+	InterpProgram prog;
+	uint32_t numGlobals = 0;
+	for (auto global : globals){ prog.globals[global.second] = numGlobals++; }
+	//String literals are constants holding the address of their
+	// bytes, which live as long as the program runs
+	HashMap<Opd *, uint32_t> literals;
+	std::deque<std::string> stringData;
+	for (auto entry : strings){
+		stringData.push_back(stringBytes(entry.second));
+		literals[entry.first] = static_cast<uint32_t>(prog.consts.size());
+		prog.consts.push_back(
+			reinterpret_cast<int64_t>(stringData.back().c_str()));
+	}
+	for (auto proc : *procs){
+		size_t idx = prog.procIdxs.size();
+		prog.procIdxs[proc->getName()] = idx;
+	}
+	for (auto proc : *procs){
+		prog.procs.push_back(translate(proc, prog, literals));
+	}
+	auto main = prog.procIdxs.find("main");
+	if (main == prog.procIdxs.end()){
+		throw new InternalError("no procedure main");
+	}
+	int64_t res = execute(prog, main->second);
+	flushOutput();
+	return static_cast<int>(res);
+}
+
+}
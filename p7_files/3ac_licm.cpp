@@ -0,0 +1,280 @@
+#include <algorithm>
+#include "3ac.hpp"
+
+namespace cminusminus{
+
+// Loop-invariant code motion over SSA form. A while loop's
+// condition and body are lowered in place, so anything they
+// compute from values the loop never changes is recomputed
+// on every iteration. Such computations move into a preheader:
+// a new block that falls into the loop header and that every
+// edge into the loop from outside goes through.
+//
+// A BinOpQuad, UnaryOpQuad or LocQuad is invariant when each
+// operand it reads is a literal, an SSA version defined outside
+// the loop (or by a quad already found invariant), or memory
+// that nothing in the loop can write. Its result has to be an
+// SSA version (or, for a LocQuad setting an AddrOpd, an AddrOpd
+// set nowhere else), so it has no other definitions to clash
+// with. These quads only set their result, and with SSA every
+// use of it is dominated by the header and so by the preheader.
+// The one thing hoisting can add is a trap, on a division that
+// would not otherwise have run, so divisions stay put unless
+// they divide by a literal other than 0 and -1.
+
+static bool canTrap(BinOpQuad * binop){
+	BinOp op = binop->getOp();
+	if (op != DIV64 && op != DIV8){ return false; }
+	LitOpd * lit = binop->getSrc2()->asLit();
+	return lit == nullptr || lit->valString() == "0"
+		|| lit->valString() == "-1";
+}
+
+//A loop's header phis, to be put back in the order of its
+// predecessors once the preheader is in place. The arguments
+// from inside the loop are keyed by the jump ending their
+// predecessor; the one from outside will come from the
+// preheader.
+struct PhiFixup{
+	std::vector<PhiQuad *> phis;
+	std::vector<HashMap<Quad *, Opd *>> loopArgs;
+	std::vector<Opd *> entryArgs;
+};
+
+//What hoisting needs to know about the procedure, gathered in
+// one pass before any loop changes. Everything is worked out
+// on that first CFG: a preheader stays inside every loop around
+// its own, so what is moved into it is still where those loops
+// expect it, and the CFG is only built again at the end.
+struct LoopFacts{
+	ControlFlowGraph * graph;
+	std::set<Opd *> ssa;
+	HashMap<Opd *, size_t> addrDefs;
+	//Indexed by loop: what the loop (with the loops inside it)
+	// defines, and whether it might write memory
+	std::vector<std::set<Opd *>> loopDefs;
+	std::vector<bool> writesMemory;
+	//Position of each block in reverse postorder, or NONE
+	std::vector<size_t> rpoRank;
+	HashMap<Quad *, std::list<Quad *>::iterator> positions;
+	//Quads that start a block. One leaves a nop behind when it
+	// moves, so that no block disappears.
+	std::set<Quad *> leaders;
+	std::vector<PhiFixup> fixups;
+	bool changed = false;
+};
+
+//Hoist what can be hoisted out of loop l
+static void hoistFromLoop(Procedure * proc, LoopFacts& facts, size_t l){
+	ControlFlowGraph * graph = facts.graph;
+	const std::vector<Quad *>& quads = graph->getQuads();
+	const Loop * loop = &graph->getLoops()[l];
+	size_t header = loop->getHeader();
+	const BasicBlock& headBlock = graph->getBlock(header);
+	Quad * headerQuad = quads[headBlock.getFirst()];
+
+	//The preheader takes the place of the only edge into the
+	// loop. It goes right before the header, so the block
+	// there must not fall into the header from inside.
+	size_t entry = BasicBlock::NONE;
+	size_t numEntries = 0;
+	for (size_t pred : headBlock.getPreds()){
+		if (!loop->contains(pred)){
+			entry = pred;
+			numEntries++;
+		}
+	}
+	if (numEntries != 1){ return; }
+	Quad * prevLast = quads[graph->getBlock(header - 1).getLast()];
+	bool prevFalls = !prevLast->asGoto() && !prevLast->asLeave();
+	if (prevFalls && loop->contains(header - 1)){ return; }
+
+	const std::set<Opd *>& ssa = facts.ssa;
+	const std::set<Opd *>& loopDefs = facts.loopDefs[l];
+	bool writesMemory = facts.writesMemory[l];
+	std::set<Opd *> hoisted;
+	//An AddrOpd is read through, so the address being invariant
+	// is not enough
+	auto invariant = [&](Opd * opd){
+		if (hoisted.count(opd) > 0){ return !opd->asAddr() || !writesMemory; }
+		if (opd->asAddr() || loopDefs.count(opd) > 0){ return false; }
+		return ssa.count(opd) > 0 || !writesMemory;
+	};
+
+	//Visiting the blocks in reverse postorder sees each
+	// definition before its uses. A quad moved out of an inner
+	// loop is visited where it used to be, which comes no
+	// earlier than its uses do.
+	std::vector<size_t> blocks;
+	for (size_t b : loop->getBlocks()){
+		if (facts.rpoRank[b] != BasicBlock::NONE){ blocks.push_back(b); }
+	}
+	std::sort(blocks.begin(), blocks.end(), [&](size_t a, size_t b){
+		return facts.rpoRank[a] < facts.rpoRank[b];
+	});
+	std::vector<Quad *> moved;
+	for (size_t b : blocks){
+		const BasicBlock& block = graph->getBlock(b);
+		for (size_t i = block.getFirst(); i <= block.getLast(); i++){
+			Quad * quad = quads[i];
+			Opd * dst = nullptr;
+			Opd * notRead = nullptr;
+			bool setsAddr = false;
+			if (BinOpQuad * binop = quad->asBinOp()){
+				if (!canTrap(binop)){ dst = binop->getDst(); }
+			} else if (UnaryOpQuad * unary = quad->asUnaryOp()){
+				dst = unary->getDst();
+			} else if (LocQuad * loc = quad->asLoc()){
+				dst = loc->getTgt();
+				setsAddr = loc->isTgtLoc();
+				if (loc->isSrcLoc()){ notRead = loc->getSrc(); }
+			}
+			if (dst == nullptr){ continue; }
+			bool ownsDst = setsAddr ? facts.addrDefs[dst] == 1 : ssa.count(dst) > 0;
+			if (!ownsDst){ continue; }
+			bool ok = true;
+			for (Opd * use : quad->getUses()){
+				if (use != notRead && !invariant(use)){ ok = false; }
+			}
+			if (!ok){ continue; }
+			hoisted.insert(dst);
+			moved.push_back(quad);
+		}
+	}
+	if (moved.empty()){ return; }
+
+	//The header's phis get a new predecessor in place of entry
+	const std::vector<size_t>& preds = headBlock.getPreds();
+	PhiFixup fixup;
+	for (size_t i = headBlock.getFirst(); i <= headBlock.getLast(); i++){
+		PhiQuad * phi = quads[i]->asPhi();
+		if (phi == nullptr){ break; }
+		fixup.phis.push_back(phi);
+		fixup.loopArgs.push_back(HashMap<Quad *, Opd *>());
+		fixup.entryArgs.push_back(nullptr);
+		for (size_t p = 0; p < preds.size(); p++){
+			if (preds[p] == entry){
+				fixup.entryArgs.back() = phi->getArgs()[p];
+			} else {
+				Quad * key = quads[graph->getBlock(preds[p]).getLast()];
+				fixup.loopArgs.back()[key] = phi->getArgs()[p];
+			}
+		}
+	}
+	if (!fixup.phis.empty()){ facts.fixups.push_back(fixup); }
+
+	//A jump into the loop from outside goes to the preheader
+	const std::list<Label *>& headLabels = headerQuad->getLabels();
+	auto entersLoop = [&](Label * tgt){
+		return std::find(headLabels.begin(), headLabels.end(), tgt)
+			!= headLabels.end();
+	};
+	Label * preLabel = nullptr;
+	Quad * entryLast = quads[graph->getBlock(entry).getLast()];
+	if (GotoQuad * jmp = entryLast->asGoto()){
+		if (entersLoop(jmp->getTarget())){
+			preLabel = proc->makeLabel();
+			jmp->setTarget(preLabel);
+		}
+	} else if (IfzQuad * ifz = entryLast->asIfz()){
+		if (entersLoop(ifz->getTarget())){
+			preLabel = proc->makeLabel();
+			ifz->setTarget(preLabel);
+		}
+	}
+
+	std::list<Quad *> * body = proc->getQuads();
+	auto preheader = facts.positions[headerQuad];
+	for (Quad * quad : moved){
+		auto pos = facts.positions[quad];
+		if (facts.leaders.count(quad) > 0){
+			Quad * nop = new NopQuad();
+			for (Label * label : quad->getLabels()){ nop->addLabel(label); }
+			quad->clearLabels();
+			*pos = nop;
+		} else {
+			body->erase(pos);
+		}
+		facts.positions[quad] = body->insert(preheader, quad);
+	}
+	if (preLabel != nullptr){ moved.front()->addLabel(preLabel); }
+	facts.leaders.insert(moved.front());
+	facts.changed = true;
+}
+
+void Procedure::hoistLoopInvariants(){
+	LoopFacts facts;
+	facts.graph = getCFG();
+	ControlFlowGraph * graph = facts.graph;
+	const std::vector<Quad *>& quads = graph->getQuads();
+	const std::vector<Loop>& loops = graph->getLoops();
+	if (loops.empty()){ return; }
+
+	//Reads through pointers are counted as writes as well,
+	// since the quads do not tell the two apart
+	facts.ssa.insert(versions.begin(), versions.end());
+	facts.loopDefs.resize(loops.size());
+	facts.writesMemory.resize(loops.size(), false);
+	for (size_t i = 0; i < quads.size(); i++){
+		Quad * quad = quads[i];
+		for (Opd * def : quad->getDefs()){
+			if (def->asAddr()){ facts.addrDefs[def]++; }
+		}
+		LocQuad * loc = quad->asLoc();
+		bool setsAddr = loc != nullptr && loc->isTgtLoc();
+		bool writes = quad->asCall() != nullptr;
+		for (Opd * def : quad->getDefs()){
+			if (facts.ssa.count(def) == 0 && !def->asAddr()){ writes = true; }
+		}
+		for (Opd * use : quad->getUses()){
+			if (use->asAddr() && !setsAddr){ writes = true; }
+		}
+		size_t l = graph->getBlock(graph->blockOf(i)).getLoop();
+		for (; l != BasicBlock::NONE; l = loops[l].getParent()){
+			for (Opd * def : quad->getDefs()){ facts.loopDefs[l].insert(def); }
+			if (writes){ facts.writesMemory[l] = true; }
+		}
+	}
+	facts.rpoRank.resize(graph->numBlocks(), BasicBlock::NONE);
+	const std::vector<size_t>& rpo = graph->reversePostorder();
+	for (size_t r = 0; r < rpo.size(); r++){ facts.rpoRank[rpo[r]] = r; }
+	for (const BasicBlock& block : graph->getBlocks()){
+		facts.leaders.insert(quads[block.getFirst()]);
+	}
+	for (auto itr = bodyQuads->begin(); itr != bodyQuads->end(); ++itr){
+		facts.positions[*itr] = itr;
+	}
+
+	//Inner loops go first, so that what leaves an inner loop
+	// can go on out of the loops around it
+	std::vector<size_t> order;
+	for (size_t l = 0; l < loops.size(); l++){ order.push_back(l); }
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+		return loops[a].getDepth() > loops[b].getDepth();
+	});
+	for (size_t l : order){ hoistFromLoop(this, facts, l); }
+	if (!facts.changed){ return; }
+
+	invalidateCFG();
+	graph = getCFG();
+	const std::vector<Quad *>& newQuads = graph->getQuads();
+	HashMap<Quad *, size_t> starts;
+	for (const BasicBlock& block : graph->getBlocks()){
+		starts[newQuads[block.getFirst()]] = block.getID();
+	}
+	for (const PhiFixup& fixup : facts.fixups){
+		const BasicBlock& head = graph->getBlock(starts.at(fixup.phis.front()));
+		for (size_t p = 0; p < fixup.phis.size(); p++){
+			std::vector<Opd *> args;
+			for (size_t pred : head.getPreds()){
+				Quad * key = newQuads[graph->getBlock(pred).getLast()];
+				auto found = fixup.loopArgs[p].find(key);
+				args.push_back(found == fixup.loopArgs[p].end()
+					? fixup.entryArgs[p] : found->second);
+			}
+			fixup.phis[p]->setArgs(args);
+		}
+	}
+}
+
+}
@@ -11,7 +11,7 @@ IRProgram * ProgramNode::to3AC(TypeAnalysis * ta){
 }
 
 static void formalsTo3AC(Procedure * proc, 
-  std::list<FormalDeclNode *> * myFormals){
+  ArenaList<FormalDeclNode *> * myFormals){
 	for (auto formal : *myFormals){
 		formal->to3AC(proc);
 	}
@@ -103,7 +103,7 @@ Opd * AssignExpNode::flatten(Procedure * proc){
 	return lhs;
 }
 
-static void argsTo3AC(Procedure * proc, std::list<ExpNode *> * args){
+static void argsTo3AC(Procedure * proc, ArenaList<ExpNode *> * args){
 	std::list<std::pair<Opd *, const DataType *>> argOpds;
 	for (auto argNode : *args){
 		Opd * argOpd = argNode->flatten(proc);
@@ -238,28 +238,131 @@ Opd * DivideNode::flatten(Procedure * proc){
 	return dst;
 }
 
-Opd * AndNode::flatten(Procedure * proc){
-	Opd * op1 = this->myExp1->flatten(proc);
-	Opd * op2 = this->myExp2->flatten(proc);
-	size_t width = proc->getProg()->opWidth(this);
+//Evaluate lhs, and rhs only if lhs does not already decide
+// the result: for an and when lhs is true, for an or when 
+// lhs is false
+static Opd * shortCircuit(Procedure * proc, size_t width,
+  ExpNode * lhs, ExpNode * rhs, bool isAnd){
 	Opd * opRes = proc->makeTmp(width);
-	BinOp opr = BinOp::AND64;
-	if (width == 1){ opr = BinOp::AND8; }
-	BinOpQuad * quad = new BinOpQuad(opRes, opr, op1, op2);
-	proc->addQuad(quad);
+	Label * doneLabel = proc->makeLabel();
+	Quad * doneNop = new NopQuad();
+	doneNop->addLabel(doneLabel);
+
+	proc->addQuad(new AssignQuad(opRes, lhs->flatten(proc), false));
+	if (isAnd){
+		proc->addQuad(new IfzQuad(opRes, doneLabel));
+	} else {
+		Label * rhsLabel = proc->makeLabel();
+		Quad * rhsNop = new NopQuad();
+		rhsNop->addLabel(rhsLabel);
+		proc->addQuad(new IfzQuad(opRes, rhsLabel));
+		proc->addQuad(new GotoQuad(doneLabel));
+		proc->addQuad(rhsNop);
+	}
+	proc->addQuad(new AssignQuad(opRes, rhs->flatten(proc), false));
+	proc->addQuad(doneNop);
 	return opRes;
 }
 
+Opd * AndNode::flatten(Procedure * proc){
+	size_t width = proc->getProg()->opWidth(this);
+	return shortCircuit(proc, width, myExp1, myExp2, true);
+}
+
 Opd * OrNode::flatten(Procedure * proc){
-	Opd * op1 = this->myExp1->flatten(proc);
-	Opd * op2 = this->myExp2->flatten(proc);
 	size_t width = proc->getProg()->opWidth(this);
-	Opd * opRes = proc->makeTmp(width);
-	BinOp opr = BinOp::OR64;
-	if (width == 1){ opr = BinOp::OR8; }
-	BinOpQuad * quad = new BinOpQuad(opRes, opr, op1, op2);
-	proc->addQuad(quad);
-	return opRes;
+	return shortCircuit(proc, width, myExp1, myExp2, false);
+}
+
+void ExpNode::flattenCond(Procedure * proc, Label * tgt, bool jumpIf){
+	Opd * cond = flatten(proc);
+	if (!jumpIf){
+		proc->addQuad(new IfzQuad(cond, tgt));
+		return;
+	}
+	Label * skipLabel = proc->makeLabel();
+	Quad * skipNop = new NopQuad();
+	skipNop->addLabel(skipLabel);
+	proc->addQuad(new IfzQuad(cond, skipLabel));
+	proc->addQuad(new GotoQuad(tgt));
+	proc->addQuad(skipNop);
+}
+
+//An and is false as soon as one side is, and an or is true as
+// soon as one side is. Deciding the other way needs both
+// sides, so a true lhs of an or (or false lhs of an and)
+// skips over the test of rhs.
+void AndNode::flattenCond(Procedure * proc, Label * tgt, bool jumpIf){
+	if (!jumpIf){
+		myExp1->flattenCond(proc, tgt, false);
+		myExp2->flattenCond(proc, tgt, false);
+		return;
+	}
+	Label * skipLabel = proc->makeLabel();
+	Quad * skipNop = new NopQuad();
+	skipNop->addLabel(skipLabel);
+	myExp1->flattenCond(proc, skipLabel, false);
+	myExp2->flattenCond(proc, tgt, true);
+	proc->addQuad(skipNop);
+}
+
+void OrNode::flattenCond(Procedure * proc, Label * tgt, bool jumpIf){
+	if (jumpIf){
+		myExp1->flattenCond(proc, tgt, true);
+		myExp2->flattenCond(proc, tgt, true);
+		return;
+	}
+	Label * skipLabel = proc->makeLabel();
+	Quad * skipNop = new NopQuad();
+	skipNop->addLabel(skipLabel);
+	myExp1->flattenCond(proc, skipLabel, true);
+	myExp2->flattenCond(proc, tgt, false);
+	proc->addQuad(skipNop);
+}
+
+void NotNode::flattenCond(Procedure * proc, Label * tgt, bool jumpIf){
+	myExp->flattenCond(proc, tgt, !jumpIf);
+}
+
+//The comparison goes straight into the IFZ, so the boolean
+// is never stored
+void BinaryExpNode::compareCond(Procedure * proc, Label * tgt,
+  BinOp op64, BinOp op8){
+	Opd * op1 = myExp1->flatten(proc);
+	Opd * op2 = myExp2->flatten(proc);
+	size_t width = proc->getProg()->opWidth(myExp1);
+	BinOp opr = width == 1 ? op8 : op64;
+	proc->addQuad(new IfzQuad(opr, op1, op2, tgt));
+}
+
+void EqualsNode::flattenCond(Procedure * proc, Label * tgt, bool jumpIf){
+	if (jumpIf){ compareCond(proc, tgt, NEQ64, NEQ8); }
+	else { compareCond(proc, tgt, EQ64, EQ8); }
+}
+
+void NotEqualsNode::flattenCond(Procedure * proc, Label * tgt, bool jumpIf){
+	if (jumpIf){ compareCond(proc, tgt, EQ64, EQ8); }
+	else { compareCond(proc, tgt, NEQ64, NEQ8); }
+}
+
+void LessNode::flattenCond(Procedure * proc, Label * tgt, bool jumpIf){
+	if (jumpIf){ compareCond(proc, tgt, GTE64, GTE8); }
+	else { compareCond(proc, tgt, LT64, LT8); }
+}
+
+void LessEqNode::flattenCond(Procedure * proc, Label * tgt, bool jumpIf){
+	if (jumpIf){ compareCond(proc, tgt, GT64, GT8); }
+	else { compareCond(proc, tgt, LTE64, LTE8); }
+}
+
+void GreaterNode::flattenCond(Procedure * proc, Label * tgt, bool jumpIf){
+	if (jumpIf){ compareCond(proc, tgt, LTE64, LTE8); }
+	else { compareCond(proc, tgt, GT64, GT8); }
+}
+
+void GreaterEqNode::flattenCond(Procedure * proc, Label * tgt, bool jumpIf){
+	if (jumpIf){ compareCond(proc, tgt, LT64, LT8); }
+	else { compareCond(proc, tgt, GTE64, GTE8); }
 }
 
 Opd * EqualsNode::flatten(Procedure * proc){
@@ -380,12 +483,11 @@ void WriteStmtNode::to3AC(Procedure * proc){
 }
 
 void IfStmtNode::to3AC(Procedure * proc){
-	Opd * cond = myCond->flatten(proc);
 	Label * afterLabel = proc->makeLabel();
 	Quad * afterNop = new NopQuad();
 	afterNop->addLabel(afterLabel);
 
-	proc->addQuad(new IfzQuad(cond, afterLabel));
+	myCond->flattenCond(proc, afterLabel, false);
 	for (auto stmt : *myBody){
 		stmt->to3AC(proc);
 	}
@@ -400,10 +502,7 @@ void IfElseStmtNode::to3AC(Procedure * proc){
 	Quad * afterNop = new NopQuad();
 	afterNop->addLabel(afterLabel);
 
-	Opd * cond = myCond->flatten(proc);
-
-	Quad * jmpFalse = new IfzQuad(cond, elseLabel);
-	proc->addQuad(jmpFalse);
+	myCond->flattenCond(proc, elseLabel, false);
 	for (auto stmt : *myBodyTrue){
 		stmt->to3AC(proc);
 	}
@@ -430,9 +529,7 @@ void WhileStmtNode::to3AC(Procedure * proc){
 	afterQuad->addLabel(afterLabel);
 
 	proc->addQuad(headNop);
-	Opd * cond = myCond->flatten(proc);
-	Quad * jmpFalse = new IfzQuad(cond, afterLabel);
-	proc->addQuad(jmpFalse);
+	myCond->flattenCond(proc, afterLabel, false);
 
 	for (auto stmt : *myBody){
 		stmt->to3AC(proc);
@@ -3,17 +3,13 @@
 
 namespace cminusminus{
 
-Procedure::Procedure(IRProgram * prog, std::string name)
+Procedure::Procedure(IRProgram * prog, const std::string& name)
 : myProg(prog), myName(name){
 	maxTmp = 0;
 	enter = new EnterQuad(this);
 	leave = new LeaveQuad(this);
 	bodyQuads = new std::list<Quad *>();
-	if (myName.compare("main") == 0){
-		enter->addLabel(new Label("main"));
-	} else {
-		enter->addLabel(new Label("fun_" + myName));
-	}
+	enter->addLabel(new Label(entryName(myName)));
 	leaveLabel = myProg->makeLabel();
 	leave->addLabel(leaveLabel);
 }
@@ -22,6 +18,13 @@ std::string Procedure::getName(){
 	return myName;
 }
 
+std::string Procedure::entryName(const std::string& fnName){
+	if (fnName.compare("main") == 0){
+		return "main";
+	}
+	return "fun_" + fnName;
+}
+
 Label * Procedure::getLeaveLabel(){
 	return leaveLabel;
 }
@@ -70,11 +73,13 @@ Label * Procedure::makeLabel(){
 
 void Procedure::addQuad(Quad * quad){
 	bodyQuads->push_back(quad);
+	invalidateCFG();
 }
 
 Quad * Procedure::popQuad(){
 	Quad * last = bodyQuads->back();
 	bodyQuads->pop_back();
+	invalidateCFG();
 	return last;
 }
 
@@ -82,6 +87,47 @@ void Procedure::replaceQuad(Quad * oldQuad, Quad * newQuad){
 	auto itr = std::find(bodyQuads->begin(), bodyQuads->end(), oldQuad);
 	itr = bodyQuads->erase(itr);
 	bodyQuads->insert(itr, newQuad);
+	invalidateCFG();
+}
+
+void Procedure::rewriteQuads(const HashMap<Quad *, Quad *>& replacements,
+  const std::vector<bool>& liveBlocks){
+	ControlFlowGraph * graph = getCFG();
+	size_t idx = 1;
+	auto itr = bodyQuads->begin();
+	while (itr != bodyQuads->end()){
+		size_t b = graph->blockOf(idx);
+		size_t last = graph->getBlock(b).getLast();
+		std::list<Label *> labels;
+		bool kept = b == 0;
+		for (; idx <= last; idx++){
+			Quad * quad = *itr;
+			auto found = replacements.find(quad);
+			Quad * next = found == replacements.end() ? quad : found->second;
+			if (!liveBlocks[b]){ next = nullptr; }
+			if (next == nullptr){
+				for (Label * label : quad->getLabels()){
+					labels.push_back(label);
+				}
+				itr = bodyQuads->erase(itr);
+				continue;
+			}
+			if (next != quad){
+				for (Label * label : quad->getLabels()){ next->addLabel(label); }
+				*itr = next;
+			}
+			for (Label * label : labels){ next->addLabel(label); }
+			labels.clear();
+			kept = true;
+			++itr;
+		}
+		if (!kept && liveBlocks[b]){
+			Quad * nop = new NopQuad();
+			for (Label * label : labels){ nop->addLabel(label); }
+			bodyQuads->insert(itr, nop);
+		}
+	}
+	invalidateCFG();
 }
 
 void Procedure::gatherLocal(SemSymbol * sym){
@@ -110,23 +156,46 @@ SymOpd * Procedure::getSymOpd(SemSymbol * sym){
 }
 
 AuxOpd * Procedure::makeTmp(size_t width){
-	std::string name = "tmp";
-	name += std::to_string(maxTmp++);
-	AuxOpd * res = new AuxOpd(name, width);
+	AuxOpd * res = new AuxOpd(maxTmp++, width);
 	temps.push_back(res);
 
 	return res;
 }
 
 AddrOpd * Procedure::makeAddrOpd(size_t width){
-	std::string name = "addrTmp";
-	name += std::to_string(maxTmp++);
-	AddrOpd * res = new AddrOpd(name, width);
+	AddrOpd * res = new AddrOpd(maxTmp++, width);
 	addrOpds.push_back(res);
 
 	return res;
 }
 
+AuxOpd * Procedure::makeVersion(Opd * base, size_t version){
+	std::string name = base->locString() + "." + std::to_string(version);
+	AuxOpd * res = new AuxOpd(maxTmp++, base->getWidth(), name);
+	temps.push_back(res);
+
+	return res;
+}
+
+std::vector<Opd *> Procedure::promotableOpds(){
+	std::set<Opd *> escaped;
+	for (auto quad : *bodyQuads){
+		LocQuad * loc = quad->asLoc();
+		if (loc && loc->isSrcLoc() && !loc->getSrc()->asAddr()){
+			escaped.insert(loc->getSrc());
+		}
+	}
+
+	std::vector<Opd *> res;
+	auto add = [&](Opd * opd){
+		if (escaped.count(opd) == 0){ res.push_back(opd); }
+	};
+	for (auto formal : formals){ add(formal); }
+	for (auto local : locals){ add(local.second); }
+	for (auto tmp : temps){ add(tmp); }
+	return res;
+}
+
 size_t Procedure::numTemps() const{
 	return this->temps.size();
 }
@@ -4,7 +4,7 @@
 
 namespace cminusminus {
 
-Procedure * IRProgram::makeProc(std::string name){
+Procedure * IRProgram::makeProc(const std::string& name){
 	Procedure * proc = new Procedure(this, name);
 	procs->push_back(proc);
 	return proc;
@@ -47,6 +47,39 @@ Opd * IRProgram::makeString(std::string val){
 	return opd;
 }
 
+std::string IRProgram::stringBytes(const std::string& lit){
+	std::string res;
+	for (size_t i = 1; i + 1 < lit.size(); i++){
+		if (lit[i] != '\\' || i + 2 >= lit.size()){
+			res += lit[i];
+			continue;
+		}
+		i++;
+		switch (lit[i]){
+		case 'n': res += '\n'; break;
+		case 't': res += '\t'; break;
+		default: res += lit[i];
+		}
+	}
+	return res;
+}
+
+void IRProgram::optimize(){
+	for (auto proc : *procs){
+		proc->eliminateTailCalls();
+		proc->toSSA();
+		proc->propagateConstants();
+		proc->numberValues();
+		proc->eliminateDeadCode();
+		proc->hoistLoopInvariants();
+		proc->reduceStrength();
+		proc->fromSSA();
+		proc->coalesceCopies();
+		proc->fuseCompares();
+		proc->dropUnusedOpds();
+	}
+}
+
 std::string IRProgram::toString(bool verbose){
 	std::string res = "";
 	res += "[BEGIN GLOBALS]\n";
@@ -23,6 +23,37 @@ std::string Quad::commentStr(){
 	return "";
 }
 
+//Record a read of opd, unless it is a literal
+static void addRead(std::list<Opd *>& uses, Opd * opd){
+	if (opd->asLit() == nullptr){
+		uses.push_back(opd);
+	}
+}
+
+//Record a store to opd. A store through an AddrOpd only
+// reads the address it holds.
+static void addStore(std::list<Opd *>& uses, std::list<Opd *>& defs, 
+  Opd * opd){
+	if (opd->asAddr() != nullptr){
+		uses.push_back(opd);
+	} else {
+		defs.push_back(opd);
+	}
+}
+
+//Replace a read of oldOpd
+static void swapRead(Opd *& slot, Opd * oldOpd, Opd * newOpd){
+	if (slot == oldOpd){ slot = newOpd; }
+}
+
+//Replace oldOpd in a slot that is stored to, if the store
+// counts as a def (or, when asDef is false, as a use)
+static void swapStore(Opd *& slot, Opd * oldOpd, Opd * newOpd, bool asDef){
+	if (slot != oldOpd){ return; }
+	bool isDef = oldOpd->asAddr() == nullptr;
+	if (isDef == asDef){ slot = newOpd; }
+}
+
 std::string Quad::toString(bool verbose){
 	auto res = std::string("");
 
@@ -58,6 +89,13 @@ std::string CallQuad::repr(){
 	return "call " + callee->getName();
 }
 
+TailCallQuad::TailCallQuad(Procedure * procIn, SemSymbol * calleeIn)
+: myProc(procIn), callee(calleeIn){ }
+
+std::string TailCallQuad::repr(){
+	return "tailcall " + callee->getName();
+}
+
 EnterQuad::EnterQuad(Procedure * procIn)
 : Quad(), myProc(procIn) { }
 
@@ -183,11 +221,36 @@ std::string GotoQuad::repr(){
 }
 
 IfzQuad::IfzQuad(Opd * cndIn, Label * tgtIn) 
-: Quad(), cnd(cndIn), tgt(tgtIn){ }
+: Quad(), cnd(cndIn), cmp(EQ64), src1(nullptr), src2(nullptr), 
+  tgt(tgtIn){ }
+
+IfzQuad::IfzQuad(BinOp cmpIn, Opd * src1In, Opd * src2In, Label * tgtIn)
+: Quad(), cnd(nullptr), cmp(cmpIn), src1(src1In), src2(src2In),
+  tgt(tgtIn){
+	assert(src1In != nullptr);
+	assert(src2In != nullptr);
+	assert(isRelational(cmpIn));
+}
+
+bool IfzQuad::isRelational(BinOp opr){
+	switch(opr){
+	case EQ64: case NEQ64: case LT64: case GT64: case LTE64: case GTE64:
+	case EQ8: case NEQ8: case LT8: case GT8: case LTE8: case GTE8:
+		return true;
+	default:
+		return false;
+	}
+}
 
 std::string IfzQuad::repr(){
 	std::string res = "IFZ ";
-	res += cnd->valString();
+	if (isFused()){
+		res += src1->valString();
+		res += " " + BinOpQuad::oprString(cmp) + " ";
+		res += src2->valString();
+	} else {
+		res += cnd->valString();
+	}
 	res += " GOTO ";
 	res += tgt->toString();
 	return res;
@@ -239,6 +302,18 @@ std::string SetRetQuad::repr(){
 	return res;
 }
 
+PhiQuad::PhiQuad(Opd * dstIn, size_t numArgs)
+: Quad(), dst(dstIn), args(numArgs, dstIn){ }
+
+std::string PhiQuad::repr(){
+	std::string res = dst->valString() + " := PHI";
+	for (size_t i = 0; i < args.size(); i++){
+		if (i > 0){ res += ","; }
+		res += " " + args[i]->valString();
+	}
+	return res;
+}
+
 std::string LocQuad::repr(){
 	std::string res = "";
 	if (tgtIsLoc){ res += tgt->locString(); } 
@@ -251,4 +326,229 @@ std::string LocQuad::repr(){
 	return res;
 }
 
+std::list<Opd *> BinOpQuad::getUses(){
+	std::list<Opd *> uses, defs;
+	addRead(uses, src1);
+	addRead(uses, src2);
+	addStore(uses, defs, dst);
+	return uses;
+}
+
+std::list<Opd *> BinOpQuad::getDefs(){
+	std::list<Opd *> uses, defs;
+	addStore(uses, defs, dst);
+	return defs;
+}
+
+std::list<Opd *> UnaryOpQuad::getUses(){
+	std::list<Opd *> uses, defs;
+	addRead(uses, src);
+	addStore(uses, defs, dst);
+	return uses;
+}
+
+std::list<Opd *> UnaryOpQuad::getDefs(){
+	std::list<Opd *> uses, defs;
+	addStore(uses, defs, dst);
+	return defs;
+}
+
+std::list<Opd *> AssignQuad::getUses(){
+	std::list<Opd *> uses, defs;
+	addRead(uses, src);
+	addStore(uses, defs, dst);
+	return uses;
+}
+
+std::list<Opd *> AssignQuad::getDefs(){
+	std::list<Opd *> uses, defs;
+	addStore(uses, defs, dst);
+	return defs;
+}
+
+//Taking the location of a symbol is not a read of its
+// value, but it is still reported as a use so that the 
+// symbol stays visible to analyses that have to treat 
+// it as escaping. Setting the location of an AddrOpd
+// defines it.
+std::list<Opd *> LocQuad::getUses(){
+	std::list<Opd *> uses, defs;
+	addRead(uses, src);
+	if (!tgtIsLoc){ addStore(uses, defs, tgt); }
+	return uses;
+}
+
+std::list<Opd *> LocQuad::getDefs(){
+	std::list<Opd *> uses, defs;
+	if (tgtIsLoc){ defs.push_back(tgt); }
+	else { addStore(uses, defs, tgt); }
+	return defs;
+}
+
+std::list<Opd *> IfzQuad::getUses(){
+	std::list<Opd *> uses;
+	if (isFused()){
+		addRead(uses, src1);
+		addRead(uses, src2);
+	} else {
+		addRead(uses, cnd);
+	}
+	return uses;
+}
+
+std::list<Opd *> IntrinsicOutputQuad::getUses(){
+	std::list<Opd *> uses;
+	addRead(uses, myArg);
+	return uses;
+}
+
+std::list<Opd *> IntrinsicInputQuad::getUses(){
+	std::list<Opd *> uses, defs;
+	addStore(uses, defs, myArg);
+	return uses;
+}
+
+std::list<Opd *> IntrinsicInputQuad::getDefs(){
+	std::list<Opd *> uses, defs;
+	addStore(uses, defs, myArg);
+	return defs;
+}
+
+std::list<Opd *> SetArgQuad::getUses(){
+	std::list<Opd *> uses;
+	addRead(uses, opd);
+	return uses;
+}
+
+std::list<Opd *> GetArgQuad::getUses(){
+	std::list<Opd *> uses, defs;
+	addStore(uses, defs, opd);
+	return uses;
+}
+
+std::list<Opd *> GetArgQuad::getDefs(){
+	std::list<Opd *> uses, defs;
+	addStore(uses, defs, opd);
+	return defs;
+}
+
+std::list<Opd *> SetRetQuad::getUses(){
+	std::list<Opd *> uses;
+	addRead(uses, opd);
+	return uses;
+}
+
+std::list<Opd *> GetRetQuad::getUses(){
+	std::list<Opd *> uses, defs;
+	addStore(uses, defs, opd);
+	return uses;
+}
+
+std::list<Opd *> GetRetQuad::getDefs(){
+	std::list<Opd *> uses, defs;
+	addStore(uses, defs, opd);
+	return defs;
+}
+
+void BinOpQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	swapRead(src1, oldOpd, newOpd);
+	swapRead(src2, oldOpd, newOpd);
+	swapStore(dst, oldOpd, newOpd, false);
+}
+
+void BinOpQuad::replaceDefs(Opd * oldOpd, Opd * newOpd){
+	swapStore(dst, oldOpd, newOpd, true);
+}
+
+void UnaryOpQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	swapRead(src, oldOpd, newOpd);
+	swapStore(dst, oldOpd, newOpd, false);
+}
+
+void UnaryOpQuad::replaceDefs(Opd * oldOpd, Opd * newOpd){
+	swapStore(dst, oldOpd, newOpd, true);
+}
+
+void AssignQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	swapRead(src, oldOpd, newOpd);
+	swapStore(dst, oldOpd, newOpd, false);
+}
+
+void AssignQuad::replaceDefs(Opd * oldOpd, Opd * newOpd){
+	swapStore(dst, oldOpd, newOpd, true);
+}
+
+void LocQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	swapRead(src, oldOpd, newOpd);
+	if (!tgtIsLoc){ swapStore(tgt, oldOpd, newOpd, false); }
+}
+
+void LocQuad::replaceDefs(Opd * oldOpd, Opd * newOpd){
+	if (tgtIsLoc){ swapRead(tgt, oldOpd, newOpd); }
+	else { swapStore(tgt, oldOpd, newOpd, true); }
+}
+
+void IfzQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	if (isFused()){
+		swapRead(src1, oldOpd, newOpd);
+		swapRead(src2, oldOpd, newOpd);
+	} else {
+		swapRead(cnd, oldOpd, newOpd);
+	}
+}
+
+void IntrinsicOutputQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	swapRead(myArg, oldOpd, newOpd);
+}
+
+void IntrinsicInputQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	swapStore(myArg, oldOpd, newOpd, false);
+}
+
+void IntrinsicInputQuad::replaceDefs(Opd * oldOpd, Opd * newOpd){
+	swapStore(myArg, oldOpd, newOpd, true);
+}
+
+void SetArgQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	swapRead(opd, oldOpd, newOpd);
+}
+
+void GetArgQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	swapStore(opd, oldOpd, newOpd, false);
+}
+
+void GetArgQuad::replaceDefs(Opd * oldOpd, Opd * newOpd){
+	swapStore(opd, oldOpd, newOpd, true);
+}
+
+void SetRetQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	swapRead(opd, oldOpd, newOpd);
+}
+
+void GetRetQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	swapStore(opd, oldOpd, newOpd, false);
+}
+
+void GetRetQuad::replaceDefs(Opd * oldOpd, Opd * newOpd){
+	swapStore(opd, oldOpd, newOpd, true);
+}
+
+std::list<Opd *> PhiQuad::getUses(){
+	std::list<Opd *> uses;
+	for (Opd * arg : args){ addRead(uses, arg); }
+	return uses;
+}
+
+void PhiQuad::replaceUses(Opd * oldOpd, Opd * newOpd){
+	for (Opd *& arg : args){ swapRead(arg, oldOpd, newOpd); }
+}
+
+std::list<Opd *> PhiQuad::getDefs(){
+	return { dst };
+}
+
+void PhiQuad::replaceDefs(Opd * oldOpd, Opd * newOpd){
+	swapRead(dst, oldOpd, newOpd);
+}
+
 }
@@ -0,0 +1,218 @@
+#include <iterator>
+#include "3ac.hpp"
+#include "dataflow.hpp"
+
+namespace cminusminus{
+
+// SSA construction follows Cytron et al.: a variable gets a phi
+// at each join in the iterated dominance frontier of its
+// definitions (pruned to the joins where it is live), and then
+// every definition is given a fresh version in a preorder walk
+// of the dominator tree. Only the promotable operands are
+// renamed; globals, address-taken symbols and AddrOpds are
+// memory, and are left as they are.
+
+void Procedure::toSSA(){
+	std::vector<Opd *> vars = promotableOpds();
+	HashMap<Opd *, size_t> varIdx;
+	for (size_t v = 0; v < vars.size(); v++){ varIdx[vars[v]] = v; }
+
+	ControlFlowGraph * graph = getCFG();
+	const std::vector<Quad *>& quads = graph->getQuads();
+	size_t numBlocks = graph->numBlocks();
+	Liveness live(graph, varIdx);
+
+	std::vector<std::vector<size_t>> defBlocks(vars.size());
+	for (size_t b : graph->reversePostorder()){
+		const BasicBlock& block = graph->getBlock(b);
+		for (size_t i = block.getFirst(); i <= block.getLast(); i++){
+			for (Opd * def : quads[i]->getDefs()){
+				auto found = varIdx.find(def);
+				if (found == varIdx.end()){ continue; }
+				std::vector<size_t>& blocks = defBlocks[found->second];
+				if (blocks.empty() || blocks.back() != b){
+					blocks.push_back(b);
+				}
+			}
+		}
+	}
+
+	//Place the phis. The marks hold v+1 for the variable
+	// that last put the block on the worklist or gave it a
+	// phi, so they never need to be cleared.
+	std::vector<std::vector<size_t>> blockPhis(numBlocks);
+	std::vector<size_t> hasPhi(numBlocks, 0);
+	std::vector<size_t> queued(numBlocks, 0);
+	for (size_t v = 0; v < vars.size(); v++){
+		std::vector<size_t> work = defBlocks[v];
+		for (size_t b : work){ queued[b] = v + 1; }
+		while (!work.empty()){
+			size_t b = work.back();
+			work.pop_back();
+			for (size_t join : graph->dominanceFrontier(b)){
+				if (hasPhi[join] == v + 1 || !live.liveIn(join).get(v)){
+					continue;
+				}
+				hasPhi[join] = v + 1;
+				blockPhis[join].push_back(v);
+				if (queued[join] != v + 1){
+					queued[join] = v + 1;
+					work.push_back(join);
+				}
+			}
+		}
+	}
+
+	//Phis go in front of the block's first quad, which takes
+	// its labels along. Nothing is live into the leave
+	// block, so that first quad is always in the body.
+	HashMap<PhiQuad *, size_t> phiVars;
+	size_t idx = 1;
+	for (auto itr = bodyQuads->begin(); itr != bodyQuads->end(); ++itr, ++idx){
+		size_t b = graph->blockOf(idx);
+		if (graph->getBlock(b).getFirst() != idx || blockPhis[b].empty()){
+			continue;
+		}
+		Quad * leader = *itr;
+		size_t numPreds = graph->getBlock(b).getPreds().size();
+		bool first = true;
+		for (size_t v : blockPhis[b]){
+			PhiQuad * phi = new PhiQuad(vars[v], numPreds);
+			phiVars[phi] = v;
+			if (first){
+				for (Label * label : leader->getLabels()){
+					phi->addLabel(label);
+				}
+				first = false;
+			}
+			bodyQuads->insert(itr, phi);
+		}
+		leader->clearLabels();
+	}
+	invalidateCFG();
+
+	//Rename. The phis did not change the shape of the graph,
+	// so predecessor lists still line up with phi arguments.
+	graph = getCFG();
+	const std::vector<Quad *>& ssaQuads = graph->getQuads();
+	std::vector<std::vector<Opd *>> stacks(vars.size());
+	for (size_t v = 0; v < vars.size(); v++){
+		stacks[v].push_back(vars[v]);
+	}
+	std::vector<size_t> numVersions(vars.size(), 0);
+
+	auto renameBlock = [&](size_t b, std::vector<size_t>& pushed){
+		const BasicBlock& block = graph->getBlock(b);
+		for (size_t i = block.getFirst(); i <= block.getLast(); i++){
+			Quad * quad = ssaQuads[i];
+			if (quad->asPhi() == nullptr){
+				for (Opd * use : quad->getUses()){
+					auto found = varIdx.find(use);
+					if (found != varIdx.end()){
+						quad->replaceUses(use, stacks[found->second].back());
+					}
+				}
+			}
+			for (Opd * def : quad->getDefs()){
+				auto found = varIdx.find(def);
+				if (found == varIdx.end()){ continue; }
+				size_t v = found->second;
+				AuxOpd * version = makeVersion(vars[v], ++numVersions[v]);
+				versions.push_back(version);
+				quad->replaceDefs(def, version);
+				stacks[v].push_back(version);
+				pushed.push_back(v);
+			}
+		}
+		for (size_t succ : block.getSuccs()){
+			const BasicBlock& succBlock = graph->getBlock(succ);
+			const std::vector<size_t>& preds = succBlock.getPreds();
+			size_t predIdx = 0;
+			while (preds[predIdx] != b){ predIdx++; }
+			for (size_t i = succBlock.getFirst(); i <= succBlock.getLast(); i++){
+				PhiQuad * phi = ssaQuads[i]->asPhi();
+				if (phi == nullptr){ break; }
+				size_t v = phiVars[phi];
+				phi->setArg(predIdx, stacks[v].back());
+			}
+		}
+	};
+
+	//Walk the dominator tree, keeping the variables each
+	// block pushed so they can be popped on the way out
+	struct Frame{
+		size_t block;
+		size_t nextChild;
+		std::vector<size_t> pushed;
+	};
+	std::vector<Frame> walk;
+	walk.push_back(Frame{0, 0, {}});
+	renameBlock(0, walk.back().pushed);
+	while (!walk.empty()){
+		Frame& top = walk.back();
+		const std::vector<size_t>& children = graph->domChildren(top.block);
+		if (top.nextChild < children.size()){
+			size_t child = children[top.nextChild++];
+			walk.push_back(Frame{child, 0, {}});
+			renameBlock(child, walk.back().pushed);
+		} else {
+			for (size_t v : top.pushed){ stacks[v].pop_back(); }
+			walk.pop_back();
+		}
+	}
+}
+
+// Out of SSA by Sreedhar et al.'s first method: each phi gets
+// its own temporary, which every predecessor sets at its end
+// and the phi's block copies out at its start. Since the
+// temporary is live only along those edges, no edges have to
+// be split, and the copies cannot clobber a value that is
+// still needed (the lost-copy and swap problems).
+void Procedure::fromSSA(){
+	ControlFlowGraph * graph = getCFG();
+	const std::vector<Quad *>& quads = graph->getQuads();
+
+	HashMap<Quad *, std::list<Quad *>::iterator> positions;
+	for (auto itr = bodyQuads->begin(); itr != bodyQuads->end(); ++itr){
+		positions[*itr] = itr;
+	}
+
+	for (const BasicBlock& block : graph->getBlocks()){
+		for (size_t i = block.getFirst(); i <= block.getLast(); i++){
+			PhiQuad * phi = quads[i]->asPhi();
+			if (phi == nullptr){ continue; }
+
+			Opd * dst = phi->getDst();
+			AuxOpd * tmp = makeTmp(dst->getWidth());
+			const std::vector<Opd *>& args = phi->getArgs();
+			for (size_t p = 0; p < args.size(); p++){
+				const BasicBlock& pred = graph->getBlock(block.getPreds()[p]);
+				Quad * last = quads[pred.getLast()];
+				Quad * copy = new AssignQuad(tmp, args[p], false);
+				if (last->asEnter()){
+					bodyQuads->push_front(copy);
+				} else if (last->asGoto() || last->asIfz()){
+					bodyQuads->insert(positions[last], copy);
+				} else {
+					bodyQuads->insert(std::next(positions[last]), copy);
+				}
+			}
+
+			Quad * copyOut = new AssignQuad(dst, tmp, false);
+			for (Label * label : phi->getLabels()){
+				copyOut->addLabel(label);
+			}
+			//The phi may still be the last quad of some other
+			// block's predecessor, so it keeps a position
+			auto itr = positions[phi];
+			itr = bodyQuads->erase(itr);
+			itr = bodyQuads->insert(itr, copyOut);
+			positions[copyOut] = itr;
+			positions[phi] = itr;
+		}
+	}
+	versions.clear();
+	invalidateCFG();
+}
+
+}
@@ -0,0 +1,196 @@
+#include <cstdlib>
+#include <iterator>
+#include "3ac.hpp"
+
+namespace cminusminus{
+
+// Strength reduction of induction variable multiplies, over SSA
+// form. A basic induction variable is a phi i at a loop header
+// whose argument along every back edge is the same i' = i + k,
+// with k a literal, computed once per iteration. A product
+// i * c (with c a literal) then goes up by k * c each time
+// around, so it is carried in a second induction variable:
+//
+//     header:  ic := PHI(init * c, ic')      (next to i's phi)
+//              ...
+//              i'  := i + k
+//              ic' := ic + k * c             (right after i')
+//
+// and i * c becomes a copy of ic (i' * c, or the product of a
+// copy of i', a copy of ic'). The initial value is folded when
+// init is a literal, and computed at the end of each block
+// entering the loop otherwise.
+
+//The value of a numeric literal
+static bool literalValue(Opd * opd, long long& val){
+	LitOpd * lit = opd == nullptr ? nullptr : opd->asLit();
+	if (lit == nullptr){ return false; }
+	std::string str = lit->valString();
+	char * end = nullptr;
+	val = std::strtoll(str.c_str(), &end, 10);
+	return !str.empty() && *end == '\0';
+}
+
+//Products wrap around, as imulq does
+static LitOpd * productLit(long long a, long long b){
+	unsigned long long prod = static_cast<unsigned long long>(a)
+		* static_cast<unsigned long long>(b);
+	return new LitOpd(std::to_string(static_cast<long long>(prod)), 8);
+}
+
+//If quad is next := iv + k (or k + iv, or iv - k), the step k
+static bool stepOf(Quad * quad, Opd * iv, long long& step){
+	BinOpQuad * binop = quad == nullptr ? nullptr : quad->asBinOp();
+	if (binop == nullptr){ return false; }
+	BinOp op = binop->getOp();
+	if (op == ADD64){
+		if (binop->getSrc1() == iv){
+			return literalValue(binop->getSrc2(), step);
+		}
+		return binop->getSrc2() == iv && literalValue(binop->getSrc1(), step);
+	}
+	if (op == SUB64 && binop->getSrc1() == iv
+	  && literalValue(binop->getSrc2(), step)){
+		step = static_cast<long long>(0 - static_cast<unsigned long long>(step));
+		return true;
+	}
+	return false;
+}
+
+void Procedure::reduceStrength(){
+	ControlFlowGraph * graph = getCFG();
+	const std::vector<Quad *>& quads = graph->getQuads();
+	//Only an SSA version has the one def to look up; memory and
+	// globals may be written anywhere
+	std::set<Opd *> ssa(versions.begin(), versions.end());
+	HashMap<Opd *, size_t> defSites;
+	for (size_t i = 0; i < quads.size(); i++){
+		for (Opd * def : quads[i]->getDefs()){
+			if (ssa.count(def) > 0){ defSites[def] = i; }
+		}
+	}
+	HashMap<Quad *, std::list<Quad *>::iterator> positions;
+	for (auto itr = bodyQuads->begin(); itr != bodyQuads->end(); ++itr){
+		positions[*itr] = itr;
+	}
+	auto defOf = [&](Opd * opd) -> Quad * {
+		auto found = defSites.find(opd);
+		return found == defSites.end() ? nullptr : quads[found->second];
+	};
+
+	//Insert quad at the end of the given block, before the
+	// jump that ends it if there is one
+	auto appendToBlock = [&](size_t b, Quad * quad){
+		const BasicBlock& block = graph->getBlock(b);
+		Quad * last = quads[block.getLast()];
+		if (last->asEnter()){
+			bodyQuads->push_front(quad);
+		} else if (last->asGoto() || last->asIfz()){
+			if (block.getFirst() == block.getLast()){
+				for (Label * label : last->getLabels()){ quad->addLabel(label); }
+				last->clearLabels();
+			}
+			bodyQuads->insert(positions[last], quad);
+		} else {
+			bodyQuads->insert(std::next(positions[last]), quad);
+		}
+	};
+
+	std::set<Quad *> reduced;
+	const std::vector<Loop>& loops = graph->getLoops();
+	for (size_t l = 0; l < loops.size(); l++){
+		const Loop& loop = loops[l];
+		const BasicBlock& head = graph->getBlock(loop.getHeader());
+		const std::vector<size_t>& preds = head.getPreds();
+
+		for (size_t i = head.getFirst(); i <= head.getLast(); i++){
+			PhiQuad * phi = quads[i]->asPhi();
+			if (phi == nullptr){ break; }
+			Opd * iv = phi->getDst();
+
+			//The same increment along every back edge, run
+			// once per iteration
+			Opd * next = nullptr;
+			bool basic = true;
+			for (size_t p = 0; p < preds.size(); p++){
+				if (!loop.contains(preds[p])){ continue; }
+				Opd * arg = phi->getArgs()[p];
+				if (next != nullptr && arg != next){ basic = false; }
+				next = arg;
+			}
+			//Copies of the increment carry the same value, and
+			// are not propagated away. A cycle of copies is not
+			// an increment, so stop at the first repeat
+			std::set<Opd *> nexts;
+			Quad * incr = defOf(next);
+			while (incr != nullptr && incr->asAssign()
+			  && nexts.insert(next).second){
+				next = incr->asAssign()->getSrc();
+				incr = defOf(next);
+			}
+			nexts.insert(next);
+			long long step;
+			if (!basic || incr == nullptr || !stepOf(incr, iv, step)){ continue; }
+			size_t incrBlock = graph->blockOf(defSites[next]);
+			if (graph->getBlock(incrBlock).getLoop() != l){ continue; }
+
+			//The derived induction variables, by multiplier
+			std::map<long long, std::pair<Opd *, Opd *>> derived;
+			for (size_t b : loop.getBlocks()){
+				const BasicBlock& block = graph->getBlock(b);
+				for (size_t q = block.getFirst(); q <= block.getLast(); q++){
+					BinOpQuad * mult = quads[q]->asBinOp();
+					if (mult == nullptr || reduced.count(mult) > 0){ continue; }
+					if (mult->getOp() != MULT64){ continue; }
+					Opd * factor = mult->getSrc1();
+					long long c;
+					if (!literalValue(mult->getSrc2(), c)){
+						factor = mult->getSrc2();
+						if (!literalValue(mult->getSrc1(), c)){ continue; }
+					}
+					if (factor != iv && nexts.count(factor) == 0){ continue; }
+
+					auto found = derived.find(c);
+					if (found == derived.end()){
+						AuxOpd * cur = makeTmp(8);
+						AuxOpd * upd = makeTmp(8);
+						versions.push_back(cur);
+						versions.push_back(upd);
+						PhiQuad * curPhi = new PhiQuad(cur, preds.size());
+						for (size_t p = 0; p < preds.size(); p++){
+							if (loop.contains(preds[p])){
+								curPhi->setArg(p, upd);
+								continue;
+							}
+							Opd * init = phi->getArgs()[p];
+							long long initVal;
+							if (literalValue(init, initVal)){
+								curPhi->setArg(p, productLit(initVal, c));
+							} else {
+								AuxOpd * start = makeTmp(8);
+								versions.push_back(start);
+								appendToBlock(preds[p], new BinOpQuad(start,
+									MULT64, init, productLit(1, c)));
+								curPhi->setArg(p, start);
+							}
+						}
+						bodyQuads->insert(std::next(positions[phi]), curPhi);
+						bodyQuads->insert(std::next(positions[incr]),
+							new BinOpQuad(upd, ADD64, cur, productLit(step, c)));
+						found = derived.insert(
+							std::make_pair(c, std::make_pair(cur, upd))).first;
+					}
+					Opd * value = factor == iv ? found->second.first
+						: found->second.second;
+					Quad * copy = new AssignQuad(mult->getDst(), value, false);
+					for (Label * label : mult->getLabels()){ copy->addLabel(label); }
+					*positions[mult] = copy;
+					reduced.insert(mult);
+				}
+			}
+		}
+	}
+	if (!reduced.empty()){ invalidateCFG(); }
+}
+
+}
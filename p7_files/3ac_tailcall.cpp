@@ -0,0 +1,137 @@
+#include <iterator>
+#include "3ac.hpp"
+
+namespace cminusminus{
+
+// Tail-call elimination. A return of a call's result lowers to
+//
+//     setarg 1 a ... setarg n z
+//     call f
+//     getret t
+//     setret t
+//     goto leave
+//
+// (without the getret and setret when nothing is returned), so
+// the frame is kept alive only to hand back what f returns.
+// When f is the procedure itself, the arguments are copied into
+// the formals and the call becomes a jump back to the top of
+// the body, so the recursion runs as a loop. When f is another
+// procedure that takes its arguments in registers, the call
+// becomes a TailCallQuad, which pops the frame before jumping.
+//
+// Both reuse the frame while the call's arguments could still
+// point into it, so nothing is done for a procedure that takes
+// the address of any of its own variables.
+
+//The position of the first quad of the setargs that end just
+// before call, or call itself if there are none. numArgs is
+// set to the number of arguments. Returns the end of quads if
+// the setargs are not all there.
+static std::list<Quad *>::iterator argsStart(std::list<Quad *>& quads,
+  std::list<Quad *>::iterator call, size_t& numArgs){
+	auto first = call;
+	numArgs = 0;
+	//The index the setarg before first has to have, once
+	// the last argument is known
+	size_t expected = 0;
+	while (first != quads.begin()){
+		SetArgQuad * setArg = (*std::prev(first))->asSetArg();
+		if (setArg == nullptr){ break; }
+		if (expected != 0 && setArg->getIndex() != expected){ break; }
+		if (numArgs == 0){ numArgs = setArg->getIndex(); }
+		--first;
+		if (setArg->getIndex() == 1){ return first; }
+		expected = setArg->getIndex() - 1;
+	}
+	return numArgs == 0 ? call : quads.end();
+}
+
+void Procedure::eliminateTailCalls(){
+	std::set<Opd *> globals = myProg->globalSyms();
+	for (auto quad : *bodyQuads){
+		LocQuad * loc = quad->asLoc();
+		if (loc && loc->isSrcLoc() && !loc->getSrc()->asAddr()
+		  && globals.count(loc->getSrc()) == 0){
+			return;
+		}
+	}
+
+	//Where a self-recursive call jumps to: the quad right
+	// after the getargs that start the body
+	Label * top = nullptr;
+	auto makeTop = [&](){
+		auto itr = bodyQuads->begin();
+		while (itr != bodyQuads->end() && (*itr)->asGetArg()){ ++itr; }
+		top = makeLabel();
+		Quad * nop = new NopQuad();
+		nop->addLabel(top);
+		bodyQuads->insert(itr, nop);
+	};
+
+	bool changed = false;
+	for (auto itr = bodyQuads->begin(); itr != bodyQuads->end(); ++itr){
+		CallQuad * call = (*itr)->asCall();
+		if (call == nullptr || !call->getLabels().empty()){ continue; }
+
+		//The call's result, if any, has to be returned as is,
+		// and nothing may come after that but leaving
+		auto end = std::next(itr);
+		auto unlabeled = [&](){
+			return end != bodyQuads->end() && (*end)->getLabels().empty();
+		};
+		GetRetQuad * getRet = unlabeled() ? (*end)->asGetRet() : nullptr;
+		if (getRet != nullptr){
+			++end;
+			SetRetQuad * setRet = unlabeled() ? (*end)->asSetRet() : nullptr;
+			if (setRet == nullptr || setRet->getSrc() != getRet->getDst()){
+				continue;
+			}
+			++end;
+		}
+		if (end != bodyQuads->end()){
+			GotoQuad * jmp = unlabeled() ? (*end)->asGoto() : nullptr;
+			if (jmp == nullptr || jmp->getTarget() != leaveLabel){ continue; }
+			++end;
+		}
+
+		size_t numArgs;
+		auto first = argsStart(*bodyQuads, itr, numArgs);
+		if (first == bodyQuads->end()){ continue; }
+		bool self = call->getCallee()->getName() == myName;
+		if (self ? numArgs != formals.size() : numArgs > RegUtils::REG_ARGS){
+			continue;
+		}
+
+		if (!self){
+			*itr = new TailCallQuad(this, call->getCallee());
+			itr = bodyQuads->erase(std::next(itr), end);
+			itr = bodyQuads->insert(itr, new GotoQuad(leaveLabel));
+			changed = true;
+			continue;
+		}
+
+		//Every argument is read before any formal is written
+		if (top == nullptr){ makeTop(); }
+		std::vector<Opd *> newVals;
+		for (auto arg = first; arg != itr; ++arg){
+			SetArgQuad * setArg = (*arg)->asSetArg();
+			AuxOpd * tmp = makeTmp(setArg->getSrc()->getWidth());
+			Quad * save = new AssignQuad(tmp, setArg->getSrc(), false);
+			for (Label * label : setArg->getLabels()){ save->addLabel(label); }
+			*arg = save;
+			newVals.push_back(tmp);
+		}
+		itr = bodyQuads->erase(itr, end);
+		size_t idx = 0;
+		for (SymOpd * formal : formals){
+			Quad * update = new AssignQuad(formal, newVals[idx++], false);
+			update->setComment("Tail call");
+			bodyQuads->insert(itr, update);
+		}
+		itr = bodyQuads->insert(itr, new GotoQuad(top));
+		changed = true;
+	}
+	if (changed){ invalidateCFG(); }
+}
+
+}
@@ -0,0 +1,67 @@
+#include <cstdlib>
+#include "arena.hpp"
+#include "errors.hpp"
+
+namespace cminusminus{
+
+static const size_t BLOCK_SIZE = 64 * 1024;
+static const size_t ALIGN = alignof(std::max_align_t);
+
+static Arena * currentArena = nullptr;
+
+Arena::Arena() : cursor(nullptr), limit(nullptr), previous(currentArena),
+  numNodes(0){
+	currentArena = this;
+}
+
+Arena::~Arena(){
+	//Destroy in the reverse order of construction, so that
+	// containers go away before the things they point to
+	for (auto itr = finalizers.rbegin(); itr != finalizers.rend(); ++itr){
+		itr->second(itr->first);
+	}
+	for (char * block : blocks){
+		std::free(block);
+	}
+	currentArena = previous;
+}
+
+Arena * Arena::current(){
+	if (currentArena == nullptr){
+		throw new InternalError("No arena to allocate from");
+	}
+	return currentArena;
+}
+
+char * Arena::newBlock(size_t size){
+	char * block = static_cast<char *>(std::malloc(size));
+	if (block == nullptr){ throw std::bad_alloc(); }
+	blocks.push_back(block);
+	return block;
+}
+
+void * Arena::allocate(size_t size){
+	size = (size + ALIGN - 1) & ~(ALIGN - 1);
+	if (size > BLOCK_SIZE / 4){
+		//Oversized requests get a block of their own so
+		// that they don't waste the tail of the current one
+		return newBlock(size);
+	}
+	if (size > static_cast<size_t>(limit - cursor)){
+		cursor = newBlock(BLOCK_SIZE);
+		limit = cursor + BLOCK_SIZE;
+	}
+	void * res = cursor;
+	cursor += size;
+	return res;
+}
+
+void Arena::destroyObject(void * obj){
+	static_cast<ArenaObject *>(obj)->~ArenaObject();
+}
+
+void Arena::adopt(ArenaObject * obj){
+	finalizers.push_back(std::make_pair(obj, &destroyObject));
+}
+
+}
@@ -0,0 +1,131 @@
+#ifndef CMINUSMINUS_ARENA_HPP
+#define CMINUSMINUS_ARENA_HPP
+
+#include <cstddef>
+#include <list>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cminusminus{
+
+class ArenaObject;
+
+// A bump allocator for everything the front end builds for a single
+// compilation (tokens, AST nodes and the lists that hold
+// them). Allocation is a pointer increment into a large block, and
+// nothing is freed individually: the whole arena is released in one
+// shot when it is destroyed, after running the destructors of any
+// objects that need one.
+//
+// An Arena makes itself the current arena for as long as it is alive
+// (restoring the previous one when it dies), so that classes deriving
+// from ArenaObject can be created with a plain "new".
+class Arena{
+public:
+	Arena();
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void * allocate(size_t size);
+
+	//Construct a T in the arena. T's destructor is run when the
+	// arena is released, unless it would do nothing.
+	template <typename T, typename... Args>
+	T * make(Args&&... args){
+		void * mem = allocate(sizeof(T));
+		T * obj = new (mem) T(std::forward<Args>(args)...);
+		if (NeedsFinalizer<T>::value){
+			finalizers.push_back(std::make_pair(obj, &destroy<T>));
+		}
+		return obj;
+	}
+
+	//Run obj's destructor when the arena is released
+	void adopt(ArenaObject * obj);
+
+	//AST nodes are numbered per arena, so that the ids of one
+	// compilation start from zero however many came before it
+	size_t newNodeID(){ return numNodes++; }
+	size_t nodeCount() const{ return numNodes; }
+
+	static Arena * current();
+private:
+	template <typename T>
+	struct NeedsFinalizer
+	: std::integral_constant<bool, !std::is_trivially_destructible<T>::value>{ };
+	template <typename T>
+	static void destroy(void * obj){ static_cast<T *>(obj)->~T(); }
+	static void destroyObject(void * obj);
+
+	char * newBlock(size_t size);
+
+	std::vector<char *> blocks;
+	char * cursor;
+	char * limit;
+	std::vector<std::pair<void *, void (*)(void *)>> finalizers;
+	Arena * previous;
+	size_t numNodes;
+};
+
+// Classes deriving from ArenaObject are always allocated in the
+// current arena. Deleting one is a no-op; the storage is handled
+// when the arena is released. Most of them hold nothing but
+// pointers and numbers, so their destructors are never run: a
+// class with a member that owns memory (a std::string, say) adopts
+// itself into the arena in its constructor instead.
+class ArenaObject{
+public:
+	static void * operator new(size_t size){
+		return Arena::current()->allocate(size);
+	}
+	static void operator delete(void *){ }
+	virtual ~ArenaObject(){ }
+protected:
+	ArenaObject(){ }
+};
+
+// A standard allocator over the arena that is current when it is
+// created, for the containers that the grammar builds. Freeing is
+// a no-op, like deleting an ArenaObject.
+template <typename T>
+class ArenaAllocator{
+public:
+	typedef T value_type;
+
+	ArenaAllocator() : arena(Arena::current()){ }
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena){ }
+
+	T * allocate(size_t n){
+		return static_cast<T *>(arena->allocate(n * sizeof(T)));
+	}
+	void deallocate(T *, size_t){ }
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const{
+		return arena == other.arena;
+	}
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const{
+		return arena != other.arena;
+	}
+private:
+	template <typename U> friend class ArenaAllocator;
+	Arena * arena;
+};
+
+template <typename T>
+using ArenaList = std::list<T, ArenaAllocator<T>>;
+
+//An ArenaList of things that need no destroying is all arena
+// memory, so its destructor would only walk the nodes
+template <typename T>
+struct Arena::NeedsFinalizer<ArenaList<T>>
+: std::integral_constant<bool, !std::is_trivially_destructible<T>::value>{ };
+
+}
+
+#endif
@@ -1,9 +1,9 @@
 #include "ast.hpp"
 
-cminusminus::ProgramNode::ProgramNode(std::list<DeclNode *> * globalsIn)
-: ASTNode(new Position(0,0,0,0)), myGlobals(globalsIn){
+cminusminus::ProgramNode::ProgramNode(ArenaList<DeclNode *> * globalsIn)
+: ASTNode(Position()), myGlobals(globalsIn){
 	if (!globalsIn->empty()){
-		myPos->expand(
+		myPos = Position(
 			myGlobals->front()->pos(),
 			myGlobals->back()->pos()
 		);
@@ -5,6 +5,7 @@
 #include <sstream>
 #include <string.h>
 #include <list>
+#include "arena.hpp"
 #include "tokens.hpp"
 #include "types.hpp"
 #include "3ac.hpp"
@@ -28,24 +29,34 @@ class ExpNode;
 class LValNode;
 class IDNode;
 
-class ASTNode{
+//Every node is numbered densely in order of construction 
+// within its arena, so that analyses can keep per-node facts in plain 
+// vectors indexed by id() rather than in hash maps keyed 
+// on the node's address.
+class ASTNode : public ArenaObject{
 public:
-	ASTNode(Position * pos) : myPos(pos){ }
+	ASTNode(const Position& pos) : myPos(pos), myID(Arena::current()->newNodeID()){ }
 	virtual void unparse(std::ostream&, int) = 0;
-	Position * pos() { return myPos; };
-	std::string posStr(){ return pos()->span(); }
+	const Position& pos() { return myPos; };
+	size_t id() const { return myID; }
+	//The number of node ids handed out so far in the
+	// current arena
+	static size_t count(){ return Arena::current()->nodeCount(); }
+	std::string posStr(){ return pos().span(); }
 	virtual bool nameAnalysis(SymbolTable *) = 0;
 	//Note that there is no ASTNode::typeAnalysis. To allow
 	// for different type signatures, type analysis is 
 	// implemented as needed in various subclasses
 	virtual std::string nodeKind() = 0;
 protected:
-	Position * myPos = nullptr;
+	Position myPos;
+private:
+	const size_t myID;
 };
 
 class ProgramNode : public ASTNode{
 public:
-	ProgramNode(std::list<DeclNode *> * globalsIn);
+	ProgramNode(ArenaList<DeclNode *> * globalsIn);
 	virtual std::string nodeKind() override { return "Program"; }
 	void unparse(std::ostream&, int) override;
 	virtual bool nameAnalysis(SymbolTable *) override;
@@ -53,23 +64,26 @@ public:
 	IRProgram * to3AC(TypeAnalysis * ta);
 	virtual ~ProgramNode(){ }
 private:
-	std::list<DeclNode *> * myGlobals;
+	ArenaList<DeclNode *> * myGlobals;
 };
 
 class ExpNode : public ASTNode{
 protected:
-	ExpNode(Position * p) : ASTNode(p){ }
+	ExpNode(const Position& p) : ASTNode(p){ }
 public:
 	virtual void unparseNested(std::ostream& out);
 	//virtual void unparse(std::ostream& out, int indent) override = 0;
 	virtual bool nameAnalysis(SymbolTable * symTab) override = 0;
 	virtual void typeAnalysis(TypeAnalysis *) = 0;
 	virtual Opd * flatten(Procedure * proc) = 0;
+	//Evaluate the expression as a condition: jump to tgt if
+	// its value is jumpIf, and fall through otherwise
+	virtual void flattenCond(Procedure * proc, Label * tgt, bool jumpIf);
 };
 
 class LValNode : public ExpNode{
 public:
-	LValNode(Position * p) : ExpNode(p){}
+	LValNode(const Position& p) : ExpNode(p){}
 	virtual std::string nodeKind() override { return "LVal"; }
 	void unparse(std::ostream& out, int indent) override = 0;
 	void unparseNested(std::ostream& out) override;
@@ -81,9 +95,10 @@ public:
 
 class IDNode : public LValNode{
 public:
-	IDNode(Position * p, std::string nameIn)
+	IDNode(const Position& p, Atom nameIn)
 	: LValNode(p), name(nameIn), mySymbol(nullptr){}
-	std::string getName(){ return name; }
+	const std::string& getName() const { return name.str(); }
+	Atom getAtom() const { return name; }
 	virtual std::string nodeKind() override { return "ID"; }
 	void unparse(std::ostream& out, int indent) override;
 	void attachSymbol(SemSymbol * symbolIn);
@@ -92,13 +107,13 @@ public:
 	virtual void typeAnalysis(TypeAnalysis *) override;
 	virtual Opd * flatten(Procedure * proc) override;
 private:
-	std::string name;
+	Atom name;
 	SemSymbol * mySymbol;
 };
 
 class TypeNode : public ASTNode{
 public:
-	TypeNode(Position * p) : ASTNode(p){ }
+	TypeNode(const Position& p) : ASTNode(p){ }
 	void unparse(std::ostream&, int) override = 0;
 	virtual std::string nodeKind() override = 0;
 	virtual const DataType * getType() = 0;
@@ -108,7 +123,7 @@ public:
 
 class StmtNode : public ASTNode{
 public:
-	StmtNode(Position * p) : ASTNode(p){ }
+	StmtNode(const Position& p) : ASTNode(p){ }
 	virtual void unparse(std::ostream& out, int indent) override = 0;
 	virtual std::string nodeKind() override = 0;
 	virtual void typeAnalysis(TypeAnalysis *) = 0;
@@ -117,7 +132,7 @@ public:
 
 class DeclNode : public StmtNode{
 public:
-	DeclNode(Position * p) : StmtNode(p){ }
+	DeclNode(const Position& p) : StmtNode(p){ }
 	void unparse(std::ostream& out, int indent) override =0;
 	virtual std::string nodeKind() override = 0;
 	virtual void typeAnalysis(TypeAnalysis *) override = 0;
@@ -127,7 +142,7 @@ public:
 
 class VarDeclNode : public DeclNode{
 public:
-	VarDeclNode(Position * p, TypeNode * typeIn, IDNode * IDIn)
+	VarDeclNode(const Position& p, TypeNode * typeIn, IDNode * IDIn)
 	: DeclNode(p), myType(typeIn), myID(IDIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "VarDecl"; }
@@ -144,7 +159,7 @@ private:
 
 class FormalDeclNode : public VarDeclNode{
 public:
-	FormalDeclNode(Position * p, TypeNode * type, IDNode * id) 
+	FormalDeclNode(const Position& p, TypeNode * type, IDNode * id) 
 	: VarDeclNode(p, type, id){ }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "FormalDecl"; }
@@ -154,15 +169,15 @@ public:
 
 class FnDeclNode : public DeclNode{
 public:
-	FnDeclNode(Position * p, 
+	FnDeclNode(const Position& p, 
 	  TypeNode * retTypeIn, IDNode * idIn,
-	  std::list<FormalDeclNode *> * formalsIn,
-	  std::list<StmtNode *> * bodyIn)
+	  ArenaList<FormalDeclNode *> * formalsIn,
+	  ArenaList<StmtNode *> * bodyIn)
 	: DeclNode(p), myRetType(retTypeIn), myID(idIn),
 	  myFormals(formalsIn), myBody(bodyIn){ 
 	}
 	IDNode * ID() const { return myID; }
-	std::list<FormalDeclNode *> * getFormals() const{
+	ArenaList<FormalDeclNode *> * getFormals() const{
 		return myFormals;
 	}
 	void unparse(std::ostream& out, int indent) override;
@@ -177,13 +192,13 @@ public:
 private:
 	TypeNode * myRetType;
 	IDNode * myID;
-	std::list<FormalDeclNode *> * myFormals;
-	std::list<StmtNode *> * myBody;
+	ArenaList<FormalDeclNode *> * myFormals;
+	ArenaList<StmtNode *> * myBody;
 };
 
 class AssignStmtNode : public StmtNode{
 public:
-	AssignStmtNode(Position * p, AssignExpNode * expIn)
+	AssignStmtNode(const Position& p, AssignExpNode * expIn)
 	: StmtNode(p), myExp(expIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "AssignStmt"; }
@@ -196,7 +211,7 @@ private:
 
 class ReadStmtNode : public StmtNode{
 public:
-	ReadStmtNode(Position * p, LValNode * dstIn)
+	ReadStmtNode(const Position& p, LValNode * dstIn)
 	: StmtNode(p), myDst(dstIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "ReceiveStmt"; }
@@ -209,7 +224,7 @@ private:
 
 class WriteStmtNode : public StmtNode{
 public:
-	WriteStmtNode(Position * p, ExpNode * srcIn)
+	WriteStmtNode(const Position& p, ExpNode * srcIn)
 	: StmtNode(p), mySrc(srcIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "ReportStmt"; }
@@ -222,7 +237,7 @@ private:
 
 class PostDecStmtNode : public StmtNode{
 public:
-	PostDecStmtNode(Position * p, LValNode * lvalIn)
+	PostDecStmtNode(const Position& p, LValNode * lvalIn)
 	: StmtNode(p), myLVal(lvalIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "PostDecStmt"; }
@@ -235,7 +250,7 @@ private:
 
 class PostIncStmtNode : public StmtNode{
 public:
-	PostIncStmtNode(Position * p, LValNode * lvalIn)
+	PostIncStmtNode(const Position& p, LValNode * lvalIn)
 	: StmtNode(p), myLVal(lvalIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "PostIncStmt"; }
@@ -248,8 +263,8 @@ private:
 
 class IfStmtNode : public StmtNode{
 public:
-	IfStmtNode(Position * p, ExpNode * condIn,
-	  std::list<StmtNode *> * bodyIn)
+	IfStmtNode(const Position& p, ExpNode * condIn,
+	  ArenaList<StmtNode *> * bodyIn)
 	: StmtNode(p), myCond(condIn), myBody(bodyIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "IfStmt"; }
@@ -258,14 +273,14 @@ public:
 	virtual void to3AC(Procedure * prog) override;
 private:
 	ExpNode * myCond;
-	std::list<StmtNode *> * myBody;
+	ArenaList<StmtNode *> * myBody;
 };
 
 class IfElseStmtNode : public StmtNode{
 public:
-	IfElseStmtNode(Position * p, ExpNode * condIn, 
-	  std::list<StmtNode *> * bodyTrueIn,
-	  std::list<StmtNode *> * bodyFalseIn)
+	IfElseStmtNode(const Position& p, ExpNode * condIn, 
+	  ArenaList<StmtNode *> * bodyTrueIn,
+	  ArenaList<StmtNode *> * bodyFalseIn)
 	: StmtNode(p), myCond(condIn),
 	  myBodyTrue(bodyTrueIn), myBodyFalse(bodyFalseIn) { }
 	void unparse(std::ostream& out, int indent) override;
@@ -275,14 +290,14 @@ public:
 	virtual void to3AC(Procedure * prog) override;
 private:
 	ExpNode * myCond;
-	std::list<StmtNode *> * myBodyTrue;
-	std::list<StmtNode *> * myBodyFalse;
+	ArenaList<StmtNode *> * myBodyTrue;
+	ArenaList<StmtNode *> * myBodyFalse;
 };
 
 class WhileStmtNode : public StmtNode{
 public:
-	WhileStmtNode(Position * p, ExpNode * condIn, 
-	  std::list<StmtNode *> * bodyIn)
+	WhileStmtNode(const Position& p, ExpNode * condIn, 
+	  ArenaList<StmtNode *> * bodyIn)
 	: StmtNode(p), myCond(condIn), myBody(bodyIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "WhileStmt"; }
@@ -291,12 +306,12 @@ public:
 	virtual void to3AC(Procedure * prog) override;
 private:
 	ExpNode * myCond;
-	std::list<StmtNode *> * myBody;
+	ArenaList<StmtNode *> * myBody;
 };
 
 class ReturnStmtNode : public StmtNode{
 public:
-	ReturnStmtNode(Position * p, ExpNode * exp)
+	ReturnStmtNode(const Position& p, ExpNode * exp)
 	: StmtNode(p), myExp(exp){ }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "ReturnStmt"; }
@@ -309,8 +324,8 @@ private:
 
 class CallExpNode : public ExpNode{
 public:
-	CallExpNode(Position * p, IDNode * id,
-	  std::list<ExpNode *> * argsIn)
+	CallExpNode(const Position& p, IDNode * id,
+	  ArenaList<ExpNode *> * argsIn)
 	: ExpNode(p), myID(id), myArgs(argsIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	void unparseNested(std::ostream& out) override;
@@ -322,12 +337,12 @@ public:
 	virtual Opd * flatten(Procedure * proc) override;
 private:
 	IDNode * myID;
-	std::list<ExpNode *> * myArgs;
+	ArenaList<ExpNode *> * myArgs;
 };
 
 class BinaryExpNode : public ExpNode{
 public:
-	BinaryExpNode(Position * p, ExpNode * lhs, ExpNode * rhs)
+	BinaryExpNode(const Position& p, ExpNode * lhs, ExpNode * rhs)
 	: ExpNode(p), myExp1(lhs), myExp2(rhs) { }
 	bool nameAnalysis(SymbolTable * symTab) override;
 	virtual void typeAnalysis(TypeAnalysis *) override = 0;
@@ -339,11 +354,14 @@ protected:
 	void binaryEqTyping(TypeAnalysis * typing);
 	void binaryRelTyping(TypeAnalysis * typing);
 	void binaryMathTyping(TypeAnalysis * typing);
+	//Lower a comparison in a condition. The operator given
+	// is the one whose falsehood sends control to tgt.
+	void compareCond(Procedure * proc, Label * tgt, BinOp op64, BinOp op8);
 };
 
 class PlusNode : public BinaryExpNode{
 public:
-	PlusNode(Position * p, ExpNode * e1, ExpNode * e2)
+	PlusNode(const Position& p, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(p, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "Plus"; }
@@ -353,7 +371,7 @@ public:
 
 class MinusNode : public BinaryExpNode{
 public:
-	MinusNode(Position * p, ExpNode * e1, ExpNode * e2)
+	MinusNode(const Position& p, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(p, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "Minus"; }
@@ -363,7 +381,7 @@ public:
 
 class TimesNode : public BinaryExpNode{
 public:
-	TimesNode(Position * p, ExpNode * e1In, ExpNode * e2In)
+	TimesNode(const Position& p, ExpNode * e1In, ExpNode * e2In)
 	: BinaryExpNode(p, e1In, e2In){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "Times"; }
@@ -373,7 +391,7 @@ public:
 
 class DivideNode : public BinaryExpNode{
 public:
-	DivideNode(Position * p, ExpNode * e1, ExpNode * e2)
+	DivideNode(const Position& p, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(p, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "Divide"; }
@@ -383,89 +401,105 @@ public:
 
 class AndNode : public BinaryExpNode{
 public:
-	AndNode(Position * p, ExpNode * e1, ExpNode * e2)
+	AndNode(const Position& p, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(p, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "And"; }
 	virtual void typeAnalysis(TypeAnalysis *) override;
 	virtual Opd * flatten(Procedure * prog) override;
+	virtual void flattenCond(Procedure * proc, Label * tgt,
+		bool jumpIf) override;
 };
 
 class OrNode : public BinaryExpNode{
 public:
-	OrNode(Position * p, ExpNode * e1, ExpNode * e2)
+	OrNode(const Position& p, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(p, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "Or"; }
 	virtual void typeAnalysis(TypeAnalysis *) override;
 	virtual Opd * flatten(Procedure * prog) override;
+	virtual void flattenCond(Procedure * proc, Label * tgt,
+		bool jumpIf) override;
 };
 
 class EqualsNode : public BinaryExpNode{
 public:
-	EqualsNode(Position * p, ExpNode * e1, ExpNode * e2)
+	EqualsNode(const Position& p, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(p, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "Eq"; }
 	virtual void typeAnalysis(TypeAnalysis *) override;
 	virtual Opd * flatten(Procedure * prog) override;
+	virtual void flattenCond(Procedure * proc, Label * tgt,
+		bool jumpIf) override;
 	
 };
 
 class NotEqualsNode : public BinaryExpNode{
 public:
-	NotEqualsNode(Position * p, ExpNode * e1, ExpNode * e2)
+	NotEqualsNode(const Position& p, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(p, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "NotEq"; }
 	virtual void typeAnalysis(TypeAnalysis *) override;
 	virtual Opd * flatten(Procedure * prog) override;
+	virtual void flattenCond(Procedure * proc, Label * tgt,
+		bool jumpIf) override;
 	
 };
 
 class LessNode : public BinaryExpNode{
 public:
-	LessNode(Position * p, ExpNode * e1, ExpNode * e2)
+	LessNode(const Position& p, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(p, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "Less"; }
 	virtual void typeAnalysis(TypeAnalysis *) override;
 	virtual Opd * flatten(Procedure * proc) override;
+	virtual void flattenCond(Procedure * proc, Label * tgt,
+		bool jumpIf) override;
 };
 
 class LessEqNode : public BinaryExpNode{
 public:
-	LessEqNode(Position * pos, ExpNode * e1, ExpNode * e2)
+	LessEqNode(const Position& pos, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(pos, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "LessEq"; }
 	virtual void typeAnalysis(TypeAnalysis *) override;
 	virtual Opd * flatten(Procedure * prog) override;
+	virtual void flattenCond(Procedure * proc, Label * tgt,
+		bool jumpIf) override;
 };
 
 class GreaterNode : public BinaryExpNode{
 public:
-	GreaterNode(Position * p, ExpNode * e1, ExpNode * e2)
+	GreaterNode(const Position& p, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(p, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "GreaterEq"; }
 	virtual void typeAnalysis(TypeAnalysis *) override;
 	virtual Opd * flatten(Procedure * proc) override;
+	virtual void flattenCond(Procedure * proc, Label * tgt,
+		bool jumpIf) override;
 };
 
 class GreaterEqNode : public BinaryExpNode{
 public:
-	GreaterEqNode(Position * p, ExpNode * e1, ExpNode * e2)
+	GreaterEqNode(const Position& p, ExpNode * e1, ExpNode * e2)
 	: BinaryExpNode(p, e1, e2){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "GreaterEq"; }
 	virtual void typeAnalysis(TypeAnalysis *) override;
 	virtual Opd * flatten(Procedure * prog) override;
+	virtual void flattenCond(Procedure * proc, Label * tgt,
+		bool jumpIf) override;
 };
 
 class UnaryExpNode : public ExpNode {
 public:
-	UnaryExpNode(Position * p, ExpNode * expIn) 
+	UnaryExpNode(const Position& p, ExpNode * expIn) 
 	: ExpNode(p){
 		this->myExp = expIn;
 	}
@@ -479,7 +513,7 @@ protected:
 
 class ShortToIntNode : public UnaryExpNode{
 public:
-	ShortToIntNode(Position * p, ExpNode * expIn): UnaryExpNode(p, expIn) { }
+	ShortToIntNode(const Position& p, ExpNode * expIn): UnaryExpNode(p, expIn) { }
 	void unparse(std::ostream& out, int indent) override {
 		myExp->unparse(out, indent);
 	}
@@ -498,7 +532,7 @@ public:
 
 class RefNode : public UnaryExpNode{
 public:
-	RefNode(Position * p, IDNode * IDIn) 
+	RefNode(const Position& p, IDNode * IDIn) 
 	: UnaryExpNode(p, IDIn), myID(IDIn){
 	}
 	std::string nodeKind() override { return "&"; }
@@ -512,7 +546,7 @@ protected:
 
 class DerefNode : public LValNode{
 public:
-	DerefNode(Position * p, IDNode * IDIn) 
+	DerefNode(const Position& p, IDNode * IDIn) 
 	: LValNode(p), myID(IDIn){
 	}
 	std::string nodeKind() override { return "Deref"; }
@@ -526,7 +560,7 @@ protected:
 
 class NegNode : public UnaryExpNode{
 public:
-	NegNode(Position * p, ExpNode * exp)
+	NegNode(const Position& p, ExpNode * exp)
 	: UnaryExpNode(p, exp){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "Neg"; }
@@ -537,18 +571,20 @@ public:
 
 class NotNode : public UnaryExpNode{
 public:
-	NotNode(Position * p, ExpNode * exp)
+	NotNode(const Position& p, ExpNode * exp)
 	: UnaryExpNode(p, exp){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "Not"; }
 	bool nameAnalysis(SymbolTable * symTab) override;
 	virtual void typeAnalysis(TypeAnalysis *) override;
 	virtual Opd * flatten(Procedure * prog) override;
+	virtual void flattenCond(Procedure * proc, Label * tgt,
+		bool jumpIf) override;
 };
 
 class VoidTypeNode : public TypeNode{
 public:
-	VoidTypeNode(Position * p) : TypeNode(p){}
+	VoidTypeNode(const Position& p) : TypeNode(p){}
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "VoidType"; }
 	virtual const DataType * getType()override { 
@@ -558,7 +594,7 @@ public:
 
 class PtrTypeNode : public TypeNode{
 public:
-	PtrTypeNode(Position * p, TypeNode * baseTypeIn)
+	PtrTypeNode(const Position& p, TypeNode * baseTypeIn)
 	:TypeNode(p), myBaseType(baseTypeIn) { }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "PTR " + myBaseType->nodeKind(); }
@@ -570,7 +606,7 @@ private:
 
 class IntTypeNode : public TypeNode{
 public:
-	IntTypeNode(Position * p): TypeNode(p){}
+	IntTypeNode(const Position& p): TypeNode(p){}
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "IntType"; }
 	virtual const DataType * getType() override;
@@ -578,7 +614,7 @@ public:
 
 class ShortTypeNode : public TypeNode{
 public:
-	ShortTypeNode(Position * p): TypeNode(p){}
+	ShortTypeNode(const Position& p): TypeNode(p){}
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "ShortType"; }
 	virtual const DataType * getType() override { return BasicType::SHORT(); }
@@ -586,7 +622,7 @@ public:
 
 class BoolTypeNode : public TypeNode{
 public:
-	BoolTypeNode(Position * p): TypeNode(p) { }
+	BoolTypeNode(const Position& p): TypeNode(p) { }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "BoolType"; }
 	virtual const DataType * getType() override;
@@ -594,7 +630,7 @@ public:
 
 class StringTypeNode : public TypeNode{
 public:
-	StringTypeNode(Position * p): TypeNode(p) { }
+	StringTypeNode(const Position& p): TypeNode(p) { }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "StringType"; }
 	virtual const DataType * getType() override;
@@ -619,7 +655,7 @@ private:
 
 class AssignExpNode : public ExpNode{
 public:
-	AssignExpNode(Position * p, LValNode * dstIn, ExpNode * srcIn)
+	AssignExpNode(const Position& p, LValNode * dstIn, ExpNode * srcIn)
 	: ExpNode(p), myDst(dstIn), mySrc(srcIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	virtual std::string nodeKind() override { return "AssignExp"; }
@@ -633,7 +669,7 @@ private:
 
 class ShortLitNode : public ExpNode{
 public:
-	ShortLitNode(Position * p, const int numIn)
+	ShortLitNode(const Position& p, const int numIn)
 	: ExpNode(p), myNum(numIn){ }
 	virtual void unparseNested(std::ostream& out) override{
 		unparse(out, 0);
@@ -649,7 +685,7 @@ private:
 
 class IntLitNode : public ExpNode{
 public:
-	IntLitNode(Position * p, const int numIn)
+	IntLitNode(const Position& p, const int numIn)
 	: ExpNode(p), myNum(numIn){ }
 	virtual void unparseNested(std::ostream& out) override{
 		unparse(out, 0);
@@ -665,8 +701,8 @@ private:
 
 class StrLitNode : public ExpNode{
 public:
-	StrLitNode(Position * p, const std::string strIn)
-	: ExpNode(p), myStr(strIn){ }
+	StrLitNode(const Position& p, const std::string strIn)
+	: ExpNode(p), myStr(strIn){ Arena::current()->adopt(this); }
 	virtual void unparseNested(std::ostream& out) override{
 		unparse(out, 0);
 	}
@@ -683,7 +719,7 @@ private:
 
 class TrueNode : public ExpNode{
 public:
-	TrueNode(Position * p): ExpNode(p){ }
+	TrueNode(const Position& p): ExpNode(p){ }
 	virtual void unparseNested(std::ostream& out) override{
 		unparse(out, 0);
 	}
@@ -696,7 +732,7 @@ public:
 
 class FalseNode : public ExpNode{
 public:
-	FalseNode(Position * p): ExpNode(p){ }
+	FalseNode(const Position& p): ExpNode(p){ }
 	virtual void unparseNested(std::ostream& out) override{
 		unparse(out, 0);
 	}
@@ -709,7 +745,7 @@ public:
 
 class CallStmtNode : public StmtNode{
 public:
-	CallStmtNode(Position * p, CallExpNode * expIn)
+	CallStmtNode(const Position& p, CallExpNode * expIn)
 	: StmtNode(p), myCallExp(expIn){ }
 	void unparse(std::ostream& out, int indent) override;
 	std::string nodeKind() override { return "CallStmt"; }
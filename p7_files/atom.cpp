@@ -0,0 +1,42 @@
+#include <unordered_map>
+#include <vector>
+#include "atom.hpp"
+#include "errors.hpp"
+
+namespace cminusminus{
+
+// The spellings are owned by the map (whose nodes never move), and
+// the vector maps an atom's id back to its spelling.
+struct AtomTable{
+	std::unordered_map<std::string, uint32_t> ids;
+	std::vector<const std::string *> names;
+};
+
+static AtomTable& table(){
+	static AtomTable theTable;
+	return theTable;
+}
+
+Atom Atom::intern(const char * str, size_t len){
+	AtomTable& tbl = table();
+	uint32_t nextID = static_cast<uint32_t>(tbl.names.size());
+	auto res = tbl.ids.emplace(std::string(str, len), nextID);
+	if (res.second){
+		tbl.names.push_back(&res.first->first);
+	}
+	return Atom(res.first->second);
+}
+
+size_t Atom::count(){
+	return table().names.size();
+}
+
+const std::string& Atom::str() const{
+	AtomTable& tbl = table();
+	if (myID >= tbl.names.size()){
+		throw new InternalError("Bad atom");
+	}
+	return *tbl.names[myID];
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef CMINUSMINUS_ATOM_HPP
+#define CMINUSMINUS_ATOM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace cminusminus{
+
+// An interned identifier. The scanner enters every distinct spelling
+// into a single process-wide table the first time it sees it, and an
+// Atom is just the index of that spelling in the table. Comparing and
+// hashing atoms is therefore an integer operation; the spelling itself
+// is only consulted when a name has to be printed.
+class Atom{
+public:
+	static Atom intern(const char * str, size_t len);
+	static Atom intern(const std::string& str){
+		return intern(str.data(), str.size());
+	}
+	//The number of distinct atoms interned so far. Every atom's
+	// id() is less than this.
+	static size_t count();
+
+	const std::string& str() const;
+	uint32_t id() const { return myID; }
+
+	bool operator==(Atom other) const { return myID == other.myID; }
+	bool operator!=(Atom other) const { return myID != other.myID; }
+	bool operator<(Atom other) const { return myID < other.myID; }
+private:
+	explicit Atom(uint32_t idIn) : myID(idIn){ }
+	uint32_t myID;
+};
+
+}
+
+namespace std{
+
+template <>
+struct hash<cminusminus::Atom>{
+	size_t operator()(cminusminus::Atom atom) const{
+		return atom.id();
+	}
+};
+
+}
+
+#endif
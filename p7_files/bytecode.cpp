@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <memory>
+#include "bytecode.hpp"
+#include "errors.hpp"
+#include "stdcminusminus.h"
+
+namespace cminusminus{
+
+// The file format is a header, then each table as a count and
+// its entries, all little-endian:
+//
+//   "CMMB", version, number of globals, highest argument number
+//   constants: 8 bytes each
+//   strings: constant index, length, bytes
+//   procedures: name length, name, entry, number of registers
+//   code: op, kinds, 2 unused bytes, 3 fields
+//
+// Nothing read is trusted. The constructor checks that every
+// field is in range for what it indexes, that jumps stay within
+// their procedure, and that each procedure ends in a LEAVE, so
+// the VM never checks any of it. Only pointers, which are
+// real addresses here as in the generated code, can go wrong.
+
+static const char BYTECODE_MAGIC[] = "CMMB";
+static const uint32_t BYTECODE_VERSION = 1;
+
+//Frames all come out of a block of this many quadwords, the
+// same 8MB as the usual native stack
+static const size_t VM_STACK_SLOTS = 1 << 20;
+
+//What each field of an instruction holds
+enum FieldUse { UNUSED, SRC, DST, TARGET, PROC, ARG };
+
+static void fieldUses(Bytecode::Op op, FieldUse uses[3]){
+	uses[0] = uses[1] = uses[2] = UNUSED;
+	switch (op){
+	case Bytecode::ADD: case Bytecode::SUB: case Bytecode::MULT:
+	case Bytecode::DIV: case Bytecode::EQ: case Bytecode::NEQ:
+	case Bytecode::LT: case Bytecode::GT: case Bytecode::LTE:
+	case Bytecode::GTE: case Bytecode::OR: case Bytecode::AND:
+		uses[0] = DST; uses[1] = SRC; uses[2] = SRC;
+		break;
+	case Bytecode::NEG: case Bytecode::NOT: case Bytecode::COPY:
+		uses[0] = DST; uses[1] = SRC;
+		break;
+	case Bytecode::ADDR:
+		//Only something that can be written has an address, and
+		// a DEREF's address is just the register, read with COPY
+		uses[0] = DST; uses[1] = DST;
+		break;
+	case Bytecode::GOTO:
+		uses[0] = TARGET;
+		break;
+	case Bytecode::IFZ:
+		uses[0] = TARGET; uses[1] = SRC;
+		break;
+	case Bytecode::IFZ_EQ: case Bytecode::IFZ_NEQ: case Bytecode::IFZ_LT:
+	case Bytecode::IFZ_GT: case Bytecode::IFZ_LTE: case Bytecode::IFZ_GTE:
+		uses[0] = TARGET; uses[1] = SRC; uses[2] = SRC;
+		break;
+	case Bytecode::PRINT_INT: case Bytecode::PRINT_BOOL:
+	case Bytecode::PRINT_STRING: case Bytecode::SET_RET:
+		uses[1] = SRC;
+		break;
+	case Bytecode::READ_INT: case Bytecode::READ_BOOL: case Bytecode::GET_RET:
+		uses[0] = DST;
+		break;
+	case Bytecode::SET_ARG:
+		uses[0] = ARG; uses[1] = SRC;
+		break;
+	case Bytecode::GET_ARG:
+		uses[0] = DST; uses[1] = ARG;
+		break;
+	case Bytecode::CALL: case Bytecode::TAIL_CALL:
+		uses[0] = PROC;
+		break;
+	case Bytecode::LEAVE: case Bytecode::NOP: case Bytecode::NUM_OPS:
+		break;
+	}
+}
+
+static InternalError * badBytecode(const std::string& why){
+	return new InternalError(("bad bytecode: " + why).c_str());
+}
+
+Bytecode::Bytecode(const std::vector<Proc>& procsIn,
+  const std::vector<Inst>& codeIn, const std::vector<int64_t>& constsIn,
+  const std::vector<String>& stringsIn, uint32_t numGlobalsIn,
+  uint32_t numArgsIn)
+: procs(procsIn), code(codeIn), consts(constsIn), strings(stringsIn),
+  numGlobals(numGlobalsIn), numArgs(numArgsIn), mainIdx(0){
+	validate();
+}
+
+void Bytecode::validate(){
+	bool foundMain = false;
+	for (size_t p = 0; p < procs.size(); p++){
+		if (procs[p].name == "main"){
+			mainIdx = p;
+			foundMain = true;
+		}
+	}
+	if (!foundMain){ throw badBytecode("no procedure main"); }
+	for (const String& str : strings){
+		if (str.constIdx >= consts.size()){
+			throw badBytecode("string outside the constant pool");
+		}
+	}
+
+	for (size_t p = 0; p < procs.size(); p++){
+		size_t begin = procs[p].entry;
+		size_t end = p + 1 < procs.size() ? procs[p + 1].entry : code.size();
+		if (p == 0 && begin != 0){
+			throw badBytecode("code before the first procedure");
+		}
+		if (begin >= end || end > code.size()){
+			throw badBytecode("procedure " + procs[p].name + " has no code");
+		}
+		if (code[end - 1].op != LEAVE){
+			throw badBytecode("procedure " + procs[p].name + " runs off its end");
+		}
+		for (size_t i = begin; i < end; i++){
+			const Inst& inst = code[i];
+			if (inst.op >= NUM_OPS){ throw badBytecode("unknown op"); }
+			FieldUse uses[3];
+			fieldUses(inst.op, uses);
+			for (size_t f = 0; f < 3; f++){
+				uint32_t val = inst.fields[f];
+				bool ok = true;
+				switch (uses[f]){
+				case UNUSED:
+					break;
+				case SRC: case DST:
+					switch (inst.kind(f)){
+					case REG: ok = val < procs[p].numRegs; break;
+					case DEREF:
+						ok = val < procs[p].numRegs && inst.op != ADDR;
+						break;
+					case GLOBAL: ok = val < numGlobals; break;
+					case CONST: ok = uses[f] == SRC && val < consts.size(); break;
+					}
+					break;
+				case TARGET: ok = val >= begin && val < end; break;
+				case PROC: ok = val < procs.size(); break;
+				case ARG: ok = val <= numArgs; break;
+				}
+				if (!ok){
+					throw badBytecode("field out of range in " + procs[p].name);
+				}
+			}
+		}
+	}
+}
+
+static void put(std::ostream& out, uint64_t val, size_t bytes){
+	for (size_t i = 0; i < bytes; i++){
+		out.put(static_cast<char>((val >> (8 * i)) & 0xff));
+	}
+}
+
+static uint64_t get(std::istream& in, size_t bytes){
+	uint64_t val = 0;
+	for (size_t i = 0; i < bytes; i++){
+		int c = in.get();
+		if (c == EOF){ throw badBytecode("file ends early"); }
+		val |= static_cast<uint64_t>(c) << (8 * i);
+	}
+	return val;
+}
+
+static uint32_t get32(std::istream& in){
+	return static_cast<uint32_t>(get(in, 4));
+}
+
+static void putString(std::ostream& out, const std::string& str){
+	put(out, str.size(), 4);
+	out.write(str.data(), static_cast<std::streamsize>(str.size()));
+}
+
+static std::string getString(std::istream& in){
+	uint32_t size = get32(in);
+	std::string res;
+	for (uint32_t i = 0; i < size; i++){
+		res += static_cast<char>(get(in, 1));
+	}
+	return res;
+}
+
+void Bytecode::write(std::ostream& out) const{
+	out.write(BYTECODE_MAGIC, 4);
+	put(out, BYTECODE_VERSION, 4);
+	put(out, numGlobals, 4);
+	put(out, numArgs, 4);
+	put(out, consts.size(), 4);
+	for (int64_t val : consts){ put(out, static_cast<uint64_t>(val), 8); }
+	put(out, strings.size(), 4);
+	for (const String& str : strings){
+		put(out, str.constIdx, 4);
+		putString(out, str.bytes);
+	}
+	put(out, procs.size(), 4);
+	for (const Proc& proc : procs){
+		putString(out, proc.name);
+		put(out, proc.entry, 4);
+		put(out, proc.numRegs, 4);
+	}
+	put(out, code.size(), 4);
+	for (const Inst& inst : code){
+		put(out, inst.op, 1);
+		put(out, inst.kinds, 1);
+		put(out, 0, 2);
+		for (uint32_t field : inst.fields){ put(out, field, 4); }
+	}
+}
+
+Bytecode Bytecode::read(std::istream& in){
+	char magic[4];
+	for (char& c : magic){ c = static_cast<char>(get(in, 1)); }
+	if (std::string(magic, 4) != BYTECODE_MAGIC){
+		throw badBytecode("not a bytecode file");
+	}
+	if (get32(in) != BYTECODE_VERSION){ throw badBytecode("wrong version"); }
+	uint32_t globalsIn = get32(in);
+	uint32_t argsIn = get32(in);
+	std::vector<int64_t> constsIn;
+	for (uint32_t i = get32(in); i > 0; i--){
+		constsIn.push_back(static_cast<int64_t>(get(in, 8)));
+	}
+	std::vector<String> stringsIn;
+	for (uint32_t i = get32(in); i > 0; i--){
+		uint32_t constIdx = get32(in);
+		stringsIn.push_back(String{constIdx, getString(in)});
+	}
+	std::vector<Proc> procsIn;
+	for (uint32_t i = get32(in); i > 0; i--){
+		std::string name = getString(in);
+		uint32_t entry = get32(in);
+		procsIn.push_back(Proc{name, entry, get32(in)});
+	}
+	std::vector<Inst> codeIn;
+	for (uint32_t i = get32(in); i > 0; i--){
+		Inst inst;
+		inst.op = static_cast<Op>(get(in, 1));
+		inst.kinds = static_cast<uint8_t>(get(in, 1));
+		inst.unused = static_cast<uint16_t>(get(in, 2));
+		for (uint32_t& field : inst.fields){ field = get32(in); }
+		codeIn.push_back(inst);
+	}
+	return Bytecode(procsIn, codeIn, constsIn, stringsIn, globalsIn, argsIn);
+}
+
+//Die the way the native program would have
+static void fault(int sig){
+	flushOutput();
+	std::raise(sig);
+	std::abort();
+}
+
+// The VM threads its code where the compiler allows it: each
+// handler ends by jumping straight to the next instruction's,
+// through a table of label addresses (a GNU extension), rather
+// than going back around a switch. Otherwise the same handlers
+// are the cases of a switch.
+#if defined(__GNUC__)
+#define VM_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+#ifdef VM_THREADED
+#define VM_CASE(op) L_##op:
+#define VM_NEXT inst = ip++; goto *handlers[inst->op]
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT continue
+#endif
+
+int64_t Bytecode::run() const{
+	std::vector<int64_t> pool(consts);
+	for (const String& str : strings){
+		pool[str.constIdx] = reinterpret_cast<int64_t>(str.bytes.c_str());
+	}
+	std::unique_ptr<int64_t[]> stack(new int64_t[VM_STACK_SLOTS]);
+	int64_t * stackEnd = stack.get() + VM_STACK_SLOTS;
+	std::vector<int64_t> globals(numGlobals, 0);
+	std::vector<int64_t> args(numArgs + 1, 0);
+
+	struct Return{
+		const Proc * proc;
+		const Inst * ip;
+		int64_t * fp;
+	};
+	std::vector<Return> calls;
+	const Proc * proc = &procs[mainIdx];
+	int64_t * fp = stack.get();
+	const Inst * ip = &code[proc->entry];
+	const Inst * inst = nullptr;
+	int64_t ret = 0;
+
+	//Where each kind of field indexes from; registers move with
+	// the frame
+	int64_t * bases[4] = {fp, globals.data(), pool.data(), fp};
+	auto enterFrame = [&](){
+		if (proc->numRegs > static_cast<size_t>(stackEnd - fp)){ fault(SIGSEGV); }
+		std::fill(fp, fp + proc->numRegs, 0);
+		bases[REG] = bases[DEREF] = fp;
+	};
+	auto at = [&](size_t field) -> int64_t * {
+		int64_t * slot = bases[inst->kind(field)] + inst->fields[field];
+		if (inst->kind(field) == DEREF){ slot = reinterpret_cast<int64_t *>(*slot); }
+		return slot;
+	};
+	//Arithmetic wraps, as it does in the generated code
+	auto wrap = [](uint64_t val){ return static_cast<int64_t>(val); };
+	auto bits = [&](size_t field){ return static_cast<uint64_t>(*at(field)); };
+	auto call = [&](size_t callee){
+		proc = &procs[callee];
+		ip = &code[proc->entry];
+		enterFrame();
+	};
+	enterFrame();
+
+#ifdef VM_THREADED
+	//In the order of Op
+	static void * const handlers[NUM_OPS] = {
+		&&L_ADD, &&L_SUB, &&L_MULT, &&L_DIV, &&L_EQ, &&L_NEQ, &&L_LT, &&L_GT,
+		&&L_LTE, &&L_GTE, &&L_OR, &&L_AND, &&L_NEG, &&L_NOT, &&L_COPY,
+		&&L_ADDR, &&L_GOTO, &&L_IFZ, &&L_IFZ_EQ, &&L_IFZ_NEQ, &&L_IFZ_LT,
+		&&L_IFZ_GT, &&L_IFZ_LTE, &&L_IFZ_GTE, &&L_PRINT_INT, &&L_PRINT_BOOL,
+		&&L_PRINT_STRING, &&L_READ_INT, &&L_READ_BOOL, &&L_SET_ARG,
+		&&L_GET_ARG, &&L_CALL, &&L_TAIL_CALL, &&L_SET_RET, &&L_GET_RET,
+		&&L_LEAVE, &&L_NOP
+	};
+	VM_NEXT;
+#else
+	while (true){
+	inst = ip++;
+	switch (inst->op){
+#endif
+	VM_CASE(ADD) *at(0) = wrap(bits(1) + bits(2)); VM_NEXT;
+	VM_CASE(SUB) *at(0) = wrap(bits(1) - bits(2)); VM_NEXT;
+	VM_CASE(MULT) *at(0) = wrap(bits(1) * bits(2)); VM_NEXT;
+	VM_CASE(DIV){
+		int64_t a = *at(1);
+		int64_t b = *at(2);
+		if (b == 0 || (a == INT64_MIN && b == -1)){ fault(SIGFPE); }
+		*at(0) = a / b;
+		VM_NEXT;
+	}
+	VM_CASE(EQ) *at(0) = *at(1) == *at(2); VM_NEXT;
+	VM_CASE(NEQ) *at(0) = *at(1) != *at(2); VM_NEXT;
+	VM_CASE(LT) *at(0) = *at(1) < *at(2); VM_NEXT;
+	VM_CASE(GT) *at(0) = *at(1) > *at(2); VM_NEXT;
+	VM_CASE(LTE) *at(0) = *at(1) <= *at(2); VM_NEXT;
+	VM_CASE(GTE) *at(0) = *at(1) >= *at(2); VM_NEXT;
+	VM_CASE(OR) *at(0) = *at(1) | *at(2); VM_NEXT;
+	VM_CASE(AND) *at(0) = *at(1) & *at(2); VM_NEXT;
+	VM_CASE(NEG) *at(0) = wrap(0 - bits(1)); VM_NEXT;
+	//Booleans are always 0 or 1
+	VM_CASE(NOT) *at(0) = *at(1) ^ 1; VM_NEXT;
+	VM_CASE(COPY) *at(0) = *at(1); VM_NEXT;
+	VM_CASE(ADDR) *at(0) = reinterpret_cast<int64_t>(at(1)); VM_NEXT;
+	VM_CASE(GOTO) ip = &code[inst->fields[0]]; VM_NEXT;
+	VM_CASE(IFZ)
+		if (*at(1) == 0){ ip = &code[inst->fields[0]]; }
+		VM_NEXT;
+	VM_CASE(IFZ_EQ)
+		if (!(*at(1) == *at(2))){ ip = &code[inst->fields[0]]; }
+		VM_NEXT;
+	VM_CASE(IFZ_NEQ)
+		if (!(*at(1) != *at(2))){ ip = &code[inst->fields[0]]; }
+		VM_NEXT;
+	VM_CASE(IFZ_LT)
+		if (!(*at(1) < *at(2))){ ip = &code[inst->fields[0]]; }
+		VM_NEXT;
+	VM_CASE(IFZ_GT)
+		if (!(*at(1) > *at(2))){ ip = &code[inst->fields[0]]; }
+		VM_NEXT;
+	VM_CASE(IFZ_LTE)
+		if (!(*at(1) <= *at(2))){ ip = &code[inst->fields[0]]; }
+		VM_NEXT;
+	VM_CASE(IFZ_GTE)
+		if (!(*at(1) >= *at(2))){ ip = &code[inst->fields[0]]; }
+		VM_NEXT;
+	VM_CASE(PRINT_INT) printInt(*at(1)); VM_NEXT;
+	VM_CASE(PRINT_BOOL) printBool(*at(1)); VM_NEXT;
+	VM_CASE(PRINT_STRING)
+		printString(reinterpret_cast<const char *>(*at(1)));
+		VM_NEXT;
+	VM_CASE(READ_INT) *at(0) = getInt(); VM_NEXT;
+	VM_CASE(READ_BOOL) *at(0) = getBool(); VM_NEXT;
+	VM_CASE(SET_ARG) args[inst->fields[0]] = *at(1); VM_NEXT;
+	VM_CASE(GET_ARG) *at(0) = args[inst->fields[1]]; VM_NEXT;
+	VM_CASE(CALL)
+		calls.push_back(Return{proc, ip, fp});
+		fp += proc->numRegs;
+		call(inst->fields[0]);
+		VM_NEXT;
+	//The callee takes over the frame, and returns to wherever
+	// this procedure would have
+	VM_CASE(TAIL_CALL) call(inst->fields[0]); VM_NEXT;
+	VM_CASE(SET_RET) ret = *at(1); VM_NEXT;
+	VM_CASE(GET_RET) *at(0) = ret; VM_NEXT;
+	VM_CASE(LEAVE)
+		if (calls.empty()){
+			flushOutput();
+			return ret;
+		}
+		proc = calls.back().proc;
+		ip = calls.back().ip;
+		fp = calls.back().fp;
+		bases[REG] = bases[DEREF] = fp;
+		calls.pop_back();
+		VM_NEXT;
+	VM_CASE(NOP) VM_NEXT;
+#ifndef VM_THREADED
+	case NUM_OPS: break;
+	}
+	}
+#endif
+}
+
+#undef VM_CASE
+#undef VM_NEXT
+#ifdef VM_THREADED
+#undef VM_THREADED
+#pragma GCC diagnostic pop
+#endif
+
+}
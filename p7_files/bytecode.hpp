@@ -0,0 +1,95 @@
+#ifndef CMINUSMINUS_BYTECODE_HPP
+#define CMINUSMINUS_BYTECODE_HPP
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cminusminus{
+
+//A program lowered to fixed-width instructions, for the VM to
+// run. Each procedure has a file of quadword registers, one per
+// operand it uses, that lives in its frame. Literals are in a
+// constant pool, string literals included, whose slots come to
+// hold the address of their bytes once the program is loaded.
+// A program can be written out and read back, so that running
+// it again needs none of the front end.
+class Bytecode{
+public:
+	//Each instruction has up to three fields. Field 0 is the
+	// destination (or a jump target, procedure or argument
+	// number), and fields 1 and 2 are the sources.
+	enum Op : uint8_t {
+		ADD, SUB, MULT, DIV, EQ, NEQ, LT, GT, LTE, GTE, OR, AND,
+		NEG, NOT,
+		//Copy a value, or the address of field 1
+		COPY, ADDR,
+		//Jump to field 0: always, when field 1 is zero, or unless
+		// field 1 compares to field 2 as named
+		GOTO, IFZ, IFZ_EQ, IFZ_NEQ, IFZ_LT, IFZ_GT, IFZ_LTE, IFZ_GTE,
+		PRINT_INT, PRINT_BOOL, PRINT_STRING, READ_INT, READ_BOOL,
+		//Set argument number field 0 to field 1, and set field 0
+		// to argument number field 1
+		SET_ARG, GET_ARG,
+		//Call procedure field 0
+		CALL, TAIL_CALL,
+		SET_RET, GET_RET, LEAVE, NOP,
+		NUM_OPS
+	};
+	//Where an operand field points: into the running procedure's
+	// registers, the globals, or the constant pool, or through
+	// the address held in a register
+	enum Kind : uint8_t { REG, GLOBAL, CONST, DEREF };
+
+	struct Inst{
+		Op op;
+		//Two bits for each field
+		uint8_t kinds;
+		uint16_t unused;
+		uint32_t fields[3];
+
+		Kind kind(size_t field) const {
+			return static_cast<Kind>((kinds >> (2 * field)) & 3);
+		}
+		void setKind(size_t field, Kind kind){
+			kinds = static_cast<uint8_t>(kinds | (kind << (2 * field)));
+		}
+	};
+	//A procedure's code runs from its entry to the next one's
+	struct Proc{
+		std::string name;
+		uint32_t entry;
+		uint32_t numRegs;
+	};
+	struct String{
+		uint32_t constIdx;
+		std::string bytes;
+	};
+
+	//Throws an InternalError if the parts do not make a program
+	// the VM can run safely
+	Bytecode(const std::vector<Proc>& procsIn, const std::vector<Inst>& codeIn,
+		const std::vector<int64_t>& constsIn,
+		const std::vector<String>& stringsIn,
+		uint32_t numGlobalsIn, uint32_t numArgsIn);
+	static Bytecode read(std::istream& in);
+	void write(std::ostream& out) const;
+	//Run main, returning what it returns
+	int64_t run() const;
+private:
+	void validate();
+
+	std::vector<Proc> procs;
+	std::vector<Inst> code;
+	std::vector<int64_t> consts;
+	std::vector<String> strings;
+	uint32_t numGlobals;
+	uint32_t numArgs;
+	size_t mainIdx;
+};
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include "dataflow.hpp"
+
+namespace cminusminus{
+
+Liveness::Liveness(const ControlFlowGraph * cfg,
+  const HashMap<Opd *, size_t>& opdIdx){
+	const std::vector<Quad *>& quads = cfg->getQuads();
+	const std::vector<BasicBlock>& blocks = cfg->getBlocks();
+	size_t numBlocks = blocks.size();
+	size_t numOpds = opdIdx.size();
+	std::vector<BitSet> gen(numBlocks, BitSet(numOpds));
+	std::vector<BitSet> kill(numBlocks, BitSet(numOpds));
+	in.assign(numBlocks, BitSet(numOpds));
+	out.assign(numBlocks, BitSet(numOpds));
+
+	for (size_t b = 0; b < numBlocks; b++){
+		const BasicBlock& block = blocks[b];
+		for (size_t i = block.getFirst(); i <= block.getLast(); i++){
+			for (Opd * use : quads[i]->getUses()){
+				auto found = opdIdx.find(use);
+				if (found == opdIdx.end()){ continue; }
+				if (!kill[b].get(found->second)){
+					gen[b].set(found->second);
+				}
+			}
+			for (Opd * def : quads[i]->getDefs()){
+				auto found = opdIdx.find(def);
+				if (found != opdIdx.end()){
+					kill[b].set(found->second);
+				}
+			}
+		}
+		in[b].merge(gen[b]);
+	}
+
+	//Visiting the blocks in postorder lets most facts settle
+	// in a single pass. Unreachable blocks are visited too, so
+	// that code in them still sees its operands as live.
+	std::vector<size_t> order(cfg->reversePostorder().rbegin(),
+		cfg->reversePostorder().rend());
+	for (size_t b = 0; b < numBlocks; b++){
+		if (!blocks[b].isReachable()){ order.push_back(b); }
+	}
+	bool changed = true;
+	while (changed){
+		changed = false;
+		for (size_t b : order){
+			for (size_t succ : blocks[b].getSuccs()){
+				out[b].merge(in[succ]);
+			}
+			if (in[b].mergeMinus(out[b], kill[b])){
+				changed = true;
+			}
+		}
+	}
+}
+
+}
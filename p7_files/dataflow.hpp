@@ -0,0 +1,70 @@
+#ifndef CMINUSMINUS_DATAFLOW_HPP
+#define CMINUSMINUS_DATAFLOW_HPP
+
+#include <cstdint>
+#include <vector>
+#include "3ac.hpp"
+
+namespace cminusminus{
+
+//A fixed-size set of small integers, one bit each
+class BitSet{
+public:
+	BitSet(size_t size) : words((size + 63) / 64, 0){ }
+	void set(size_t i){ words[i / 64] |= bit(i); }
+	void reset(size_t i){ words[i / 64] &= ~bit(i); }
+	bool get(size_t i) const { return (words[i / 64] & bit(i)) != 0; }
+	//Call f on each member, in increasing order
+	template <typename F>
+	void forEach(F f) const{
+		for (size_t w = 0; w < words.size(); w++){
+			uint64_t rest = words[w];
+			while (rest != 0){
+				size_t low = static_cast<size_t>(__builtin_ctzll(rest));
+				f(w * 64 + low);
+				rest &= rest - 1;
+			}
+		}
+	}
+	//this |= other & ~mask. Returns whether this changed.
+	bool mergeMinus(const BitSet& other, const BitSet& mask){
+		bool changed = false;
+		for (size_t w = 0; w < words.size(); w++){
+			uint64_t next = words[w] | (other.words[w] & ~mask.words[w]);
+			changed = changed || next != words[w];
+			words[w] = next;
+		}
+		return changed;
+	}
+	bool merge(const BitSet& other){
+		bool changed = false;
+		for (size_t w = 0; w < words.size(); w++){
+			uint64_t next = words[w] | other.words[w];
+			changed = changed || next != words[w];
+			words[w] = next;
+		}
+		return changed;
+	}
+private:
+	static uint64_t bit(size_t i){ return uint64_t(1) << (i % 64); }
+	std::vector<uint64_t> words;
+};
+
+//Which operands are live on entry to and exit from each block
+// of a CFG. Only the operands numbered in opdIdx are tracked.
+// A phi's arguments are treated as ordinary uses at the top of
+// its block.
+class Liveness{
+public:
+	Liveness(const ControlFlowGraph * cfg,
+		const HashMap<Opd *, size_t>& opdIdx);
+	const BitSet& liveIn(size_t block) const { return in[block]; }
+	const BitSet& liveOut(size_t block) const { return out[block]; }
+private:
+	std::vector<BitSet> in;
+	std::vector<BitSet> out;
+};
+
+}
+
+#endif
@@ -51,17 +51,17 @@ private:
 class Report{
 public:
 	static void fatal(
-		Position * pos,
+		const Position& pos,
 		const char * msg
 	){
 		std::cerr << "FATAL " 
-		<< pos->span()
+		<< pos.span()
 		<< ": " 
 		<< msg  << std::endl;
 	}
 
 	static void fatal(
-		Position * pos,
+		const Position& pos,
 		const std::string msg
 	){
 		fatal(pos,msg.c_str());
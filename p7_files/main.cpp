@@ -7,6 +7,8 @@
 #include "scanner.hpp"
 #include "name_analysis.hpp"
 #include "type_analysis.hpp"
+#include "pipeline.hpp"
+#include "bytecode.hpp"
 
 using namespace cminusminus;
 
@@ -19,6 +21,21 @@ static void usageAndDie(){
 	<< " [-c]: Do type checking\n"
 	<< " [-a <3ACFile>]: Output program as 3-address code\n"
 	<< " [-o <ASMFile>]: Output x64 assembly to <ASMFile>\n"
+	<< " [-e <ObjFile>]: Output an x64 ELF object file to <ObjFile>,\n"
+	<< "   ready to link without running the assembler\n"
+	<< " [-j]: Compile the program into memory and run it, exiting\n"
+	<< "   with what its main returns\n"
+	<< " [-r]: Run the program by interpreting its 3AC, exiting\n"
+	<< "   with what its main returns\n"
+	<< " [-v]: Run the program's bytecode in the VM, exiting with\n"
+	<< "   what its main returns. Only one of -j, -r and -v can be given\n"
+	<< " [-b <BytecodeFile>]: Output the program's bytecode\n"
+	<< " [-x]: The input file is bytecode output by -b; run it in\n"
+	<< "   the VM, exiting with what its main returns\n"
+	<< " [-O<level>]: Optimization level for -o, -e and -j (0 or 1).\n"
+	<< "   -O1 allocates registers and shares stack slots\n"
+	<< " [-i <size>]: At -O1, inline calls to procedures of at most\n"
+	<< "   <size> quads (default 16; 0 turns inlining off)\n"
 	;
 	std::cout << std::flush;
 	std::cerr << std::flush;
@@ -37,6 +54,8 @@ static void writeTokenStream(const char * inPath, const char * outPath){
 		throw new cminusminus::InternalError(msg.c_str());
 	}
 
+	Arena arena;
+	LineMap lines;
 	Scanner scanner(&inStream);
 	if (strcmp(outPath, "--") == 0){
 		scanner.outputTokens(std::cout);
@@ -52,27 +71,6 @@ static void writeTokenStream(const char * inPath, const char * outPath){
 	}
 }
 
-static cminusminus::ProgramNode * parse(const char * inFile){
-	std::ifstream inStream(inFile);
-	if (!inStream.good()){
-		std::string msg = "Bad input stream ";
-		msg += inFile;
-		throw new InternalError(msg.c_str());
-	}
-
-	//This pointer will be set to the root of the
-	// AST after parsing
-	cminusminus::ProgramNode * root = nullptr;
-
-	cminusminus::Scanner scanner(&inStream);
-	cminusminus::Parser parser(scanner, &root);
-
-	int errCode = parser.parse();
-	if (errCode != 0){ return nullptr; }
-
-	return root;
-}
-
 static void outputAST(ASTNode * ast, const char * outPath){
 	if (strcmp(outPath, "--") == 0){
 		ast->unparse(std::cout, 0);
@@ -87,30 +85,6 @@ static void outputAST(ASTNode * ast, const char * outPath){
 	}
 }
 
-static cminusminus::NameAnalysis * doNameAnalysis(const char * inputPath){
-	cminusminus::ProgramNode * ast = parse(inputPath);
-	if (ast == nullptr){ return nullptr; }
-	
-	return cminusminus::NameAnalysis::build(ast);
-}
-
-static bool doUnparsing(const char * inputPath, const char * outPath){
-	cminusminus::ProgramNode * ast = parse(inputPath);
-	if (ast == nullptr){ 
-		std::cerr << "No AST built\n";
-		return false;
-	}
-
-	outputAST(ast, outPath);
-	return true;
-}
-
-static cminusminus::TypeAnalysis * doTypeAnalysis(const char * inputPath){
-	cminusminus::NameAnalysis * nameAnalysis = doNameAnalysis(inputPath);
-	if (nameAnalysis == nullptr){ return nullptr; }
-	return TypeAnalysis::build(nameAnalysis);
-}
-
 static void write3AC(cminusminus::IRProgram * prog, const char * outPath){
 	if (outPath == nullptr){
 		throw new InternalError("Null 3AC flat file given");
@@ -126,28 +100,63 @@ static void write3AC(cminusminus::IRProgram * prog, const char * outPath){
 }
 
 
-static IRProgram * do3AC(const char * inputPath){
-	cminusminus::TypeAnalysis * typeAnalysis = doTypeAnalysis(inputPath);
-	if (typeAnalysis == nullptr){ return nullptr; }
-	
-	IRProgram * prog = typeAnalysis->ast->to3AC(typeAnalysis);
-	return prog;
-}
-
-static int writeX64(cminusminus::IRProgram * prog, const char * outPath){
+static int writeX64(cminusminus::IRProgram * prog, const char * outPath,
+  int optLevel){
 	if (outPath == nullptr){
 		throw new InternalError("Null codegen file given");
 	}
+	bool optimize = optLevel >= 1;
 	if (strcmp(outPath, "--") == 0){
-		prog->toX64(std::cout);
+		prog->toX64(std::cout, optimize);
 	} else {
 		std::ofstream outStream(outPath);
-		prog->toX64(outStream);
+		prog->toX64(outStream, optimize);
+		outStream.close();
+	}
+	return 0;
+}
+
+static int writeElf(cminusminus::IRProgram * prog, const char * outPath,
+  int optLevel){
+	if (outPath == nullptr){
+		throw new InternalError("Null object file given");
+	}
+	bool optimize = optLevel >= 1;
+	if (strcmp(outPath, "--") == 0){
+		prog->toElf(std::cout, optimize);
+	} else {
+		std::ofstream outStream(outPath, std::ios::binary);
+		prog->toElf(outStream, optimize);
 		outStream.close();
 	}
 	return 0;
 }
 
+static int writeBytecode(cminusminus::IRProgram * prog, const char * outPath){
+	if (outPath == nullptr){
+		throw new InternalError("Null bytecode file given");
+	}
+	if (strcmp(outPath, "--") == 0){
+		prog->toBytecode().write(std::cout);
+	} else {
+		std::ofstream outStream(outPath, std::ios::binary);
+		prog->toBytecode().write(outStream);
+		outStream.close();
+	}
+	return 0;
+}
+
+static int runBytecode(const char * inPath){
+	std::ifstream inStream(inPath, std::ios::binary);
+	if (!inStream.good()){
+		std::string msg = "Bad input stream";
+		msg += inPath;
+		throw new InternalError(msg.c_str());
+	}
+	cminusminus::Bytecode code = cminusminus::Bytecode::read(inStream);
+	return static_cast<int>(code.run());
+}
+
 int 
 main( const int argc, const char **argv )
 {
@@ -167,6 +176,14 @@ main( const int argc, const char **argv )
 	bool checkTypes = false;
 	const char * threeACFile = NULL;
 	const char * asmFile = NULL;
+	const char * objFile = NULL;
+	bool run = false;
+	bool interpret = false;
+	bool runVM = false;
+	const char * bytecodeFile = NULL;
+	bool runBytecodeIn = false;
+	int optLevel = 0;
+	size_t inlineSize = cminusminus::Pipeline::DEFAULT_INLINE_SIZE;
 
 	bool useful = false;
 	int i = 1;
@@ -201,6 +218,48 @@ main( const int argc, const char **argv )
 				if (i >= argc){ usageAndDie(); }
 				asmFile = argv[i];
 				useful = true;
+			} else if (argv[i][1] == 'e'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				objFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'j'){
+				run = true;
+				useful = true;
+			} else if (argv[i][1] == 'r'){
+				interpret = true;
+				useful = true;
+			} else if (argv[i][1] == 'v'){
+				runVM = true;
+				useful = true;
+			} else if (argv[i][1] == 'b'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				bytecodeFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'x'){
+				runBytecodeIn = true;
+			} else if (argv[i][1] == 'i'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				char * end;
+				long size = strtol(argv[i], &end, 10);
+				if (*end != '\0' || size < 0){
+					std::cerr << "Bad inline size: ";
+					std::cerr << argv[i] << std::endl;
+					usageAndDie();
+				}
+				inlineSize = static_cast<size_t>(size);
+			} else if (argv[i][1] == 'O'){
+				if (strcmp(argv[i], "-O0") == 0){
+					optLevel = 0;
+				} else if (strcmp(argv[i], "-O1") == 0){
+					optLevel = 1;
+				} else {
+					std::cerr << "Unknown optimization level: ";
+					std::cerr << argv[i] << std::endl;
+					usageAndDie();
+				}
 			} else {
 				std::cerr << "Unrecognized argument: ";
 				std::cerr << argv[i] << std::endl;
@@ -219,26 +278,43 @@ main( const int argc, const char **argv )
 	if (inFile == NULL){
 		usageAndDie();
 	}
-	if (!useful){
+	if (runBytecodeIn && useful){
+		std::cerr << "Nothing else can be done with bytecode\n";
+		usageAndDie();
+	} else if (!runBytecodeIn && !useful){
 		std::cerr << "Hey, you didn't tell cminusminusc to do anything!\n";
 		usageAndDie();
 	}
+	//Each of these runs the program to its exit, so only one can
+	if ((run && interpret) || (run && runVM) || (interpret && runVM)){
+		std::cerr << "Only one of -j, -r and -v can run the program\n";
+		usageAndDie();
+	}
 
 	try {
+		if (runBytecodeIn){
+			return runBytecode(inFile);
+		}
 		if (tokensFile != nullptr){
 			writeTokenStream(inFile, tokensFile);
 		}
+		cminusminus::Pipeline pipeline(inFile, optLevel, inlineSize);
 		if (checkParse){
-			if (!parse(inFile)){
+			if (!pipeline.ast()){
 				std::cerr << "Parse failed" << std::endl;
 			}
 		}
 		if (unparseFile != nullptr){
-			doUnparsing(inFile, unparseFile);
+			cminusminus::ProgramNode * ast = pipeline.ast();
+			if (ast == nullptr){
+				std::cerr << "No AST built\n";
+			} else {
+				outputAST(ast, unparseFile);
+			}
 		}
 		if (namesFile){
 			cminusminus::NameAnalysis * na;
-			na = doNameAnalysis(inFile);
+			na = pipeline.nameAnalysis();
 			if (na == nullptr){
 				std::cerr << "Name Analysis Failed\n";
 				return 1;
@@ -247,21 +323,49 @@ main( const int argc, const char **argv )
 		}
 		if (checkTypes){
 			cminusminus::TypeAnalysis * ta;
-			ta = doTypeAnalysis(inFile);
+			ta = pipeline.typeAnalysis();
 			if (ta == nullptr){
 				std::cerr << "Type Analysis Failed\n";
 				return 1;
 			}
 		}
 		if (threeACFile != nullptr){
-			auto prog = do3AC(inFile);
+			auto prog = pipeline.ir();
 			if (prog == nullptr){ return 1; }
 			write3AC(prog, threeACFile);
 		}
 		if (asmFile != nullptr){
-			auto prog = do3AC(inFile);
+			auto prog = pipeline.ir();
+			if (prog == nullptr){ return 1; }
+			writeX64(prog, asmFile, optLevel);
+		}
+		if (objFile != nullptr){
+			auto prog = pipeline.ir();
+			if (prog == nullptr){ return 1; }
+			writeElf(prog, objFile, optLevel);
+		}
+		if (bytecodeFile != nullptr){
+			auto prog = pipeline.ir();
+			if (prog == nullptr){ return 1; }
+			writeBytecode(prog, bytecodeFile);
+		}
+		if (run){
+			auto prog = pipeline.ir();
+			if (prog == nullptr){ return 1; }
+			std::cout << std::flush;
+			return prog->run(optLevel >= 1);
+		}
+		if (interpret){
+			auto prog = pipeline.ir();
+			if (prog == nullptr){ return 1; }
+			std::cout << std::flush;
+			return prog->interpret();
+		}
+		if (runVM){
+			auto prog = pipeline.ir();
 			if (prog == nullptr){ return 1; }
-			writeX64(prog, asmFile);
+			std::cout << std::flush;
+			return prog->runVM();
 		}
 	} catch (cminusminus::ToDoError * e){
 		std::cerr << "ToDoError: " << e->msg() << "\n";
@@ -79,7 +79,7 @@ bool VarDeclNode::nameAnalysis(SymbolTable * symTab){
 	bool checkType = myType->nameAnalysis(symTab);
 
 	const DataType * dataType = getTypeNode()->getType();
-	std::string varName = ID()->getName();
+	Atom varName = ID()->getAtom();
 
 	bool validType = true;
 	if (dataType == nullptr){
@@ -106,46 +106,47 @@ bool VarDeclNode::nameAnalysis(SymbolTable * symTab){
 }
 
 bool FnDeclNode::nameAnalysis(SymbolTable * symTab){
-	std::string fnName = this->ID()->getName();
+	Atom fnName = this->ID()->getAtom();
 
 	bool validRet = myRetType->nameAnalysis(symTab);
 
-	// hold onto the scope of the function.
-	ScopeTable * atFnScope = symTab->getCurrentScope();
-	//Enter a new scope for "within" this function.
-	ScopeTable * inFnScope = symTab->enterScope();
-
 	/*Note that we check for a clash of the function 
 	  name in it's declared scope (e.g. a global
-	  scope for a global function)
+	  scope for a global function), so this has to
+	  happen before entering the function's own scope
 	*/
 	bool validName = true;
-	if (atFnScope->clash(fnName)){
+	if (symTab->clash(fnName)){
 		NameErr::multiDecl(ID()->pos()); 
 		validName = false;
 	}
 
-	bool validFormals = true;
 	std::list<const DataType *> * formalTypes = 
 		new std::list<const DataType *>();
 	for (auto formal : *(this->myFormals)){
-		validFormals = formal->nameAnalysis(symTab) && validFormals;
 		TypeNode * typeNode = formal->getTypeNode();
 		const DataType * formalType = typeNode->getType();
 		formalTypes->push_back(formalType);
 	}
 
-
 	const DataType * retType = this->getRetTypeNode()->getType();
 	FnType * dataType = new FnType(formalTypes, retType);
 	//Make sure the fnSymbol is in the symbol table before 
 	// analyzing the body, to allow for recursive calls
 	if (validName){
-		atFnScope->addFn(fnName, dataType);
-		SemSymbol * sym = atFnScope->lookup(fnName);
+		symTab->addFn(fnName, dataType);
+		SemSymbol * sym = symTab->find(fnName);
 		this->myID->attachSymbol(sym);
 	}
 
+	//Enter a new scope for "within" this function.
+	symTab->enterScope();
+
+	bool validFormals = true;
+	for (auto formal : *(this->myFormals)){
+		validFormals = formal->nameAnalysis(symTab) && validFormals;
+	}
+
 	bool validBody = true;
 	for (auto stmt : *myBody){
 		validBody = stmt->nameAnalysis(symTab) && validBody;
@@ -230,8 +231,7 @@ bool FalseNode::nameAnalysis(SymbolTable * symTab){
 }
 
 bool IDNode::nameAnalysis(SymbolTable* symTab){
-	std::string myName = this->getName();
-	SemSymbol * sym = symTab->find(myName);
+	SemSymbol * sym = symTab->find(this->getAtom());
 	if (sym == nullptr){
 		return NameErr::undeclID(pos());
 	}
@@ -0,0 +1,90 @@
+#!/bin/bash
+# Run one test program through every way cmmc can run it, and check
+# that each prints the same output and exits with the same code as
+# the unoptimized assembly. Usage: ./difftest.sh <name>, for
+# <name>.cmm with input <name>.in, from this directory.
+
+NAME=$1
+CMMC=../cmmc
+LIBLINUX="-dynamic-linker /lib64/ld-linux-x86-64.so.2"
+CRT=/usr/lib/x86_64-linux-gnu
+FAIL=0
+
+# link <object> <runtime> <program>
+link(){
+	ld $LIBLINUX $CRT/crt1.o $CRT/crti.o -lc $1 $2 $CRT/crtn.o -o $3 \
+		2> /dev/null
+}
+
+# finish <tag> <status>: record the exit code, and compare the run
+# with the baseline
+finish(){
+	echo $2 > $NAME.$1.code
+	if [ $1 = base ]; then
+		return
+	fi
+	if ! cmp -s $NAME.base.out $NAME.$1.out; then
+		echo "  $1: output differs"
+		FAIL=1
+	fi
+	if ! cmp -s $NAME.base.code $NAME.$1.code; then
+		echo "  $1: exit code $(cat $NAME.$1.code)," \
+			"expected $(cat $NAME.base.code)"
+		FAIL=1
+	fi
+}
+
+# native <tag> <runtime> <cmmc flags...>: build through the assembler
+native(){
+	local tag=$1 runtime=$2
+	shift 2
+	timeout 60 $CMMC $NAME.cmm "$@" -o $NAME.$tag.s \
+		&& as -o $NAME.$tag.o $NAME.$tag.s \
+		&& link $NAME.$tag.o $runtime $NAME.$tag.prog \
+		&& timeout 60 ./$NAME.$tag.prog < $NAME.in > $NAME.$tag.out
+	finish $tag $?
+}
+
+# elf <tag> <cmmc flags...>: build an object file with -e
+elf(){
+	local tag=$1
+	shift
+	timeout 60 $CMMC $NAME.cmm "$@" -e $NAME.$tag.o \
+		&& link $NAME.$tag.o ../stdcminusminus.o $NAME.$tag.prog \
+		&& timeout 60 ./$NAME.$tag.prog < $NAME.in > $NAME.$tag.out
+	finish $tag $?
+}
+
+# inproc <tag> <cmmc flags...>: run inside cmmc
+inproc(){
+	local tag=$1
+	shift
+	timeout 60 $CMMC $NAME.cmm "$@" < $NAME.in > $NAME.$tag.out
+	finish $tag $?
+}
+
+# bytecode <tag> <cmmc flags...>: write bytecode, then run it
+bytecode(){
+	local tag=$1
+	shift
+	timeout 60 $CMMC $NAME.cmm "$@" -b $NAME.$tag.cmmb \
+		&& timeout 60 $CMMC $NAME.$tag.cmmb -x < $NAME.in > $NAME.$tag.out
+	finish $tag $?
+}
+
+native base ../stdcminusminus.o -O0
+native O1 ../stdcminusminus.o -O1
+native O1noinline ../stdcminusminus.o -O1 -i 0
+native O0buf ../stdcminusminus_buffered.o -O0
+native O1buf ../stdcminusminus_buffered.o -O1
+elf elfO0 -O0
+elf elfO1 -O1
+inproc jitO0 -O0 -j
+inproc jitO1 -O1 -j
+inproc interpO0 -O0 -r
+inproc interpO1 -O1 -r
+inproc vmO0 -O0 -v
+inproc vmO1 -O1 -v
+bytecode bcO0 -O0
+bytecode bcO1 -O1
+exit $FAIL
@@ -0,0 +1,77 @@
+#include <fstream>
+#include "pipeline.hpp"
+#include "scanner.hpp"
+
+namespace cminusminus{
+
+Pipeline::Pipeline(const char * inPathIn, int optLevelIn,
+  size_t inlineSizeIn)
+: inPath(inPathIn), optLevel(optLevelIn), inlineSize(inlineSizeIn){ }
+
+ProgramNode * Pipeline::parse(){
+	std::ifstream inStream(inPath);
+	if (!inStream.good()){
+		std::string msg = "Bad input stream ";
+		msg += inPath;
+		throw new InternalError(msg.c_str());
+	}
+
+	//This pointer will be set to the root of the
+	// AST after parsing
+	ProgramNode * root = nullptr;
+
+	Scanner scanner(&inStream);
+	Parser parser(scanner, &root);
+
+	int errCode = parser.parse();
+	if (errCode != 0){ return nullptr; }
+
+	return root;
+}
+
+ProgramNode * Pipeline::ast(){
+	if (!parsed){
+		parsed = true;
+		myAST = parse();
+	}
+	return myAST;
+}
+
+NameAnalysis * Pipeline::nameAnalysis(){
+	if (!named){
+		named = true;
+		ProgramNode * root = ast();
+		if (root != nullptr){
+			myNameAnalysis = NameAnalysis::build(root);
+		}
+	}
+	return myNameAnalysis;
+}
+
+TypeAnalysis * Pipeline::typeAnalysis(){
+	if (!typed){
+		typed = true;
+		NameAnalysis * na = nameAnalysis();
+		if (na != nullptr){
+			myTypeAnalysis = TypeAnalysis::build(na);
+		}
+	}
+	return myTypeAnalysis;
+}
+
+IRProgram * Pipeline::ir(){
+	if (!lowered){
+		lowered = true;
+		TypeAnalysis * ta = typeAnalysis();
+		if (ta != nullptr){
+			myIR = ta->ast->to3AC(ta);
+			if (optLevel >= 1){
+				myIR->inlineCalls(inlineSize);
+				myIR->optimize();
+			}
+		}
+	}
+	return myIR;
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef CMINUSMINUS_PIPELINE_HPP
+#define CMINUSMINUS_PIPELINE_HPP
+
+#include "arena.hpp"
+#include "ast.hpp"
+#include "name_analysis.hpp"
+#include "type_analysis.hpp"
+
+namespace cminusminus{
+
+// A Pipeline drives a single input file through the phases of the
+// compiler (parse -> name analysis -> type analysis -> 3AC). Each
+// phase is run at most once, on demand, and its result is handed to
+// the next phase. Requesting several outputs from the same Pipeline
+// (e.g. both -a and -o) therefore only costs one trip through the
+// front end. A phase that fails yields nullptr, as do all phases
+// that depend on it.
+//
+// The tokens and AST nodes built for the input are allocated in an
+// arena owned by the Pipeline, and are all released at once when the
+// Pipeline is destroyed. The Pipeline also owns the line map needed
+// to print the positions of those nodes.
+//
+// At optimization level 1 and above, the 3AC is optimized as soon as
+// it is built, so every later consumer sees the optimized program.
+// Optimizing starts by inlining calls to procedures of at most
+// inlineSize quads.
+class Pipeline{
+public:
+	static const size_t DEFAULT_INLINE_SIZE = 16;
+	Pipeline(const char * inPathIn, int optLevelIn = 0,
+		size_t inlineSizeIn = DEFAULT_INLINE_SIZE);
+	ProgramNode * ast();
+	NameAnalysis * nameAnalysis();
+	TypeAnalysis * typeAnalysis();
+	IRProgram * ir();
+private:
+	ProgramNode * parse();
+
+	Arena arena;
+	LineMap lines;
+	const char * inPath;
+	int optLevel;
+	size_t inlineSize;
+
+	bool parsed = false;
+	bool named = false;
+	bool typed = false;
+	bool lowered = false;
+
+	ProgramNode * myAST = nullptr;
+	NameAnalysis * myNameAnalysis = nullptr;
+	TypeAnalysis * myTypeAnalysis = nullptr;
+	IRProgram * myIR = nullptr;
+};
+
+}
+
+#endif
@@ -0,0 +1,36 @@
+#include <algorithm>
+#include "position.hpp"
+#include "errors.hpp"
+
+namespace cminusminus{
+
+static LineMap * currentMap = nullptr;
+
+LineMap::LineMap() : previous(currentMap){
+	//The first line starts at the beginning of the file
+	lineStarts.push_back(0);
+	currentMap = this;
+}
+
+LineMap::~LineMap(){
+	currentMap = previous;
+}
+
+LineMap * LineMap::current(){
+	if (currentMap == nullptr){
+		throw new InternalError("No line map for positions");
+	}
+	return currentMap;
+}
+
+size_t LineMap::line(uint32_t offset) const{
+	auto itr = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset);
+	return static_cast<size_t>(itr - lineStarts.begin());
+}
+
+size_t LineMap::col(uint32_t offset) const{
+	size_t lineIdx = line(offset) - 1;
+	return offset - lineStarts[lineIdx] + 1;
+}
+
+}
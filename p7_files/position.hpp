@@ -1,48 +1,82 @@
 #ifndef CMINUSMINUS_POSITION_H
 #define CMINUSMINUS_POSITION_H
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace cminusminus{
 
-class Position{
-public: 
-	Position(size_t lineI, size_t colI, size_t lineE, size_t colE)
-	: myLineI(lineI), myColI(colI), myLineE(lineE), myColE(colE){
-	}
-	Position(Position * start, Position * end)
-	: myLineI(start->myLineI), myColI(start->myColI),
-	  myLineE(end->myLineE),myColE(end->myColE){
-	}
-	virtual void expand(Position * start, Position * end){
-	  myLineI = start->myLineI;
-	  myColI = start->myColI;
-	  myLineE = end->myLineE;
-	  myColE = end->myColE;
+// Records the offset at which each line of the input begins, so that
+// a Position (which only holds character offsets) can be turned back
+// into line/column form when it is printed. A LineMap makes itself
+// the current map for as long as it is alive, and the scanner fills
+// in the current map as it sees newlines.
+class LineMap{
+public:
+	LineMap();
+	~LineMap();
+	LineMap(const LineMap&) = delete;
+	LineMap& operator=(const LineMap&) = delete;
+
+	void addLine(uint32_t startOffset){
+		lineStarts.push_back(startOffset);
 	}
-	virtual std::string begin() const{
-		std::string result = "[" 
-		+ std::to_string(myLineI)
-		+ "," 
-		+ std::to_string(myColI)
+	//Line and column numbers are 1-based, as in the scanner
+	size_t line(uint32_t offset) const;
+	size_t col(uint32_t offset) const;
+
+	static LineMap * current();
+private:
+	std::vector<uint32_t> lineStarts;
+	LineMap * previous;
+};
+
+// A span of the input file, stored as the offset of its first
+// character and the offset just past its last character. Positions
+// are plain 8-byte values held inline by tokens and AST nodes; line
+// and column numbers are only reconstructed when they are printed.
+class Position{
+public:
+	Position() : myStart(NONE), myEnd(NONE){ }
+	Position(uint32_t startIn, uint32_t endIn)
+	: myStart(startIn), myEnd(endIn){ }
+	Position(const Position& start, const Position& end)
+	: myStart(start.myStart), myEnd(end.myEnd){ }
+	std::string begin() const{
+		std::string result = "["
+		+ std::to_string(lineI())
+		+ ","
+		+ std::to_string(colI())
 		+ "]";
 		return result;
 	}
-	virtual std::string span() const{
+	std::string span() const{
 		std::string result = begin()
-		+ "-[" 
-		+ std::to_string(myLineE)
-		+ "," 
-		+ std::to_string(myColE)
+		+ "-["
+		+ std::to_string(lineE())
+		+ ","
+		+ std::to_string(colE())
 		+ "]";
 		return result;
 	}
+	size_t lineI() const { return lineOf(myStart); }
+	size_t colI() const { return colOf(myStart); }
+	size_t lineE() const { return lineOf(myEnd); }
+	size_t colE() const { return colOf(myEnd); }
 private:
-	size_t myLineI;
-	size_t myColI;
-	size_t myLineE;
-	size_t myColE;
+	//Marks a Position that does not correspond to any input,
+	// which is printed as [0,0]
+	static const uint32_t NONE = UINT32_MAX;
+	static size_t lineOf(uint32_t offset){
+		return offset == NONE ? 0 : LineMap::current()->line(offset);
+	}
+	static size_t colOf(uint32_t offset){
+		return offset == NONE ? 0 : LineMap::current()->col(offset);
+	}
 
+	uint32_t myStart;
+	uint32_t myEnd;
 };
 
 }
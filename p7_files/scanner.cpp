@@ -13,8 +13,8 @@ void Scanner::outputTokens(std::ostream& outstream){
 		tokenKind = this->yylex(&lex);
 		if (tokenKind == TokenKind::END){
 			outstream << "EOF" 
-			  << " [" << this->lineNum 
-			  << "," << this->colNum << "]"
+			  << " [" << lines->line(offset)
+			  << "," << lines->col(offset) << "]"
 			  << std::endl;
 			return;
 		} else {
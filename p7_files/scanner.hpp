@@ -17,8 +17,9 @@ public:
    
    Scanner(std::istream *in) : yyFlexLexer(in)
    {
-	lineNum = 1;
-	colNum = 1;
+	offset = 0;
+	tokStart = 0;
+	lines = LineMap::current();
    };
    virtual ~Scanner() {
    };
@@ -29,49 +30,60 @@ public:
    // YY_DECL defined in the flex cminusminus.l
    virtual int yylex( cminusminus::Parser::semantic_type * const lval);
 
+   //Called (via YY_USER_ACTION) on every match, before the
+   // rule's action runs
+   void advance(){
+	tokStart = offset;
+	offset += static_cast<uint32_t>(yyleng);
+   }
+
+   //The span of the text matched by the current rule
+   Position matchPos() const{
+	return Position(tokStart, offset);
+   }
+
+   void newLine(){
+	lines->addLine(offset);
+   }
+
    int makeBareToken(int tagIn){
-	size_t len = static_cast<size_t>(yyleng);
-	Position * pos = new Position(
-	  this->lineNum, this->colNum,
-	  this->lineNum, this->colNum+len);
-        this->yylval->lexeme = new Token(pos, tagIn);
-        colNum += len;
+        this->yylval->lexeme = new Token(matchPos(), tagIn);
         return tagIn;
    }
 
-   void errIllegal(Position * pos, std::string match){
+   void errIllegal(const Position& pos, std::string match){
 	cminusminus::Report::fatal(pos, "Illegal character "
 		+ match);
    }
 
-   void errStrEsc(Position * pos){
+   void errStrEsc(const Position& pos){
 	cminusminus::Report::fatal(pos, "String literal with bad"
 	" escape sequence ignored");
    }
 
-   void errStrUnterm(Position * pos){
+   void errStrUnterm(const Position& pos){
 	cminusminus::Report::fatal(pos, "Unterminated string"
 	" literal ignored");
    }
 
-   void errStrEscAndUnterm(Position * pos){
+   void errStrEscAndUnterm(const Position& pos){
 	cminusminus::Report::fatal(pos, "Unterminated string literal"
 	" with bad escape sequence ignored");
    }
 
-   void errIntOverflow(Position * pos){
+   void errIntOverflow(const Position& pos){
 	cminusminus::Report::fatal(pos, "Integer literal overflow");
    }
 
-   void errIntUnderflow(Position * pos){
+   void errIntUnderflow(const Position& pos){
 	cminusminus::Report::fatal(pos, "Integer literal underflow");
    }
 
-   void errShortOverflow(Position * pos){
+   void errShortOverflow(const Position& pos){
 	cminusminus::Report::fatal(pos, "Short literal overflow");
    }
 
-   void errShortUnderflow(Position * pos){
+   void errShortUnderflow(const Position& pos){
 	cminusminus::Report::fatal(pos, "Short literal underflow");
    }
 
@@ -93,8 +105,9 @@ public:
 
 private:
    cminusminus::Parser::semantic_type *yylval = nullptr;
-   size_t lineNum;
-   size_t colNum;
+   uint32_t offset;
+   uint32_t tokStart;
+   LineMap * lines;
 };
 
 } /* end namespace */
@@ -1,12 +1,180 @@
 #include "stdio.h"
 #include "stdlib.h"
 #include <inttypes.h>
+#include "stdcminusminus.h"
+
+// The runtime comes in two flavors. By default every write goes
+// straight out through stdio and is flushed, so output shows up
+// as soon as it is written. Compiled with -DCMM_BUFFERED_IO (the
+// Makefile builds this as stdcminusminus_buffered.o, to link in
+// place of stdcminusminus.o), writes collect in a large buffer
+// that is flushed when it fills, before every read, at exit, and
+// whenever flushOutput is called, and reads take input from the
+// descriptor in large chunks. What is buffered is still written
+// if the program traps (dividing by zero, or through a bad
+// pointer), but it is lost if the program is killed from
+// outside, which is why this is not the default.
+
+#ifdef CMM_BUFFERED_IO
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#define OUT_BUF_SIZE (1 << 16)
+#define IN_BUF_SIZE (1 << 16)
+
+static char outBuf[OUT_BUF_SIZE];
+static size_t outLen = 0;
+
+static char inBuf[IN_BUF_SIZE];
+static size_t inPos = 0;
+static size_t inLen = 0;
+
+static void writeAll(const char * data, size_t len){
+	while (len > 0){
+		ssize_t n = write(STDOUT_FILENO, data, len);
+		if (n < 0){
+			if (errno == EINTR){ continue; }
+			return;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+}
+
+void flushOutput(){
+	writeAll(outBuf, outLen);
+	outLen = 0;
+}
+
+//Run by exit. Programs are linked without libc_nonshared,
+// which is where atexit lives.
+__attribute__((destructor)) static void flushAtExit(){
+	flushOutput();
+}
+
+//The handler goes back to the default as it runs, so returning
+// runs the faulting instruction again, and the program dies of
+// the same signal it would have without the buffer. Only write
+// is called, which is safe in a handler.
+static void flushOnTrap(int sig){
+	(void)sig;
+	flushOutput();
+}
+
+__attribute__((constructor)) static void catchTraps(){
+	static const int traps[] = {SIGFPE, SIGSEGV, SIGBUS, SIGILL};
+	struct sigaction action;
+	size_t i;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = flushOnTrap;
+	action.sa_flags = SA_RESETHAND;
+	sigemptyset(&action.sa_mask);
+	for (i = 0; i < sizeof(traps) / sizeof(traps[0]); i++){
+		sigaction(traps[i], &action, NULL);
+	}
+}
+
+static void output(const char * data, size_t len){
+	if (outLen + len > OUT_BUF_SIZE){
+		flushOutput();
+		//Too big to be worth copying
+		if (len > OUT_BUF_SIZE){
+			writeAll(data, len);
+			return;
+		}
+	}
+	memcpy(outBuf + outLen, data, len);
+	outLen += len;
+}
 
 void printBool(int64_t c){
-	if (c == 0){ 
-		fprintf(stdout, "false"); 
-	} else{ 
-		fprintf(stdout, "true"); 
+	if (c == 0){
+		output("false", 5);
+	} else{
+		output("true", 4);
+	}
+}
+
+void printInt(long int num){
+	//Digits go in from the right. Negating in unsigned
+	// arithmetic covers the most negative value too.
+	char digits[24];
+	char * start = digits + sizeof(digits);
+	unsigned long mag = num < 0 ? 0UL - (unsigned long)num : (unsigned long)num;
+	do {
+		*--start = (char)('0' + mag % 10);
+		mag /= 10;
+	} while (mag != 0);
+	if (num < 0){ *--start = '-'; }
+	output(start, (size_t)(digits + sizeof(digits) - start));
+}
+
+void printString(const char * str){
+	output(str, strlen(str));
+}
+
+//The next input character, or EOF. Anything written so far
+// goes out first, so that prompts appear before the program
+// waits for an answer.
+static int nextChar(){
+	if (inPos == inLen){
+		ssize_t n;
+		flushOutput();
+		do {
+			n = read(STDIN_FILENO, inBuf, IN_BUF_SIZE);
+		} while (n < 0 && errno == EINTR);
+		if (n <= 0){ return EOF; }
+		inPos = 0;
+		inLen = (size_t)n;
+	}
+	return (unsigned char)inBuf[inPos++];
+}
+
+int64_t getBool(){
+	int c = nextChar();
+	nextChar(); // Consume trailing newline
+	if (c == '0'){
+		return 0;
+	} else {
+		return 1;
+	}
+}
+
+//Reads a line, and parses the number at its start as atol
+// would
+int64_t getInt(){
+	int c = nextChar();
+	while (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'){
+		c = nextChar();
+	}
+	int neg = 0;
+	if (c == '-' || c == '+'){
+		neg = c == '-';
+		c = nextChar();
+	}
+	unsigned long res = 0;
+	while (c >= '0' && c <= '9'){
+		res = res * 10 + (unsigned long)(c - '0');
+		c = nextChar();
+	}
+	while (c != '\n' && c != EOF){ c = nextChar(); }
+	return (int64_t)(neg ? 0UL - res : res);
+}
+
+#else
+
+void flushOutput(){
+	fflush(stdout);
+}
+
+void printBool(int64_t c){
+	if (c == 0){
+		fprintf(stdout, "false");
+	} else{
+		fprintf(stdout, "true");
 	}
 	fflush(stdout);
 }
@@ -38,3 +206,5 @@ int64_t getInt(){
 	long int res = atol(buffer);
 	return res;
 }
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef CMINUSMINUS_STDCMINUSMINUS_H
+#define CMINUSMINUS_STDCMINUSMINUS_H
+
+#include <stdint.h>
+
+// The runtime that compiled programs call. cmmc links it in
+// too, to run programs without producing an executable.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void printBool(int64_t c);
+void printInt(long int num);
+void printString(const char * str);
+int64_t getBool(void);
+int64_t getInt(void);
+//Write out anything the runtime is holding on to. Programs have
+// no way to call this; it is for hosts like cmmc's -j, -r and
+// -v, which run a program in process and have to flush before
+// they exit or die.
+void flushOutput(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,88 +2,72 @@
 #include "types.hpp"
 namespace cminusminus{
 
-SymbolTable::SymbolTable(){
-	scopeTableChain = new std::list<ScopeTable *>();
+const size_t SymbolTable::NO_BINDING;
+
+//Every identifier has been interned by the time name
+// analysis runs, so heads rarely needs to grow
+SymbolTable::SymbolTable()
+: heads(Atom::count(), NO_BINDING){
 }
 
 void SymbolTable::print(){
-	for(auto scope : *scopeTableChain){
+	size_t end = bindings.size();
+	for (auto itr = scopeStarts.rbegin(); itr != scopeStarts.rend(); ++itr){
 		std::cout << "--- scope ---\n";
-		std::cout << scope->toString();
+		for (size_t i = *itr; i < end; i++){
+			std::cout << bindings[i].sym->toString() << "\n";
+		}
+		end = *itr;
 	}
 }
 
-ScopeTable * SymbolTable::enterScope(){
-	ScopeTable * newScope = new ScopeTable();
-	scopeTableChain->push_front(newScope);
-	return newScope;
+void SymbolTable::enterScope(){
+	scopeStarts.push_back(bindings.size());
 }
 
 void SymbolTable::leaveScope(){
-	if (scopeTableChain->empty()){
+	if (scopeStarts.empty()){
 		throw new InternalError("Attempt to pop"
 			"empty symbol table");
 	}
-	scopeTableChain->pop_front();
-}
-
-ScopeTable * SymbolTable::getCurrentScope(){
-	return scopeTableChain->front();
-}
-
-bool SymbolTable::clash(std::string varName){
-	bool hasClash = getCurrentScope()->clash(varName);
-	return hasClash;
-}
-
-SemSymbol * SymbolTable::find(std::string varName){
-	for (ScopeTable * scope : *scopeTableChain){
-		SemSymbol * sym = scope->lookup(varName);
-		if (sym != nullptr) { return sym; }
+	size_t start = scopeStarts.back();
+	scopeStarts.pop_back();
+	while (bindings.size() > start){
+		const Binding& binding = bindings.back();
+		heads[binding.sym->getAtom().id()] = binding.shadowed;
+		bindings.pop_back();
 	}
-	return nullptr;
 }
 
-bool SymbolTable::insert(SemSymbol * symbol){
-	return scopeTableChain->front()->insert(symbol);
+bool SymbolTable::clash(Atom varName){
+	size_t idx = innermost(varName);
+	if (idx == NO_BINDING){ return false; }
+	return bindings[idx].depth == scopeStarts.size();
 }
 
-ScopeTable::ScopeTable(){
-	symbols = new HashMap<std::string, SemSymbol *>();
+SemSymbol * SymbolTable::find(Atom varName){
+	size_t idx = innermost(varName);
+	if (idx == NO_BINDING){ return nullptr; }
+	return bindings[idx].sym;
 }
 
-std::string ScopeTable::toString(){
-	std::string result = "";
-	for (auto entry : *symbols){
-		result += entry.second->toString();
-		result += "\n";
-	}
-	return result;
-}
-
-bool ScopeTable::clash(std::string varName){
-	SemSymbol * found = lookup(varName);
-	if (found != nullptr){
-		return true;
-	}
-	return false;
-}
-
-SemSymbol * ScopeTable::lookup(std::string name){
-	auto found = symbols->find(name);
-	if (found == symbols->end()){
-		return NULL;
+bool SymbolTable::insert(SemSymbol * symbol){
+	if (scopeStarts.empty()){
+		throw new InternalError("Insert with no open scope");
 	}
-	return found->second;
-}
-
-bool ScopeTable::insert(SemSymbol * symbol){
-	std::string symName = symbol->getName();
-	bool alreadyInScope = (this->lookup(symName) != NULL);
-	if (alreadyInScope){
+	Atom name = symbol->getAtom();
+	if (clash(name)){
 		return false;
 	}
-	this->symbols->insert(std::make_pair(symName, symbol));
+	if (name.id() >= heads.size()){
+		heads.resize(Atom::count(), NO_BINDING);
+	}
+	Binding binding;
+	binding.sym = symbol;
+	binding.depth = scopeStarts.size();
+	binding.shadowed = heads[name.id()];
+	heads[name.id()] = bindings.size();
+	bindings.push_back(binding);
 	return true;
 }
 
@@ -1,8 +1,11 @@
 #ifndef CMINUSMINUS_SYMBOL_TABLE_HPP
 #define CMINUSMINUS_SYMBOL_TABLE_HPP
 #include <string>
+#include <cstdint>
 #include <unordered_map>
 #include <list>
+#include <vector>
+#include "atom.hpp"
 #include "types.hpp"
 
 //Use an alias template so that we can use
@@ -26,10 +29,11 @@ enum SymbolKind {
 // symbol table. 
 class SemSymbol {
 public:
-	SemSymbol(std::string nameIn, const DataType * typeIn) 
+	SemSymbol(Atom nameIn, const DataType * typeIn) 
 	: myName(nameIn), myType(typeIn){ }
 	virtual std::string toString();
-	std::string getName() const { return myName; }
+	const std::string& getName() const { return myName.str(); }
+	Atom getAtom() const { return myName; }
 	virtual SymbolKind getKind() const = 0;
 
 	virtual const DataType * getDataType() const{
@@ -44,66 +48,67 @@ public:
 		return "UNKNOWN KIND";
 	} 
 private:
-	std::string myName;
+	Atom myName;
 	const DataType * myType;
 };
 
 class VarSymbol : public SemSymbol {
 public:
-	VarSymbol(std::string name, const DataType * type) 
+	VarSymbol(Atom name, const DataType * type) 
 	: SemSymbol(name, type) { }
 	virtual SymbolKind getKind() const override { return VAR; } 
 };
 
 class FnSymbol : public SemSymbol{
 public:
-	FnSymbol(std::string name, const FnType * fnType)
+	FnSymbol(Atom name, const FnType * fnType)
 	: SemSymbol(name, fnType){ }
 	virtual SymbolKind getKind() const { return FN; }
 	SymbolKind getKind(){ return FN; } 
 };
 
-//A single scope. The symbol table is broken down into a 
-// chain of scope tables, and each scope table holds 
-// semantic symbols for a single scope. For example,
-// the globals scope will be represented by a ScopeTable,
-// and the contents of each function can be represented by
-// a ScopeTable.
-class ScopeTable {
-	public:
-		ScopeTable();
-		SemSymbol * lookup(std::string name);
-		bool insert(SemSymbol * symbol);
-		bool clash(std::string name);
-		std::string toString();
-		void addVar(std::string name, const DataType * type){
-			insert(new VarSymbol(name, type));
-		}
-		void addFn(std::string name, FnType * type){
-			insert(new FnSymbol(name, type));
-		}
-	private:
-		HashMap<std::string, SemSymbol *> * symbols;
-};
-
+//The symbol table. Rather than keeping a chain of 
+// per-scope maps, every binding that is currently in 
+// scope lives in a single stack, in the order it was 
+// declared. Each identifier (atom) maps directly to its 
+// innermost binding, and each binding remembers the one 
+// it shadows. Lookup is therefore a single array index
+// no matter how deeply scopes are nested, and leaving a 
+// scope just pops the bindings declared in it, restoring
+// whatever they shadowed.
 class SymbolTable{
 	public:
 		SymbolTable();
-		ScopeTable * enterScope();
+		void enterScope();
 		void leaveScope();
-		ScopeTable * getCurrentScope();
 		bool insert(SemSymbol * symbol);
-		SemSymbol * find(std::string varName);
-		bool clash(std::string name);
-		void addVar(std::string name, const DataType * type){
-			getCurrentScope()->addVar(name, type);
+		SemSymbol * find(Atom varName);
+		bool clash(Atom name);
+		void addVar(Atom name, const DataType * type){
+			insert(new VarSymbol(name, type));
 		}
-		void addFn(std::string name, FnType * type){
-			getCurrentScope()->addFn(name, type);
+		void addFn(Atom name, FnType * type){
+			insert(new FnSymbol(name, type));
 		}
 		void print();
 	private:
-		std::list<ScopeTable *> * scopeTableChain;
+		static const size_t NO_BINDING = SIZE_MAX;
+		struct Binding{
+			SemSymbol * sym;
+			size_t depth;
+			size_t shadowed;
+		};
+		size_t innermost(Atom name) const {
+			if (name.id() >= heads.size()){ return NO_BINDING; }
+			return heads[name.id()];
+		}
+
+		//Index (in bindings) of the innermost binding of
+		// each atom, or NO_BINDING
+		std::vector<size_t> heads;
+		std::vector<Binding> bindings;
+		//The size of bindings when each open scope was entered
+		std::vector<size_t> scopeStarts;
 };
 
 	
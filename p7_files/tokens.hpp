@@ -2,37 +2,39 @@
 #define CMINUSMINUS_TOKEN_H
 
 #include <string>
+#include "arena.hpp"
+#include "atom.hpp"
 #include "position.hpp"
 
 namespace cminusminus{
 
-class Token{
+class Token : public ArenaObject{
 public:
-	Token(Position * pos, int kindIn);
+	Token(const Position& pos, int kindIn);
 	virtual std::string toString();
 	size_t line() const;
 	size_t col() const;
 	int kind() const;
-	Position * pos() const;
+	const Position& pos() const;
 protected:
-	Position * myPos;
+	Position myPos;
 private:
 	const int myKind;
 };
 
 class IDToken : public Token{
 public:
-	IDToken(Position * posIn, std::string valIn);
-	const std::string value() const;
+	IDToken(const Position& posIn, Atom valIn);
+	Atom value() const;
 	virtual std::string toString() override;
 private:
-	const std::string myValue;
+	const Atom myValue;
 	
 };
 
 class StrToken : public Token{
 public:
-	StrToken(Position * posIn, std::string valIn);
+	StrToken(const Position& posIn, std::string valIn);
 	virtual std::string toString() override;
 	const std::string str() const;
 private:
@@ -41,7 +43,7 @@ private:
 
 class IntLitToken : public Token{
 public:
-	IntLitToken(Position * posIn, int numIn);
+	IntLitToken(const Position& posIn, int numIn);
 	virtual std::string toString() override;
 	int num() const;
 private:
@@ -50,7 +52,7 @@ private:
 
 class ShortLitToken : public Token{
 public:
-	ShortLitToken(Position * posIn, int numIn);
+	ShortLitToken(const Position& posIn, int numIn);
 	virtual std::string toString() override;
 	int num() const;
 private:
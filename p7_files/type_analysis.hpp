@@ -1,6 +1,7 @@
 #ifndef CMINUSMINUS_TYPE_ANALYSIS
 #define CMINUSMINUS_TYPE_ANALYSIS
 
+#include <vector>
 #include "ast.hpp"
 #include "symbol_table.hpp"
 #include "types.hpp"
@@ -14,13 +15,16 @@ namespace cminusminus{
 // TypeAnalysis class contains a map from each ASTNode to it's
 // DataType. Thus, instead of attaching a type field to most nodes,
 // one can instead map the node to it's type, or lookup the node
-// in the map.
+// in the map. The "map" is a vector indexed by the node's id,
+// so lookups during type checking and lowering never hash.
 class TypeAnalysis {
 
 private:
 	//The private constructor here means that the type analysis
 	// can only be created via the static build function
-	TypeAnalysis(){
+	TypeAnalysis()
+	: nodeToType(ASTNode::count(), nullptr),
+	  nodeLVal(ASTNode::count(), false){
 		hasError = false;
 	}
 
@@ -49,162 +53,169 @@ public:
 	// overloaded: this 2-argument nodeType puts a value into the
 	// map with a given type. 
 	void nodeType(const ASTNode * node, const DataType * type){
-		nodeToType[node] = type;
+		//Nodes built during the analysis (e.g. promotions)
+		// have ids past the end of the table
+		if (node->id() >= nodeToType.size()){
+			nodeToType.resize(ASTNode::count(), nullptr);
+		}
+		nodeToType[node->id()] = type;
 	}
 
 	void nodeIsLVal(const ASTNode * node, bool isLVal){
-		nodeLVal[node] = isLVal;
+		if (node->id() >= nodeLVal.size()){
+			nodeLVal.resize(ASTNode::count(), false);
+		}
+		nodeLVal[node->id()] = isLVal;
 	}
 
 	//Gets the type of a node already placed in the map. Note
 	// that this function name is overloaded: the 1-argument nodeType
 	// gets the type of the given node out of the map.
 	const DataType * nodeType(const ASTNode * node){
-		auto res = nodeToType.find(node);
-		assert(res != nodeToType.end() || "No type for node");
-		
 		//Note: this actually could be nullptr
-		return res->second;
+		if (node->id() >= nodeToType.size()){ return nullptr; }
+		return nodeToType[node->id()];
 	}
 
 	bool nodeIsLVal(const ASTNode * node){
-		return nodeLVal[node];
+		if (node->id() >= nodeLVal.size()){ return false; }
+		return nodeLVal[node->id()];
 	}
 
 	//The following functions all report and error and 
 	// tell the object that the analysis has failed. 
-	void errWriteFn(Position * pos){
+	void errWriteFn(const Position& pos){
 		hasError = true;
 		Report::fatal(pos,
 			"Attempt to output a function");
 	}
-	void errWriteVoid(Position * pos){
+	void errWriteVoid(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Attempt to write void");
 	}
-	void errAssignFn(Position * pos){
+	void errAssignFn(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, "Attempt to assign user input to function");
 	}
 
-	void errReadFn(Position * pos){
+	void errReadFn(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Attempt to assign user input to function");
 	}
-	void errCallee(Position * pos){
+	void errCallee(const Position& pos){
 		hasError = true;
 		Report::fatal(pos,
 			"Attempt to call a "
 			"non-function");
 	}
-	void errArgCount(Position * pos){
+	void errArgCount(const Position& pos){
 		hasError = true;
 		Report::fatal(pos,
 			"Function call with wrong"
 			" number of args");
 	}
-	void errArgMatch(Position * pos){
+	void errArgMatch(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Type of actual does not match"
 			" type of formal");
 	}
-	void errRetEmpty(Position * pos){
+	void errRetEmpty(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Missing return value");
 	}
-	void extraRetValue(Position * pos){
+	void extraRetValue(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Return with a value in void"
 			" function");
 	}
-	void errRetWrong(Position * pos){
+	void errRetWrong(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Bad return value");
 	}
-	void errMathOpd(Position * pos){
+	void errMathOpd(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Arithmetic operator applied"
 			" to invalid operand");
 	}
-	void errRelOpd(Position * pos){
+	void errRelOpd(const Position& pos){
 		hasError = true;
 		Report::fatal(pos,
 			"Relational operator applied to"
 			" non-numeric operand");
 	}
-	void errLogicOpd(Position * pos){
+	void errLogicOpd(const Position& pos){
 		hasError = true;
 		Report::fatal(pos,
 			"Logical operator applied to"
 			" non-bool operand");
 	}
-	void errIfCond(Position * pos){
+	void errIfCond(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Non-bool expression used as"
 			" an if condition");
 	}
-	void errWhileCond(Position * pos){
+	void errWhileCond(const Position& pos){
 		hasError = true;
 		Report::fatal(pos,
 			"Non-bool expression used as"
 			" a while condition");
 	}
-	void errEqOpd(Position * pos){
+	void errEqOpd(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Invalid equality operand");
 	}
-	void errEqOpr(Position * pos){
+	void errEqOpr(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Invalid equality operation");
 	}
-	void errNotLVal(Position * pos){
+	void errNotLVal(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Non-Lval assignment");
 	}
-	void errAssignOpd(Position * pos){
+	void errAssignOpd(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Invalid assignment operand");
 	}
-	void errAssignOpr(Position * pos){
+	void errAssignOpr(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Invalid assignment operation");
 	}
-	void errWritePtr(Position * pos){
+	void errWritePtr(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Attempt to write a raw pointer");
 	}
-	void errReadPtr(Position * pos){
+	void errReadPtr(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Attempt to read a raw pointer");
 	}
-	void errDerefOpd(Position * pos){
+	void errDerefOpd(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Invalid operand for dereference");
 	}
-	void errRefOpd(Position * pos){
+	void errRefOpd(const Position& pos){
 		hasError = true;
 		Report::fatal(pos, 
 			"Invalid ref operand");
 	}
 private:
-	HashMap<const ASTNode *, const DataType *> nodeToType;
-	HashMap<const ASTNode *, bool> nodeLVal;
+	std::vector<const DataType *> nodeToType;
+	std::vector<bool> nodeLVal;
 	const FnType * currentFnType;
 	bool hasError;
 public:
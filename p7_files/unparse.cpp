@@ -312,7 +312,7 @@ void LValNode::unparseNested(std::ostream& out){
 
 void IDNode::unparse(std::ostream& out, int indent){
 	doIndent(out, indent);
-	out << name;
+	out << getName();
 	if (mySymbol != nullptr){
 		out << "("
 		  << mySymbol->getDataType()->getString()
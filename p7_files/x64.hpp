@@ -0,0 +1,218 @@
+#ifndef CMINUSMINUS_X64_HPP
+#define CMINUSMINUS_X64_HPP
+
+#include <cstdint>
+#include <initializer_list>
+#include <list>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cminusminus{
+
+//The general-purpose registers, numbered as in the instruction
+// encoding, and %rip, which is only ever the base of a memory
+// operand
+enum class X64Reg : uint8_t {
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+	RIP, NONE
+};
+
+//An instruction operand: a register (all of it, or its low
+// dword or byte), an immediate, a memory location, or the label
+// that a jump or call goes to. An immediate or a %rip-relative
+// memory operand may name a symbol, whose address is added to
+// the value.
+class X64Opd{
+public:
+	enum Kind : uint8_t { NONE, REG, IMM, MEM, LABEL };
+
+	X64Opd()
+	: kind(NONE), size(8), scale(1), base(X64Reg::NONE),
+	  index(X64Reg::NONE), val(0){ }
+	static X64Opd reg(X64Reg reg, uint8_t size = 8);
+	static X64Opd imm(int64_t val);
+	//$sym, the address of the symbol
+	static X64Opd addrOf(const std::string& sym);
+	//disp(base), or disp(base,index,scale)
+	static X64Opd mem(X64Reg base, int64_t disp,
+		X64Reg index = X64Reg::NONE, uint8_t scale = 1);
+	//sym(%rip)
+	static X64Opd global(const std::string& sym);
+	static X64Opd label(const std::string& name);
+
+	Kind getKind() const { return kind; }
+	bool isReg() const { return kind == REG; }
+	bool isImm() const { return kind == IMM; }
+	bool isMem() const { return kind == MEM; }
+	bool isLabel() const { return kind == LABEL; }
+	//The register, or the base of a memory operand
+	X64Reg getReg() const { return base; }
+	X64Reg getIndex() const { return index; }
+	uint8_t getScale() const { return scale; }
+	//The size of a register operand in bytes: 8, 4 or 1
+	uint8_t getSize() const { return size; }
+	//The immediate, or the displacement of a memory operand
+	int64_t getVal() const { return val; }
+	//The symbol or label, or "" if there is none
+	const std::string& getSym() const { return sym; }
+	//Whether the operand is the register or uses it to
+	// address memory
+	bool mentions(X64Reg reg) const;
+	bool operator==(const X64Opd& other) const;
+	bool operator!=(const X64Opd& other) const { return !(*this == other); }
+	//In AT&T syntax
+	std::string toString() const;
+private:
+	Kind kind;
+	uint8_t size;
+	uint8_t scale;
+	X64Reg base;
+	X64Reg index;
+	int64_t val;
+	std::string sym;
+};
+
+//One line of a procedure's assembly: a label, an instruction,
+// or a comment. Instructions are the ones codegen uses, with
+// up to three operands in AT&T order.
+class X64Inst{
+public:
+	enum Kind : uint8_t { LABEL, INSTR, COMMENT };
+	enum Op : uint8_t {
+		MOVQ, MOVABSQ, MOVZBQ, LEAQ,
+		ADDQ, SUBQ, ANDQ, ORQ, XORQ, XORL, CMPQ,
+		IMULQ, IDIVQ, NEGQ, CQTO, SHLQ, SARQ, SHRQ,
+		SETE, SETNE, SETL, SETG, SETLE, SETGE,
+		JMP, JE, JNE, JL, JG, JLE, JGE,
+		CALLQ, RETQ, PUSHQ, POPQ, NOP
+	};
+
+	static X64Inst label(const std::string& name){
+		return X64Inst(LABEL, NOP, name);
+	}
+	static X64Inst instr(Op op, std::initializer_list<X64Opd> opds);
+	static X64Inst comment(const std::string& text){
+		return X64Inst(COMMENT, NOP, text);
+	}
+
+	Kind getKind() const { return kind; }
+	bool isLabel() const { return kind == LABEL; }
+	bool isInstr() const { return kind == INSTR; }
+	bool isJump() const { return isInstr() && op >= JMP && op <= JGE; }
+	bool isCondJump() const { return isInstr() && op > JMP && op <= JGE; }
+	Op getOp() const { return op; }
+	size_t numOpds() const { return opdCount; }
+	const X64Opd& getOpd(size_t i) const { return opds[i]; }
+	//The label's name, or the comment's text
+	const std::string& getText() const { return text; }
+	std::string toString() const;
+	static const char * opName(Op op);
+private:
+	X64Inst(Kind kindIn, Op opIn, const std::string& textIn)
+	: kind(kindIn), op(opIn), opdCount(0), text(textIn){ }
+
+	Kind kind;
+	Op op;
+	uint8_t opdCount;
+	X64Opd opds[3];
+	std::string text;
+};
+
+//The code generated for one procedure, held as a list of
+// instructions between codegen and printing or encoding so that
+// it can be cleaned up by a peephole pass. Comments are only
+// kept when asked for, since only printed assembly has them.
+class X64Code{
+public:
+	explicit X64Code(bool withCommentsIn) : withComments(withCommentsIn){ }
+	bool hasComments() const { return withComments; }
+	void label(const std::string& name){
+		insts.push_back(X64Inst::label(name));
+	}
+	void emit(X64Inst::Op op, std::initializer_list<X64Opd> opds = {}){
+		insts.push_back(X64Inst::instr(op, opds));
+	}
+	void comment(const std::string& text){
+		if (withComments){ insts.push_back(X64Inst::comment(text)); }
+	}
+	const std::list<X64Inst>& getInsts() const { return insts; }
+	void peephole();
+	void print(std::ostream& out) const;
+private:
+	bool dropNops();
+	bool dropJumpsToNext();
+	bool dropUnreachable();
+	bool invertBranchOverJump();
+	bool dropUnusedLabels();
+	bool forwardValues();
+	bool forwardCopies();
+	bool zeroWithXor();
+
+	bool withComments;
+	std::list<X64Inst> insts;
+};
+
+//An ELF64 relocatable object file, built without going through
+// the assembler: the code of each procedure is encoded straight
+// into .text. The result links just like the assembled output
+// of toX64, with the globals in .data, the string literals in
+// .rodata, and the calls into the runtime left to the linker.
+class ObjectFile{
+public:
+	//size zero bytes in .data
+	void addData(const std::string& name, size_t size);
+	//A NUL-terminated string in .rodata
+	void addString(const std::string& name, const std::string& bytes);
+	//Encode a procedure onto the end of .text
+	void addCode(const X64Code& code);
+	//Make the symbol visible outside of the object
+	void setGlobal(const std::string& name);
+	void write(std::ostream& out);
+	//Copy the sections into executable memory in this process,
+	// taking symbols not defined here from externs, and return
+	// the address of entry. The memory stays mapped until exit.
+	void * load(const std::map<std::string, void *>& externs,
+		const std::string& entry);
+private:
+	enum Section { UNDEF, TEXT, DATA, RODATA };
+	//Relocation types, from the x86-64 psABI
+	enum Reloc : uint32_t {
+		R_X86_64_PC32 = 2, R_X86_64_PLT32 = 4, R_X86_64_32S = 11
+	};
+	struct Symbol{
+		std::string name;
+		Section section;
+		size_t offset;
+		bool global;
+	};
+	//A 32-bit field in .text to be filled in with the address
+	// of sym plus addend, as given by an x86-64 relocation type
+	struct Fixup{
+		size_t offset;
+		std::string sym;
+		uint32_t type;
+		int64_t addend;
+	};
+
+	void define(const std::string& name, Section section, size_t offset);
+	size_t symbolIdx(const std::string& name);
+	void encode(const X64Inst& inst);
+	void encodeRM(const std::vector<uint8_t>& opcode, int regField,
+		const X64Opd& rm, bool wide, size_t immBytes);
+	void encodeImm(const X64Opd& imm, size_t bytes);
+	void encodeRel(const std::string& target);
+
+	std::string text;
+	std::string data;
+	std::string rodata;
+	std::vector<Symbol> symbols;
+	std::map<std::string, size_t> symbolIdxs;
+	std::vector<Fixup> fixups;
+};
+
+}
+
+#endif
@@ -1,177 +1,748 @@
+#include <algorithm>
+#include <cstdlib>
 #include <ostream>
 #include "3ac.hpp"
+#include "x64.hpp"
 
 namespace cminusminus{
 
+static std::string globalLabel(SymOpd * opd){
+	return "gbl_" + opd->getSym()->getName();
+}
+
 void IRProgram::allocGlobals(){
 	//Choose a label for each global
-	TODO(Implement me)
+	for (auto global : globals){
+		SymOpd * opd = global.second;
+		opd->setMemoryLoc(X64Opd::global(globalLabel(opd)));
+	}
 }
 
 void IRProgram::datagenX64(std::ostream& out){
-	TODO(Write out data section)
+	out << ".data\n";
+	for (auto global : globals){
+		out << globalLabel(global.second) << ": .quad 0\n";
+	}
+	for (auto entry : strings){
+		out << entry.first->valString() << ": .asciz "
+			<< entry.second << "\n";
+	}
 	//Put this directive after you write out strings
 	// so that everything is aligned to a quadword value
 	// again
 	out << ".align 8\n";
-	
+
 }
 
-void IRProgram::toX64(std::ostream& out){
+void IRProgram::toX64(std::ostream& out, bool optimize){
 	allocGlobals();
 	datagenX64(out);
 	// Iterate over each procedure and codegen it
-	TODO(Implement me)
+	out << ".text\n";
+	out << ".globl main\n";
+	for (auto proc : *procs){
+		proc->toX64(out, optimize);
+	}
 }
 
-void Procedure::allocLocals(){
-	//Allocate space for locals
-	// Iterate over each procedure and codegen it
-	TODO(Implement me)
+ObjectFile IRProgram::toObject(bool optimize){
+	allocGlobals();
+	ObjectFile obj;
+	for (auto global : globals){
+		obj.addData(globalLabel(global.second), 8);
+	}
+	for (auto entry : strings){
+		obj.addString(entry.first->valString(), stringBytes(entry.second));
+	}
+	for (auto proc : *procs){
+		obj.addCode(proc->toX64Code(optimize, false));
+	}
+	obj.setGlobal("main");
+	return obj;
+}
+
+void IRProgram::toElf(std::ostream& out, bool optimize){
+	toObject(optimize).write(out);
 }
 
-void Procedure::toX64(std::ostream& out){
+static X64Opd slotLoc(size_t& offset){
+	offset += 8;
+	return X64Opd::mem(X64Reg::RBP, -static_cast<int64_t>(offset));
+}
+
+void Procedure::allocLocals(bool allocRegs){
+	std::set<Opd *> inRegs;
+	if (allocRegs){
+		inRegs = allocRegisters();
+	}
+
+	//Every value takes a full quadword. The frame is laid
+	// out downward from %rbp: first the callee-saved
+	// registers we use, then a slot for each operand that
+	// did not get a register, then room for outgoing stack
+	// arguments at the bottom. When optimizing, operands
+	// that are never live at the same time share a slot.
+	size_t offset = 8 * savedRegs.size();
+	std::set<Opd *> shared;
+	if (allocRegs){
+		for (const std::vector<Opd *>& slot : colorSlots(inRegs)){
+			X64Opd loc = slotLoc(offset);
+			for (Opd * opd : slot){
+				if (SymOpd * sym = opd->asSym()){
+					sym->setMemoryLoc(loc);
+				} else if (AuxOpd * aux = opd->asAux()){
+					aux->setMemoryLoc(loc);
+				} else if (AddrOpd * addr = opd->asAddr()){
+					addr->setMemoryLoc(loc);
+				}
+				shared.insert(opd);
+			}
+		}
+	}
+	auto hasLoc = [&](Opd * opd){
+		return inRegs.count(opd) > 0 || shared.count(opd) > 0;
+	};
+	for (auto formal : formals){
+		if (!hasLoc(formal)){
+			formal->setMemoryLoc(slotLoc(offset));
+		}
+	}
+	for (auto local : locals){
+		if (!hasLoc(local.second)){
+			local.second->setMemoryLoc(slotLoc(offset));
+		}
+	}
+	for (auto tmp : temps){
+		if (!hasLoc(tmp)){
+			tmp->setMemoryLoc(slotLoc(offset));
+		}
+	}
+	for (auto addr : addrOpds){
+		if (!hasLoc(addr)){
+			addr->setMemoryLoc(slotLoc(offset));
+		}
+	}
+	offset += 8 * maxStackArgs();
+
+	//Keep %rsp 16-byte aligned at calls
+	frameSize = (offset + 15) / 16 * 16;
+}
+
+size_t Procedure::maxStackArgs(){
+	size_t res = 0;
+	for (auto quad : *bodyQuads){
+		if (SetArgQuad * setArg = quad->asSetArg()){
+			size_t idx = setArg->getIndex();
+			if (idx > RegUtils::REG_ARGS){
+				res = std::max(res, idx - RegUtils::REG_ARGS);
+			}
+		}
+	}
+	return res;
+}
+
+void Procedure::genX64(X64Code& code, bool optimize){
 	//Allocate all locals
-	allocLocals();
+	allocLocals(optimize);
 
-	enter->codegenLabels(out);
-	enter->codegenX64(out);
-	out << "#Fn body " << myName << "\n";
+	enter->codegenLabels(code);
+	enter->codegenX64(code);
+	code.comment("Fn body " + myName);
 	for (auto quad : *bodyQuads){
-		quad->codegenLabels(out);
-		out << "#" << quad->toString() << "\n";
-		quad->codegenX64(out);
+		quad->codegenLabels(code);
+		if (code.hasComments()){ code.comment(quad->toString()); }
+		quad->codegenX64(code);
 	}
-	out << "#Fn epilogue " << myName << "\n";
-	leave->codegenLabels(out);
-	leave->codegenX64(out);
+	code.comment("Fn epilogue " + myName);
+	leave->codegenLabels(code);
+	leave->codegenX64(code);
 }
 
-void Quad::codegenLabels(std::ostream& out){
-	if (labels.empty()){ return; }
+void Procedure::toX64(std::ostream& out, bool optimize){
+	toX64Code(optimize, true).print(out);
+}
+
+//The code is cleaned up by the peephole pass before it is
+// printed or encoded, whether or not it was optimized
+X64Code Procedure::toX64Code(bool optimize, bool withComments){
+	X64Code code(withComments);
+	genX64(code, optimize);
+	code.peephole();
+	return code;
+}
 
-	size_t numLabels = labels.size();
-	size_t labelIdx = 0;
-	for ( Label * label : labels){
-		out << label->getName() << ": ";
-		if (labelIdx != numLabels - 1){ out << "\n"; }
-		labelIdx++;
+void Quad::codegenLabels(X64Code& code){
+	for (Label * label : labels){
+		code.label(label->getName());
 	}
 }
 
-void BinOpQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+//The whole of a register, as an operand
+static X64Opd full(Register reg){
+	return X64Opd::reg(RegUtils::x64Reg(reg));
 }
 
-void UnaryOpQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+static X64Opd imm(long long val){
+	return X64Opd::imm(val);
 }
 
-void AssignQuad::codegenX64(std::ostream& out){
-	src->genLoadVal(out, A);
-	dst->genStoreVal(out, A);
+//Whether the operand is a literal that can be an instruction's
+// immediate, which x64 sign-extends from 32 bits, and if so
+// its value. String literals are labels, and those are left
+// to a register.
+static bool immValue(Opd * opd, long long& val){
+	LitOpd * lit = opd->asLit();
+	if (lit == nullptr){ return false; }
+	std::string str = lit->valString();
+	char * end = nullptr;
+	val = std::strtoll(str.c_str(), &end, 10);
+	return !str.empty() && *end == '\0'
+		&& val >= INT32_MIN && val <= INT32_MAX;
 }
 
-void GotoQuad::codegenX64(std::ostream& out){
-	out << "jmp " << tgt->getName() << "\n";
+//Where an instruction can read an operand's value as it
+// stands: the register, stack slot or global of a symbol or
+// temp, or an immediate. An AddrOpd's value has to be loaded
+// through its address first, and string literals and wide
+// numbers have to be moved into a register.
+static bool readable(Opd * opd, X64Opd& res){
+	long long val;
+	if (immValue(opd, val)){
+		res = imm(val);
+		return true;
+	}
+	if (opd->asSym() == nullptr && opd->asAux() == nullptr){ return false; }
+	res = opd->getMemoryLoc();
+	return true;
+}
+
+//The register a symbol or temp was allocated, if any
+static bool valueReg(Opd * opd, X64Opd& res){
+	X64Opd loc;
+	if (!readable(opd, loc) || !loc.isReg()){ return false; }
+	res = loc;
+	return true;
+}
+
+//Copy an operand's value into any register. These do for
+// registers what genLoadVal and genStoreVal do for the
+// scratch ones, which are all they take.
+static void genLoad(X64Code& code, Opd * opd, const X64Opd& reg){
+	X64Opd src;
+	if (AddrOpd * addr = opd->asAddr()){
+		X64Opd at = addr->getMemoryLoc();
+		if (!at.isReg()){
+			code.emit(X64Inst::MOVQ, {at, reg});
+			at = reg;
+		}
+		code.emit(X64Inst::MOVQ, {X64Opd::mem(at.getReg(), 0), reg});
+	} else if (readable(opd, src)){
+		if (!(src == reg)){ code.emit(X64Inst::MOVQ, {src, reg}); }
+	} else {
+		opd->genLoadVal(code, A);
+		if (!(full(A) == reg)){ code.emit(X64Inst::MOVQ, {full(A), reg}); }
+	}
 }
 
-void IfzQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+//Copy a register or immediate into an operand. %r11 is never
+// allocated, so it is free to hold an AddrOpd's address.
+static void genStore(X64Code& code, Opd * opd, const X64Opd& val){
+	X64Opd loc;
+	if (AddrOpd * addr = opd->asAddr()){
+		X64Opd at = addr->getMemoryLoc();
+		if (!at.isReg()){
+			code.emit(X64Inst::MOVQ, {at, full(R11)});
+			at = full(R11);
+		}
+		code.emit(X64Inst::MOVQ, {val, X64Opd::mem(at.getReg(), 0)});
+	} else if (readable(opd, loc)){
+		if (!(loc == val)){ code.emit(X64Inst::MOVQ, {val, loc}); }
+	} else {
+		throw new InternalError("Stored to a literal");
+	}
 }
 
-void NopQuad::codegenX64(std::ostream& out){
-	out << "nop" << "\n";
+//Compare two operands and leave the boolean result in work.
+// The left-hand one is loaded into work unless it can be
+// compared where it is.
+static void genCompare(X64Code& code, Opd * lhs, const X64Opd& rhs,
+  X64Inst::Op setOp, const X64Opd& work){
+	X64Opd lhsOpd;
+	if (!readable(lhs, lhsOpd) || lhsOpd.isImm()
+	  || (lhsOpd.isMem() && rhs.isMem())){
+		genLoad(code, lhs, work);
+		lhsOpd = work;
+	}
+	code.emit(X64Inst::CMPQ, {rhs, lhsOpd});
+	code.emit(setOp, {X64Opd::reg(X64Reg::RAX, 1)});
+	code.emit(X64Inst::MOVZBQ, {X64Opd::reg(X64Reg::RAX, 1), work});
+}
+
+//The k for which val is 2^k, or -1 if there is none
+static int log2Exact(unsigned long long val){
+	if (val == 0 || (val & (val - 1)) != 0){ return -1; }
+	int k = 0;
+	while (val > 1){
+		val >>= 1;
+		k++;
+	}
+	return k;
+}
+
+//Multiply a register by c: shifts for powers of two, lea for
+// 3, 5 and 9, and the immediate form of imulq otherwise
+static void genMultConst(X64Code& code, long long c, const X64Opd& reg){
+	int shift = c > 0 ? log2Exact(static_cast<unsigned long long>(c)) : -1;
+	if (c == 0){
+		code.emit(X64Inst::MOVQ, {imm(0), reg});
+	} else if (c == -1){
+		code.emit(X64Inst::NEGQ, {reg});
+	} else if (shift == 0){
+		//Multiplying by 1 leaves the value as it is
+	} else if (shift > 0){
+		code.emit(X64Inst::SHLQ, {imm(shift), reg});
+	} else if (c == 3 || c == 5 || c == 9){
+		code.emit(X64Inst::LEAQ, {X64Opd::mem(reg.getReg(), 0, reg.getReg(),
+			static_cast<uint8_t>(c - 1)), reg});
+	} else {
+		code.emit(X64Inst::IMULQ, {imm(c), reg, reg});
+	}
 }
 
-void IntrinsicOutputQuad::codegenX64(std::ostream& out){
-	if (myType->isBool()){
-		myArg->genLoadVal(out, DI);
-		out << "callq printBool\n";
+//The multiplier and shift for dividing by d (with |d| >= 2 and
+// not a power of two) by a multiply-high, from Hacker's Delight
+// (Warren, section 10-3)
+static void divMagic(long long d, long long& magic, int& shift){
+	const unsigned long long two63 = 1ULL << 63;
+	unsigned long long ad = d < 0 ? 0 - static_cast<unsigned long long>(d)
+		: static_cast<unsigned long long>(d);
+	unsigned long long t = two63 + (static_cast<unsigned long long>(d) >> 63);
+	unsigned long long anc = t - 1 - t % ad;
+	int p = 63;
+	unsigned long long q1 = two63 / anc;
+	unsigned long long r1 = two63 - q1 * anc;
+	unsigned long long q2 = two63 / ad;
+	unsigned long long r2 = two63 - q2 * ad;
+	unsigned long long delta;
+	do {
+		p++;
+		q1 = 2 * q1;
+		r1 = 2 * r1;
+		if (r1 >= anc){
+			q1++;
+			r1 -= anc;
+		}
+		q2 = 2 * q2;
+		r2 = 2 * r2;
+		if (r2 >= ad){
+			q2++;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+	unsigned long long m = q2 + 1;
+	if (d < 0){ m = 0 - m; }
+	magic = static_cast<long long>(m);
+	shift = p - 64;
+}
+
+//Divide %rax by the constant d, which is neither 0 nor -1,
+// rounding toward zero like idivq does. A power of two is an
+// arithmetic shift, after adding 2^k-1 to negative dividends.
+// Anything else is a multiply-high by a magic number, a shift,
+// and a final correction of 1 for negative quotients.
+static void genDivConst(X64Code& code, long long d){
+	unsigned long long ad = d < 0 ? 0 - static_cast<unsigned long long>(d)
+		: static_cast<unsigned long long>(d);
+	int shift = log2Exact(ad);
+	if (shift == 0){ return; }
+	if (shift > 0){
+		code.emit(X64Inst::MOVQ, {full(A), full(D)});
+		code.emit(X64Inst::SARQ, {imm(63), full(D)});
+		code.emit(X64Inst::SHRQ, {imm(64 - shift), full(D)});
+		code.emit(X64Inst::ADDQ, {full(D), full(A)});
+		code.emit(X64Inst::SARQ, {imm(shift), full(A)});
+		if (d < 0){ code.emit(X64Inst::NEGQ, {full(A)}); }
+		return;
+	}
+	long long magic;
+	int magicShift;
+	divMagic(d, magic, magicShift);
+	code.emit(X64Inst::MOVQ, {full(A), full(C)});
+	code.emit(X64Inst::MOVABSQ, {imm(magic), full(D)});
+	code.emit(X64Inst::IMULQ, {full(D)});
+	if (d > 0 && magic < 0){ code.emit(X64Inst::ADDQ, {full(C), full(D)}); }
+	if (d < 0 && magic > 0){ code.emit(X64Inst::SUBQ, {full(C), full(D)}); }
+	if (magicShift > 0){ code.emit(X64Inst::SARQ, {imm(magicShift), full(D)}); }
+	code.emit(X64Inst::MOVQ, {full(D), full(A)});
+	code.emit(X64Inst::SHRQ, {imm(63), full(A)});
+	code.emit(X64Inst::ADDQ, {full(D), full(A)});
+}
+
+//Every operand occupies a full quadword (see Opd::width), so
+// the 8-bit operations are generated exactly like their
+// 64-bit counterparts. A literal right-hand operand is used
+// as an immediate (multiplication commutes, so a literal on
+// the left is swapped over), and multiplying or dividing by
+// a constant avoids imulq and idivq where it can. The result
+// is computed in the destination's register when it has one,
+// and otherwise in %rax, which idivq always needs.
+void BinOpQuad::codegenX64(X64Code& code){
+	bool isMult = opr == MULT64 || opr == MULT8;
+	bool isDiv = opr == DIV64 || opr == DIV8;
+	bool commutes = isMult || opr == ADD64 || opr == ADD8
+		|| opr == AND64 || opr == AND8 || opr == OR64 || opr == OR8;
+	Opd * lhs = src1;
+	Opd * rhs = src2;
+	long long val = 0;
+	if (isMult && !immValue(rhs, val) && immValue(lhs, val)){
+		std::swap(lhs, rhs);
+	}
+	X64Opd dstReg;
+	X64Opd loc;
+	bool inReg = !isDiv && valueReg(dst, dstReg);
+	//The left-hand operand is loaded into the destination's
+	// register, so a right-hand one living there goes first
+	if (inReg && commutes && readable(rhs, loc) && loc == dstReg){
+		std::swap(lhs, rhs);
+	}
+	//Dividing by a literal 0 still has to trap, and so does
+	// dividing the most negative value by -1
+	bool isImm = immValue(rhs, val) && !(isDiv && (val == 0 || val == -1));
+	X64Opd rhsOpd = imm(val);
+	if (!isImm && (!readable(rhs, rhsOpd) || (isDiv && rhsOpd.isImm()))){
+		genLoad(code, rhs, full(C));
+		rhsOpd = full(C);
+	}
+	X64Opd work = full(A);
+	if (inReg && (!(rhsOpd == dstReg)
+	  || (readable(lhs, loc) && loc == dstReg))){
+		work = dstReg;
+	}
+	bool isCompare = !isMult && !isDiv && !commutes
+		&& opr != SUB64 && opr != SUB8;
+	if (!isCompare){ genLoad(code, lhs, work); }
+	switch(opr){
+	case ADD64: case ADD8:
+		code.emit(X64Inst::ADDQ, {rhsOpd, work});
+		break;
+	case SUB64: case SUB8:
+		code.emit(X64Inst::SUBQ, {rhsOpd, work});
+		break;
+	case MULT64: case MULT8:
+		if (isImm){ genMultConst(code, val, work); }
+		else { code.emit(X64Inst::IMULQ, {rhsOpd, work}); }
+		break;
+	case DIV64: case DIV8:
+		if (isImm){
+			genDivConst(code, val);
+		} else {
+			code.emit(X64Inst::CQTO);
+			code.emit(X64Inst::IDIVQ, {rhsOpd});
+		}
+		break;
+	case AND64: case AND8:
+		code.emit(X64Inst::ANDQ, {rhsOpd, work});
+		break;
+	case OR64: case OR8:
+		code.emit(X64Inst::ORQ, {rhsOpd, work});
+		break;
+	case EQ64: case EQ8:
+		genCompare(code, lhs, rhsOpd, X64Inst::SETE, work);
+		break;
+	case NEQ64: case NEQ8:
+		genCompare(code, lhs, rhsOpd, X64Inst::SETNE, work);
+		break;
+	case LT64: case LT8:
+		genCompare(code, lhs, rhsOpd, X64Inst::SETL, work);
+		break;
+	case GT64: case GT8:
+		genCompare(code, lhs, rhsOpd, X64Inst::SETG, work);
+		break;
+	case LTE64: case LTE8:
+		genCompare(code, lhs, rhsOpd, X64Inst::SETLE, work);
+		break;
+	case GTE64: case GTE8:
+		genCompare(code, lhs, rhsOpd, X64Inst::SETGE, work);
+		break;
+	}
+	genStore(code, dst, work);
+}
+
+void UnaryOpQuad::codegenX64(X64Code& code){
+	X64Opd work = full(A);
+	valueReg(dst, work);
+	genLoad(code, src, work);
+	switch(op){
+	case NEG64: case NEG8:
+		code.emit(X64Inst::NEGQ, {work});
+		break;
+	case NOT64: case NOT8:
+		//Booleans are always 0 or 1
+		code.emit(X64Inst::XORQ, {imm(1), work});
+		break;
+	}
+	genStore(code, dst, work);
+}
+
+//A register or immediate is stored as it is; only memory to
+// memory goes through %rax
+void AssignQuad::codegenX64(X64Code& code){
+	X64Opd dstReg;
+	X64Opd srcOpd;
+	if (valueReg(dst, dstReg)){
+		genLoad(code, src, dstReg);
+	} else if (readable(src, srcOpd) && !srcOpd.isMem()){
+		genStore(code, dst, srcOpd);
 	} else {
-		TODO(Implement me)
+		genLoad(code, src, full(A));
+		genStore(code, dst, full(A));
+	}
+}
+
+void GotoQuad::codegenX64(X64Code& code){
+	code.emit(X64Inst::JMP, {X64Opd::label(tgt->getName())});
+}
 
+//The jump taken when the comparison is false
+static X64Inst::Op negatedJump(BinOp cmp){
+	switch(cmp){
+	case EQ64: case EQ8: return X64Inst::JNE;
+	case NEQ64: case NEQ8: return X64Inst::JE;
+	case LT64: case LT8: return X64Inst::JGE;
+	case GT64: case GT8: return X64Inst::JLE;
+	case LTE64: case LTE8: return X64Inst::JG;
+	case GTE64: case GTE8: return X64Inst::JL;
+	default:
+		throw new InternalError("Fused IFZ on a non-comparison");
 	}
 }
 
-void IntrinsicInputQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+void IfzQuad::codegenX64(X64Code& code){
+	X64Opd target = X64Opd::label(tgt->getName());
+	if (isFused()){
+		X64Opd rhs;
+		if (!readable(src2, rhs)){
+			genLoad(code, src2, full(C));
+			rhs = full(C);
+		}
+		X64Opd lhs;
+		if (!readable(src1, lhs) || lhs.isImm() || (lhs.isMem() && rhs.isMem())){
+			genLoad(code, src1, full(A));
+			lhs = full(A);
+		}
+		code.emit(X64Inst::CMPQ, {rhs, lhs});
+		code.emit(negatedJump(cmp), {target});
+		return;
+	}
+	X64Opd cndOpd;
+	if (!readable(cnd, cndOpd) || cndOpd.isImm()){
+		genLoad(code, cnd, full(A));
+		cndOpd = full(A);
+	}
+	code.emit(X64Inst::CMPQ, {imm(0), cndOpd});
+	code.emit(X64Inst::JE, {target});
 }
 
-void CallQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+void NopQuad::codegenX64(X64Code& code){
+	code.emit(X64Inst::NOP);
 }
 
-void EnterQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+void PhiQuad::codegenX64(X64Code& code){
+	throw new InternalError("Phi left in the procedure (fromSSA not run)");
 }
 
-void LeaveQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+void IntrinsicOutputQuad::codegenX64(X64Code& code){
+	myArg->genLoadVal(code, DI);
+	if (myType->isBool()){
+		code.emit(X64Inst::CALLQ, {X64Opd::label("printBool")});
+	} else if (myType->isString()){
+		code.emit(X64Inst::CALLQ, {X64Opd::label("printString")});
+	} else {
+		//ints and shorts
+		code.emit(X64Inst::CALLQ, {X64Opd::label("printInt")});
+	}
 }
 
-void SetArgQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+void IntrinsicInputQuad::codegenX64(X64Code& code){
+	if (myType->isBool()){
+		code.emit(X64Inst::CALLQ, {X64Opd::label("getBool")});
+	} else if (myType->isString()){
+		throw new InternalError("Cannot read a string");
+	} else {
+		//ints and shorts
+		code.emit(X64Inst::CALLQ, {X64Opd::label("getInt")});
+	}
+	myArg->genStoreVal(code, A);
 }
 
-void GetArgQuad::codegenX64(std::ostream& out){
-	//We don't actually need to do anything here
+void CallQuad::codegenX64(X64Code& code){
+	code.emit(X64Inst::CALLQ,
+		{X64Opd::label(Procedure::entryName(callee->getName()))});
 }
 
-void SetRetQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+void EnterQuad::codegenX64(X64Code& code){
+	X64Opd rbp = X64Opd::reg(X64Reg::RBP);
+	X64Opd rsp = X64Opd::reg(X64Reg::RSP);
+	code.emit(X64Inst::PUSHQ, {rbp});
+	code.emit(X64Inst::MOVQ, {rsp, rbp});
+	if (myProc->frameBytes() > 0){
+		code.emit(X64Inst::SUBQ,
+			{imm(static_cast<long long>(myProc->frameBytes())), rsp});
+	}
+	size_t offset = 0;
+	for (Register reg : myProc->getSavedRegs()){
+		code.emit(X64Inst::MOVQ, {full(reg), slotLoc(offset)});
+	}
 }
 
-void GetRetQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+//Restore the callee-saved registers and pop the frame,
+// leaving %rsp at the return address
+static void genTeardown(X64Code& code, Procedure * proc){
+	size_t offset = 0;
+	for (Register reg : proc->getSavedRegs()){
+		code.emit(X64Inst::MOVQ, {slotLoc(offset), full(reg)});
+	}
+	code.emit(X64Inst::MOVQ,
+		{X64Opd::reg(X64Reg::RBP), X64Opd::reg(X64Reg::RSP)});
+	code.emit(X64Inst::POPQ, {X64Opd::reg(X64Reg::RBP)});
 }
 
-void LocQuad::codegenX64(std::ostream& out){
-	TODO(Implement me)
+void LeaveQuad::codegenX64(X64Code& code){
+	genTeardown(code, myProc);
+	code.emit(X64Inst::RETQ);
 }
 
-void SymOpd::genLoadVal(std::ostream& out, Register reg){
-	TODO(Implement me)
+//The arguments are already in their registers, and the
+// callee finds the stack just as the caller found it
+void TailCallQuad::codegenX64(X64Code& code){
+	genTeardown(code, myProc);
+	code.emit(X64Inst::JMP,
+		{X64Opd::label(Procedure::entryName(callee->getName()))});
 }
 
-void SymOpd::genStoreVal(std::ostream& out, Register reg){
-	TODO(Implement me)
+//Arguments past the sixth are written to the bottom of the
+// caller's frame, where the callee finds them just above
+// its return address
+void SetArgQuad::codegenX64(X64Code& code){
+	if (index <= RegUtils::REG_ARGS){
+		genLoad(code, opd, full(RegUtils::argReg(index)));
+	} else {
+		X64Opd src;
+		if (!readable(opd, src) || src.isMem()){
+			genLoad(code, opd, full(A));
+			src = full(A);
+		}
+		size_t offset = 8 * (index - RegUtils::REG_ARGS - 1);
+		code.emit(X64Inst::MOVQ, {src,
+			X64Opd::mem(X64Reg::RSP, static_cast<int64_t>(offset))});
+	}
 }
 
-void SymOpd::genLoadAddr(std::ostream& out, Register reg) {
-	TODO(Implement me if necessary)
+void GetArgQuad::codegenX64(X64Code& code){
+	if (index <= RegUtils::REG_ARGS){
+		opd->genStoreVal(code, RegUtils::argReg(index));
+	} else {
+		X64Opd work = full(A);
+		valueReg(opd, work);
+		size_t offset = 16 + 8 * (index - RegUtils::REG_ARGS - 1);
+		code.emit(X64Inst::MOVQ, {
+			X64Opd::mem(X64Reg::RBP, static_cast<int64_t>(offset)), work});
+		genStore(code, opd, work);
+	}
 }
 
-void AuxOpd::genLoadVal(std::ostream& out, Register reg){
-	TODO(Implement me)
+void SetRetQuad::codegenX64(X64Code& code){
+	opd->genLoadVal(code, A);
 }
 
-void AuxOpd::genStoreVal(std::ostream& out, Register reg){
-	TODO(Implement me)
+void GetRetQuad::codegenX64(X64Code& code){
+	opd->genStoreVal(code, A);
 }
-void AuxOpd::genLoadAddr(std::ostream& out, Register reg){
-	TODO(Implement me)
+
+//The address (or value) lands directly in the target's
+// register when it has one
+void LocQuad::codegenX64(X64Code& code){
+	X64Opd work = full(A);
+	if (tgtIsLoc){
+		AddrOpd * addr = tgt->asAddr();
+		if (addr != nullptr && addr->getMemoryLoc().isReg()){
+			work = addr->getMemoryLoc();
+		}
+	} else {
+		valueReg(tgt, work);
+	}
+	if (srcIsLoc && work.getReg() == X64Reg::RAX){
+		src->genLoadAddr(code, A);
+	} else if (srcIsLoc){
+		X64Inst::Op op = src->asAddr() ? X64Inst::MOVQ : X64Inst::LEAQ;
+		code.emit(op, {src->getMemoryLoc(), work});
+	} else {
+		genLoad(code, src, work);
+	}
+	if (work.getReg() != X64Reg::RAX){ return; }
+	if (tgtIsLoc){
+		tgt->genStoreAddr(code, A);
+	} else {
+		tgt->genStoreVal(code, A);
+	}
 }
 
+//The memory location of an operand is either a stack slot,
+// a global label, or (when registers are allocated) a
+// register, so plain moves work for all of them
+void SymOpd::genLoadVal(X64Code& code, Register reg){
+	code.emit(X64Inst::MOVQ, {getMemoryLoc(), full(reg)});
+}
+
+void SymOpd::genStoreVal(X64Code& code, Register reg){
+	code.emit(X64Inst::MOVQ, {full(reg), getMemoryLoc()});
+}
+
+void SymOpd::genLoadAddr(X64Code& code, Register reg) {
+	code.emit(X64Inst::LEAQ, {getMemoryLoc(), full(reg)});
+}
+
+void AuxOpd::genLoadVal(X64Code& code, Register reg){
+	code.emit(X64Inst::MOVQ, {getMemoryLoc(), full(reg)});
+}
+
+void AuxOpd::genStoreVal(X64Code& code, Register reg){
+	code.emit(X64Inst::MOVQ, {full(reg), getMemoryLoc()});
+}
+void AuxOpd::genLoadAddr(X64Code& code, Register reg){
+	code.emit(X64Inst::LEAQ, {getMemoryLoc(), full(reg)});
+}
 
-void AddrOpd::genStoreVal(std::ostream& out, Register reg){
-	TODO(Implement me)
+//An AddrOpd's location holds an address; its value is the
+// memory at that address. %r11 is never allocated, so it
+// is free to hold the address during a store.
+void AddrOpd::genStoreVal(X64Code& code, Register reg){
+	code.emit(X64Inst::MOVQ, {getMemoryLoc(), full(R11)});
+	code.emit(X64Inst::MOVQ, {full(reg), X64Opd::mem(X64Reg::R11, 0)});
 }
 
-void AddrOpd::genLoadVal(std::ostream& out, Register reg){
-	TODO(Implement me)
+void AddrOpd::genLoadVal(X64Code& code, Register reg){
+	code.emit(X64Inst::MOVQ, {getMemoryLoc(), full(reg)});
+	code.emit(X64Inst::MOVQ,
+		{X64Opd::mem(RegUtils::x64Reg(reg), 0), full(reg)});
 }
 
-void AddrOpd::genStoreAddr(std::ostream& out, Register reg){
-	TODO(Implement me)
+void AddrOpd::genStoreAddr(X64Code& code, Register reg){
+	code.emit(X64Inst::MOVQ, {full(reg), getMemoryLoc()});
 }
 
-void AddrOpd::genLoadAddr(std::ostream & out, Register reg){
-	TODO(Implement me)
+void AddrOpd::genLoadAddr(X64Code& code, Register reg){
+	code.emit(X64Inst::MOVQ, {getMemoryLoc(), full(reg)});
 }
 
-void LitOpd::genLoadVal(std::ostream & out, Register reg){
-	out << getMovOp() << " $" << val << ", " << getReg(reg) << "\n";
+//String literals are the labels of their bytes
+void LitOpd::genLoadVal(X64Code& code, Register reg){
+	char * end = nullptr;
+	long long num = std::strtoll(val.c_str(), &end, 10);
+	bool isNum = !val.empty() && *end == '\0';
+	code.emit(X64Inst::MOVQ,
+		{isNum ? imm(num) : X64Opd::addrOf(val), full(reg)});
 }
 
 }
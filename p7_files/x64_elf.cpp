@@ -0,0 +1,543 @@
+#include "3ac.hpp"
+#include "x64.hpp"
+
+namespace cminusminus{
+
+// Machine code and ELF output for X64Code. The encoder knows the
+// instructions that codegen and the peephole pass produce, in the
+// forms they produce them:
+//
+//  - two-operand arithmetic, moves and compares between registers,
+//    memory and immediates (addq, subq, andq, orq, xorq, cmpq,
+//    movq, and xorl), and leaq
+//  - movabsq and movzbq, one-, two- and three-operand imulq,
+//    idivq, negq, cqto, and shifts by a constant or %cl
+//  - pushq, popq, setCC, jCC, jmp, callq, retq and nop
+//
+// Memory operands are disp(base), disp(base,index,scale), or
+// label(%rip). Jumps always take a 32-bit displacement, so the
+// size of each instruction is known as soon as it is encoded.
+// References within .text are patched in place once all of the
+// code is in; anything else becomes a relocation, as the
+// assembler would have left it.
+
+static void put(std::string& buf, uint64_t val, size_t bytes){
+	for (size_t i = 0; i < bytes; i++){
+		buf += static_cast<char>((val >> (8 * i)) & 0xff);
+	}
+}
+
+static void patch(std::string& buf, size_t offset, uint64_t val, size_t bytes){
+	for (size_t i = 0; i < bytes; i++){
+		buf[offset + i] = static_cast<char>((val >> (8 * i)) & 0xff);
+	}
+}
+
+static bool fitsIn8(long long val){ return val >= -128 && val <= 127; }
+static bool fitsIn32(long long val){
+	return val >= INT32_MIN && val <= INT32_MAX;
+}
+
+static InternalError * badInst(const X64Inst& inst){
+	return new InternalError(("cannot encode " + inst.toString()).c_str());
+}
+
+//Registers are numbered as in the encoding
+static int regNum(X64Reg reg){ return static_cast<int>(reg); }
+
+//The condition code of a jCC or setCC
+static uint8_t condCode(X64Inst::Op op){
+	switch (op){
+	case X64Inst::JE: case X64Inst::SETE: return 4;
+	case X64Inst::JNE: case X64Inst::SETNE: return 5;
+	case X64Inst::JL: case X64Inst::SETL: return 12;
+	case X64Inst::JGE: case X64Inst::SETGE: return 13;
+	case X64Inst::JLE: case X64Inst::SETLE: return 14;
+	case X64Inst::JG: case X64Inst::SETG: return 15;
+	default:
+		throw new InternalError("No condition code");
+	}
+}
+
+//Registers 4 through 7 are %spl..%dil as byte registers only
+// when there is a REX prefix, and %ah..%bh otherwise
+static bool needsRex(const X64Opd& opd){
+	int num = regNum(opd.getReg());
+	return opd.isReg() && opd.getSize() == 1 && num >= 4 && num < 8;
+}
+
+void ObjectFile::define(const std::string& name, Section section,
+  size_t offset){
+	size_t idx = symbolIdx(name);
+	if (symbols[idx].section != UNDEF){
+		throw new InternalError(("duplicate symbol " + name).c_str());
+	}
+	symbols[idx].section = section;
+	symbols[idx].offset = offset;
+}
+
+size_t ObjectFile::symbolIdx(const std::string& name){
+	auto found = symbolIdxs.find(name);
+	if (found != symbolIdxs.end()){ return found->second; }
+	symbolIdxs[name] = symbols.size();
+	symbols.push_back(Symbol{name, UNDEF, 0, false});
+	return symbols.size() - 1;
+}
+
+void ObjectFile::addData(const std::string& name, size_t size){
+	define(name, DATA, data.size());
+	data.append(size, '\0');
+}
+
+void ObjectFile::addString(const std::string& name,
+  const std::string& bytes){
+	define(name, RODATA, rodata.size());
+	rodata += bytes;
+	rodata += '\0';
+}
+
+void ObjectFile::setGlobal(const std::string& name){
+	symbols[symbolIdx(name)].global = true;
+}
+
+//Encode an instruction with a ModRM byte: the opcode, regField
+// in the reg field, and rm as the register or memory operand.
+// immBytes is the size of the immediate to follow, which moves
+// where %rip points.
+void ObjectFile::encodeRM(const std::vector<uint8_t>& opcode,
+  int regField, const X64Opd& rm, bool wide, size_t immBytes){
+	bool isMem = rm.isMem();
+	bool rip = isMem && rm.getReg() == X64Reg::RIP;
+	bool hasIndex = isMem && rm.getIndex() != X64Reg::NONE;
+	int base = regNum(rm.getReg());
+	int index = regNum(rm.getIndex());
+	int64_t disp = rm.getVal();
+	uint8_t rex = 0x40;
+	if (wide){ rex |= 0x08; }
+	if (regField >= 8){ rex |= 0x04; }
+	if (hasIndex && index >= 8){ rex |= 0x02; }
+	if (!rip && base >= 8){ rex |= 0x01; }
+	if (rex != 0x40 || needsRex(rm)){
+		text += static_cast<char>(rex);
+	}
+	for (uint8_t byte : opcode){ text += static_cast<char>(byte); }
+
+	uint8_t regBits = static_cast<uint8_t>((regField & 7) << 3);
+	if (!isMem){
+		text += static_cast<char>(0xc0 | regBits | (base & 7));
+		return;
+	}
+	if (rip){
+		text += static_cast<char>(0x05 | regBits);
+		size_t at = text.size();
+		put(text, static_cast<uint64_t>(disp), 4);
+		int64_t addend = disp - 4 - static_cast<int64_t>(immBytes);
+		fixups.push_back(Fixup{at, rm.getSym(), R_X86_64_PC32, addend});
+		return;
+	}
+
+	//%rbp and %r13 as a base always take a displacement, and
+	// %rsp and %r12 take a SIB byte
+	uint8_t mod = 0x80;
+	if (disp == 0 && (base & 7) != 5){ mod = 0x00; }
+	else if (fitsIn8(disp)){ mod = 0x40; }
+	if (hasIndex || (base & 7) == 4){
+		uint8_t scale = rm.getScale();
+		uint8_t scaleBits = scale == 8 ? 3 : scale == 4 ? 2
+			: scale == 2 ? 1 : 0;
+		int indexBits = hasIndex ? index & 7 : 4;
+		text += static_cast<char>(mod | regBits | 0x04);
+		text += static_cast<char>((scaleBits << 6) | (indexBits << 3) | (base & 7));
+	} else {
+		text += static_cast<char>(mod | regBits | (base & 7));
+	}
+	if (mod == 0x40){ put(text, static_cast<uint64_t>(disp), 1); }
+	if (mod == 0x80){ put(text, static_cast<uint64_t>(disp), 4); }
+}
+
+void ObjectFile::encodeImm(const X64Opd& imm, size_t bytes){
+	if (!imm.getSym().empty()){
+		fixups.push_back(Fixup{text.size(), imm.getSym(), R_X86_64_32S,
+			imm.getVal()});
+	}
+	put(text, static_cast<uint64_t>(imm.getVal()), bytes);
+}
+
+//A 32-bit displacement to the target, from the end of the
+// instruction it ends
+void ObjectFile::encodeRel(const std::string& target){
+	fixups.push_back(Fixup{text.size(), target, R_X86_64_PLT32, -4});
+	put(text, 0, 4);
+}
+
+//The /digit in the reg field that picks the operation, for the
+// group opcodes
+static int aluExt(X64Inst::Op op){
+	switch (op){
+	case X64Inst::ADDQ: return 0;
+	case X64Inst::ORQ: return 1;
+	case X64Inst::ANDQ: return 4;
+	case X64Inst::SUBQ: return 5;
+	case X64Inst::XORQ: case X64Inst::XORL: return 6;
+	case X64Inst::CMPQ: return 7;
+	default: return -1;
+	}
+}
+
+static int shiftExt(X64Inst::Op op){
+	switch (op){
+	case X64Inst::SHLQ: return 4;
+	case X64Inst::SHRQ: return 5;
+	case X64Inst::SARQ: return 7;
+	default: return -1;
+	}
+}
+
+static int unaryExt(X64Inst::Op op, size_t numOpds){
+	switch (op){
+	case X64Inst::NEGQ: return 3;
+	case X64Inst::IMULQ: return numOpds == 1 ? 5 : -1;
+	case X64Inst::IDIVQ: return 7;
+	default: return -1;
+	}
+}
+
+void ObjectFile::encode(const X64Inst& inst){
+	X64Inst::Op op = inst.getOp();
+	size_t numOpds = inst.numOpds();
+	const X64Opd none;
+	const X64Opd& opd0 = numOpds > 0 ? inst.getOpd(0) : none;
+	const X64Opd& opd1 = numOpds > 1 ? inst.getOpd(1) : none;
+	const X64Opd& opd2 = numOpds > 2 ? inst.getOpd(2) : none;
+	auto isRM = [](const X64Opd& opd){ return opd.isReg() || opd.isMem(); };
+	//A number that fits the immediate, rather than an address
+	// left to a relocation
+	auto immFits = [](const X64Opd& opd, size_t bytes){
+		return bytes == 1 ? fitsIn8(opd.getVal()) && opd.getSym().empty()
+			: fitsIn32(opd.getVal());
+	};
+
+	switch (op){
+	//No operands
+	case X64Inst::RETQ: text += '\xc3'; return;
+	case X64Inst::NOP: text += '\x90'; return;
+	case X64Inst::CQTO: text += "\x48\x99"; return;
+
+	//Control transfers
+	case X64Inst::JMP: case X64Inst::CALLQ:
+	case X64Inst::JE: case X64Inst::JNE: case X64Inst::JL:
+	case X64Inst::JG: case X64Inst::JLE: case X64Inst::JGE:
+		if (numOpds != 1 || !opd0.isLabel()){ throw badInst(inst); }
+		if (op == X64Inst::JMP){
+			text += '\xe9';
+		} else if (op == X64Inst::CALLQ){
+			text += '\xe8';
+		} else {
+			text += '\x0f';
+			text += static_cast<char>(0x80 + condCode(op));
+		}
+		encodeRel(opd0.getSym());
+		return;
+	case X64Inst::SETE: case X64Inst::SETNE: case X64Inst::SETL:
+	case X64Inst::SETG: case X64Inst::SETLE: case X64Inst::SETGE:
+		if (numOpds != 1 || !isRM(opd0)
+		  || (opd0.isReg() && opd0.getSize() != 1)){
+			throw badInst(inst);
+		}
+		encodeRM({0x0f, static_cast<uint8_t>(0x90 + condCode(op))}, 0, opd0,
+			false, 0);
+		return;
+
+	case X64Inst::PUSHQ: case X64Inst::POPQ:
+		if (numOpds != 1 || !opd0.isReg() || opd0.getSize() != 8){
+			throw badInst(inst);
+		}
+		if (regNum(opd0.getReg()) >= 8){ text += '\x41'; }
+		text += static_cast<char>((op == X64Inst::PUSHQ ? 0x50 : 0x58)
+			+ (regNum(opd0.getReg()) & 7));
+		return;
+
+	case X64Inst::MOVABSQ:
+		if (numOpds != 2 || !opd0.isImm() || !opd0.getSym().empty()
+		  || !opd1.isReg() || opd1.getSize() != 8){
+			throw badInst(inst);
+		}
+		text += static_cast<char>(regNum(opd1.getReg()) >= 8 ? 0x49 : 0x48);
+		text += static_cast<char>(0xb8 + (regNum(opd1.getReg()) & 7));
+		put(text, static_cast<uint64_t>(opd0.getVal()), 8);
+		return;
+	case X64Inst::MOVZBQ:
+		if (numOpds != 2 || !isRM(opd0) || (opd0.isReg() && opd0.getSize() != 1)
+		  || !opd1.isReg() || opd1.getSize() != 8){
+			throw badInst(inst);
+		}
+		encodeRM({0x0f, 0xb6}, regNum(opd1.getReg()), opd0, true, 0);
+		return;
+	case X64Inst::LEAQ:
+		if (numOpds != 2 || !opd0.isMem() || !opd1.isReg()
+		  || opd1.getSize() != 8){
+			throw badInst(inst);
+		}
+		encodeRM({0x8d}, regNum(opd1.getReg()), opd0, true, 0);
+		return;
+	default:
+		break;
+	}
+
+	//The rest are sized by their suffix. Apart from a shift
+	// count in %cl, registers are that size.
+	size_t size = op == X64Inst::XORL ? 4 : 8;
+	bool wide = size == 8;
+	int shift = shiftExt(op);
+	for (size_t i = 0; i < numOpds; i++){
+		const X64Opd& opd = inst.getOpd(i);
+		bool count = shift >= 0 && i == 0;
+		if (opd.isReg() && opd.getSize() != size && !count){
+			throw badInst(inst);
+		}
+	}
+
+	//Single operand, in the group 3 opcode
+	int unary = unaryExt(op, numOpds);
+	if (unary >= 0 && numOpds == 1 && isRM(opd0)){
+		encodeRM({0xf7}, unary, opd0, wide, 0);
+		return;
+	}
+	if (op == X64Inst::IMULQ){
+		if (numOpds == 2 && isRM(opd0) && opd1.isReg()){
+			encodeRM({0x0f, 0xaf}, regNum(opd1.getReg()), opd0, wide, 0);
+			return;
+		}
+		if (numOpds == 3 && opd0.isImm() && immFits(opd0, 4) && isRM(opd1)
+		  && opd2.isReg()){
+			bool small = immFits(opd0, 1);
+			encodeRM({static_cast<uint8_t>(small ? 0x6b : 0x69)},
+				regNum(opd2.getReg()), opd1, wide, small ? 1 : 4);
+			encodeImm(opd0, small ? 1 : 4);
+			return;
+		}
+	}
+
+	if (shift >= 0 && numOpds == 2 && isRM(opd1)){
+		if (opd0.isReg() && opd0.getReg() == X64Reg::RCX
+		  && opd0.getSize() == 1){
+			encodeRM({0xd3}, shift, opd1, wide, 0);
+			return;
+		}
+		if (opd0.isImm() && opd0.getSym().empty()){
+			encodeRM({0xc1}, shift, opd1, wide, 1);
+			encodeImm(opd0, 1);
+			return;
+		}
+	}
+
+	int alu = aluExt(op);
+	if (alu >= 0 && numOpds == 2 && isRM(opd1)){
+		uint8_t opBase = static_cast<uint8_t>(alu * 8);
+		if (opd0.isImm()){
+			if (!immFits(opd0, 4)){ throw badInst(inst); }
+			bool small = immFits(opd0, 1);
+			size_t bytes = small ? 1 : 4;
+			encodeRM({static_cast<uint8_t>(small ? 0x83 : 0x81)}, alu, opd1,
+				wide, bytes);
+			encodeImm(opd0, bytes);
+			return;
+		}
+		if (opd0.isReg()){
+			encodeRM({static_cast<uint8_t>(opBase + 1)}, regNum(opd0.getReg()),
+				opd1, wide, 0);
+			return;
+		}
+		if (isRM(opd0) && opd1.isReg()){
+			encodeRM({static_cast<uint8_t>(opBase + 3)}, regNum(opd1.getReg()),
+				opd0, wide, 0);
+			return;
+		}
+	}
+
+	if (op == X64Inst::MOVQ && numOpds == 2 && isRM(opd1)){
+		if (opd0.isImm()){
+			//An immediate too big for the sign-extended form
+			// takes movabsq's
+			if (opd0.getSym().empty() && !immFits(opd0, 4) && opd1.isReg()){
+				text += static_cast<char>(regNum(opd1.getReg()) >= 8 ? 0x49 : 0x48);
+				text += static_cast<char>(0xb8 + (regNum(opd1.getReg()) & 7));
+				put(text, static_cast<uint64_t>(opd0.getVal()), 8);
+				return;
+			}
+			if (!immFits(opd0, 4)){ throw badInst(inst); }
+			encodeRM({0xc7}, 0, opd1, wide, 4);
+			encodeImm(opd0, 4);
+			return;
+		}
+		if (opd0.isReg()){
+			encodeRM({0x89}, regNum(opd0.getReg()), opd1, wide, 0);
+			return;
+		}
+		if (opd1.isReg()){
+			encodeRM({0x8b}, regNum(opd1.getReg()), opd0, wide, 0);
+			return;
+		}
+	}
+	throw badInst(inst);
+}
+
+void ObjectFile::addCode(const X64Code& code){
+	for (const X64Inst& inst : code.getInsts()){
+		if (inst.isLabel()){
+			define(inst.getText(), TEXT, text.size());
+		} else if (inst.isInstr()){
+			encode(inst);
+		}
+	}
+}
+
+//ELF constants, from the System V ABI
+static const uint32_t SHT_PROGBITS = 1;
+static const uint32_t SHT_SYMTAB = 2;
+static const uint32_t SHT_STRTAB = 3;
+static const uint32_t SHT_RELA = 4;
+static const uint64_t SHF_WRITE = 0x1;
+static const uint64_t SHF_ALLOC = 0x2;
+static const uint64_t SHF_EXECINSTR = 0x4;
+static const uint64_t SHF_INFO_LINK = 0x40;
+
+//Add a name to a string table, returning its offset
+static uint32_t addName(std::string& table, const std::string& name){
+	uint32_t offset = static_cast<uint32_t>(table.size());
+	table += name;
+	table += '\0';
+	return offset;
+}
+
+void ObjectFile::write(std::ostream& out){
+	//Section indices in the header table
+	enum { SEC_NULL, SEC_TEXT, SEC_DATA, SEC_RODATA, SEC_STACK, SEC_SYMTAB,
+		SEC_STRTAB, SEC_RELA, SEC_SHSTRTAB, NUM_SECTIONS };
+	const uint16_t sectionIdx[] = {0, SEC_TEXT, SEC_DATA, SEC_RODATA};
+
+	//Local symbols have to come before the global ones, and
+	// anything referred to but not defined is global
+	for (const Fixup& fixup : fixups){ symbolIdx(fixup.sym); }
+	std::string strtab(1, '\0');
+	std::string symtab(24, '\0');
+	std::vector<size_t> order;
+	for (size_t i = 0; i < symbols.size(); i++){
+		if (!symbols[i].global && symbols[i].section != UNDEF){ order.push_back(i); }
+	}
+	size_t firstGlobal = order.size() + 1;
+	for (size_t i = 0; i < symbols.size(); i++){
+		if (symbols[i].global || symbols[i].section == UNDEF){ order.push_back(i); }
+	}
+	std::vector<size_t> elfIdx(symbols.size());
+	for (size_t i = 0; i < order.size(); i++){
+		const Symbol& sym = symbols[order[i]];
+		elfIdx[order[i]] = i + 1;
+		bool global = sym.global || sym.section == UNDEF;
+		put(symtab, addName(strtab, sym.name), 4);
+		put(symtab, global ? 0x10 : 0x00, 1);
+		put(symtab, 0, 1);
+		put(symtab, sectionIdx[sym.section], 2);
+		put(symtab, sym.offset, 8);
+		put(symtab, 0, 8);
+	}
+
+	//References within .text are filled in here; the rest are
+	// up to the linker
+	std::string code = text;
+	std::string rela;
+	for (const Fixup& fixup : fixups){
+		const Symbol& sym = symbols[symbolIdx(fixup.sym)];
+		bool pcRel = fixup.type != R_X86_64_32S;
+		if (sym.section == TEXT && pcRel){
+			int64_t rel = static_cast<int64_t>(sym.offset) + fixup.addend
+				- static_cast<int64_t>(fixup.offset);
+			patch(code, fixup.offset, static_cast<uint64_t>(rel), 4);
+			continue;
+		}
+		put(rela, fixup.offset, 8);
+		put(rela, (static_cast<uint64_t>(elfIdx[symbolIdx(fixup.sym)]) << 32)
+			| fixup.type, 8);
+		put(rela, static_cast<uint64_t>(fixup.addend), 8);
+	}
+
+	std::string shstrtab(1, '\0');
+	struct Header{
+		uint32_t name;
+		uint32_t type;
+		uint64_t flags;
+		const std::string * contents;
+		uint32_t link;
+		uint32_t info;
+		uint64_t align;
+		uint64_t entSize;
+	};
+	std::string empty;
+	Header headers[NUM_SECTIONS] = {
+		{0, 0, 0, &empty, 0, 0, 0, 0},
+		{addName(shstrtab, ".text"), SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR,
+			&code, 0, 0, 16, 0},
+		{addName(shstrtab, ".data"), SHT_PROGBITS, SHF_WRITE | SHF_ALLOC,
+			&data, 0, 0, 8, 0},
+		{addName(shstrtab, ".rodata"), SHT_PROGBITS, SHF_ALLOC,
+			&rodata, 0, 0, 1, 0},
+		{addName(shstrtab, ".note.GNU-stack"), SHT_PROGBITS, 0,
+			&empty, 0, 0, 1, 0},
+		{addName(shstrtab, ".symtab"), SHT_SYMTAB, 0,
+			&symtab, SEC_STRTAB, static_cast<uint32_t>(firstGlobal), 8, 24},
+		{addName(shstrtab, ".strtab"), SHT_STRTAB, 0, &strtab, 0, 0, 1, 0},
+		{addName(shstrtab, ".rela.text"), SHT_RELA, SHF_INFO_LINK,
+			&rela, SEC_SYMTAB, SEC_TEXT, 8, 24},
+		{0, SHT_STRTAB, 0, &shstrtab, 0, 0, 1, 0},
+	};
+	headers[SEC_SHSTRTAB].name = addName(shstrtab, ".shstrtab");
+
+	//The file header, then each section's contents, then the
+	// section header table
+	std::string file;
+	file += "\x7f" "ELF";
+	put(file, 2, 1);  // 64-bit
+	put(file, 1, 1);  // little-endian
+	put(file, 1, 1);  // version
+	file.append(9, '\0');
+	put(file, 1, 2);  // relocatable
+	put(file, 62, 2); // x86-64
+	put(file, 1, 4);
+	put(file, 0, 8);
+	put(file, 0, 8);
+	size_t shoffAt = file.size();
+	put(file, 0, 8);
+	put(file, 0, 4);
+	put(file, 64, 2);
+	put(file, 0, 2);
+	put(file, 0, 2);
+	put(file, 64, 2);
+	put(file, NUM_SECTIONS, 2);
+	put(file, SEC_SHSTRTAB, 2);
+
+	std::vector<uint64_t> offsets(NUM_SECTIONS, 0);
+	for (size_t s = 1; s < NUM_SECTIONS; s++){
+		uint64_t align = headers[s].align;
+		while (file.size() % align != 0){ file += '\0'; }
+		offsets[s] = file.size();
+		file += *headers[s].contents;
+	}
+	while (file.size() % 8 != 0){ file += '\0'; }
+	patch(file, shoffAt, file.size(), 8);
+	for (size_t s = 0; s < NUM_SECTIONS; s++){
+		const Header& header = headers[s];
+		put(file, header.name, 4);
+		put(file, header.type, 4);
+		put(file, header.flags, 8);
+		put(file, 0, 8);
+		put(file, offsets[s], 8);
+		put(file, header.contents->size(), 8);
+		put(file, header.link, 4);
+		put(file, header.info, 4);
+		put(file, header.align, 8);
+		put(file, header.entSize, 8);
+	}
+	out.write(file.data(), static_cast<std::streamsize>(file.size()));
+}
+
+}
@@ -0,0 +1,178 @@
+#include "errors.hpp"
+#include "x64.hpp"
+
+namespace cminusminus{
+
+// Building and printing the instructions that codegen emits.
+// Printing gives the AT&T syntax that the assembler reads.
+
+X64Opd X64Opd::reg(X64Reg reg, uint8_t size){
+	X64Opd opd;
+	opd.kind = REG;
+	opd.base = reg;
+	opd.size = size;
+	return opd;
+}
+
+X64Opd X64Opd::imm(int64_t val){
+	X64Opd opd;
+	opd.kind = IMM;
+	opd.val = val;
+	return opd;
+}
+
+X64Opd X64Opd::addrOf(const std::string& sym){
+	X64Opd opd;
+	opd.kind = IMM;
+	opd.sym = sym;
+	return opd;
+}
+
+X64Opd X64Opd::mem(X64Reg base, int64_t disp, X64Reg index,
+  uint8_t scale){
+	X64Opd opd;
+	opd.kind = MEM;
+	opd.base = base;
+	opd.val = disp;
+	opd.index = index;
+	opd.scale = scale;
+	return opd;
+}
+
+X64Opd X64Opd::global(const std::string& sym){
+	X64Opd opd = mem(X64Reg::RIP, 0);
+	opd.sym = sym;
+	return opd;
+}
+
+X64Opd X64Opd::label(const std::string& name){
+	X64Opd opd;
+	opd.kind = LABEL;
+	opd.sym = name;
+	return opd;
+}
+
+bool X64Opd::mentions(X64Reg reg) const{
+	if (kind == REG){ return base == reg; }
+	return kind == MEM && (base == reg || index == reg);
+}
+
+bool X64Opd::operator==(const X64Opd& other) const{
+	if (kind != other.kind){ return false; }
+	switch (kind){
+	case NONE: return true;
+	case REG: return base == other.base && size == other.size;
+	case IMM: return val == other.val && sym == other.sym;
+	case MEM:
+		return base == other.base && index == other.index
+			&& scale == other.scale && val == other.val && sym == other.sym;
+	case LABEL: return sym == other.sym;
+	}
+	return false;
+}
+
+static std::string regName(X64Reg reg, uint8_t size){
+	static const char * names64[] = { "rax", "rcx", "rdx", "rbx",
+		"rsp", "rbp", "rsi", "rdi" };
+	static const char * names32[] = { "eax", "ecx", "edx", "ebx",
+		"esp", "ebp", "esi", "edi" };
+	static const char * names8[] = { "al", "cl", "dl", "bl",
+		"spl", "bpl", "sil", "dil" };
+	size_t num = static_cast<size_t>(reg);
+	if (reg == X64Reg::RIP){ return "%rip"; }
+	if (num >= 16){ throw new InternalError("no such register"); }
+	if (num >= 8){
+		std::string name = "%r" + std::to_string(num);
+		return size == 8 ? name : size == 4 ? name + "d" : name + "b";
+	}
+	const char ** names = size == 8 ? names64 : size == 4 ? names32 : names8;
+	return std::string("%") + names[num];
+}
+
+std::string X64Opd::toString() const{
+	switch (kind){
+	case NONE: return "UNINIT";
+	case REG: return regName(base, size);
+	case IMM: return "$" + (sym.empty() ? std::to_string(val) : sym);
+	case LABEL: return sym;
+	case MEM: break;
+	}
+	std::string res = sym;
+	if (sym.empty() && val != 0){ res = std::to_string(val); }
+	res += "(" + regName(base, 8);
+	if (index != X64Reg::NONE){
+		res += "," + regName(index, 8) + "," + std::to_string(static_cast<int>(scale));
+	}
+	return res + ")";
+}
+
+X64Inst X64Inst::instr(Op op, std::initializer_list<X64Opd> opds){
+	if (opds.size() > 3){ throw new InternalError("too many operands"); }
+	X64Inst inst(INSTR, op, "");
+	for (const X64Opd& opd : opds){ inst.opds[inst.opdCount++] = opd; }
+	return inst;
+}
+
+const char * X64Inst::opName(Op op){
+	switch (op){
+	case MOVQ: return "movq";
+	case MOVABSQ: return "movabsq";
+	case MOVZBQ: return "movzbq";
+	case LEAQ: return "leaq";
+	case ADDQ: return "addq";
+	case SUBQ: return "subq";
+	case ANDQ: return "andq";
+	case ORQ: return "orq";
+	case XORQ: return "xorq";
+	case XORL: return "xorl";
+	case CMPQ: return "cmpq";
+	case IMULQ: return "imulq";
+	case IDIVQ: return "idivq";
+	case NEGQ: return "negq";
+	case CQTO: return "cqto";
+	case SHLQ: return "shlq";
+	case SARQ: return "sarq";
+	case SHRQ: return "shrq";
+	case SETE: return "sete";
+	case SETNE: return "setne";
+	case SETL: return "setl";
+	case SETG: return "setg";
+	case SETLE: return "setle";
+	case SETGE: return "setge";
+	case JMP: return "jmp";
+	case JE: return "je";
+	case JNE: return "jne";
+	case JL: return "jl";
+	case JG: return "jg";
+	case JLE: return "jle";
+	case JGE: return "jge";
+	case CALLQ: return "callq";
+	case RETQ: return "retq";
+	case PUSHQ: return "pushq";
+	case POPQ: return "popq";
+	case NOP: return "nop";
+	}
+	throw new InternalError("Bad x64 opcode");
+}
+
+std::string X64Inst::toString() const{
+	switch(kind){
+	case LABEL: return text + ":";
+	case COMMENT: return "#" + text;
+	case INSTR: break;
+	}
+	std::string res = opName(op);
+	for (size_t i = 0; i < opdCount; i++){
+		res += i == 0 ? " " : ", ";
+		res += opds[i].toString();
+	}
+	return res;
+}
+
+void X64Code::print(std::ostream& out) const{
+	for (const X64Inst& inst : insts){
+		out << inst.toString() << "\n";
+	}
+}
+
+}
@@ -0,0 +1,121 @@
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "3ac.hpp"
+#include "x64.hpp"
+#include "stdcminusminus.h"
+
+namespace cminusminus{
+
+// Running a program without leaving the compiler. The encoded
+// object is laid out in one mapping, with .text first and the
+// data after it on pages of their own, and the references the
+// linker would have resolved are filled in directly. Everything
+// within the mapping is reached %rip-relative as usual. The
+// runtime is wherever cmmc was loaded, too far for a 32-bit
+// displacement, so each call to it goes through a stub after
+// the code that jumps through the absolute address.
+//
+// The mapping is asked for below 2GB, so that an absolute
+// 32-bit reference (R_X86_64_32S) works as it would in a
+// program linked without -pie.
+
+//Size of a stub: jmpq *0(%rip), then the target address
+static const size_t STUB_SIZE = 16;
+
+static size_t roundUp(size_t size, size_t align){
+	return (size + align - 1) / align * align;
+}
+
+void * ObjectFile::load(const std::map<std::string, void *>& externs,
+  const std::string& entry){
+	for (const Fixup& fixup : fixups){ symbolIdx(fixup.sym); }
+	size_t numStubs = 0;
+	for (const Symbol& sym : symbols){
+		if (sym.section == UNDEF){ numStubs++; }
+	}
+	size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	size_t stubStart = roundUp(text.size(), STUB_SIZE);
+	size_t codeSize = roundUp(stubStart + numStubs * STUB_SIZE, page);
+	size_t rodataStart = codeSize;
+	size_t dataStart = roundUp(rodataStart + rodata.size(), 8);
+	size_t size = roundUp(dataStart + data.size(), page);
+
+	void * mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+	if (mem == MAP_FAILED){
+		throw new InternalError("cannot map memory for the program");
+	}
+	uint8_t * base = static_cast<uint8_t *>(mem);
+	memcpy(base, text.data(), text.size());
+	memcpy(base + rodataStart, rodata.data(), rodata.size());
+	memcpy(base + dataStart, data.data(), data.size());
+
+	//Where each symbol ended up
+	std::vector<uint64_t> addrs;
+	size_t stub = stubStart;
+	for (const Symbol& sym : symbols){
+		uint8_t * addr = nullptr;
+		switch (sym.section){
+		case TEXT: addr = base + sym.offset; break;
+		case RODATA: addr = base + rodataStart + sym.offset; break;
+		case DATA: addr = base + dataStart + sym.offset; break;
+		case UNDEF: {
+			auto found = externs.find(sym.name);
+			if (found == externs.end()){
+				throw new InternalError(("undefined symbol " + sym.name).c_str());
+			}
+			uint64_t target = reinterpret_cast<uint64_t>(found->second);
+			const uint8_t jmp[] = {0xff, 0x25, 0, 0, 0, 0};
+			memcpy(base + stub, jmp, sizeof(jmp));
+			memcpy(base + stub + sizeof(jmp), &target, sizeof(target));
+			addr = base + stub;
+			stub += STUB_SIZE;
+			break;
+		}
+		}
+		addrs.push_back(reinterpret_cast<uint64_t>(addr));
+	}
+
+	for (const Fixup& fixup : fixups){
+		int64_t val = static_cast<int64_t>(addrs[symbolIdx(fixup.sym)])
+			+ fixup.addend;
+		if (fixup.type != R_X86_64_32S){
+			val -= static_cast<int64_t>(reinterpret_cast<uint64_t>(base)
+				+ fixup.offset);
+		}
+		if (val < INT32_MIN || val > INT32_MAX){
+			throw new InternalError(("reference to " + fixup.sym
+				+ " out of range").c_str());
+		}
+		int32_t field = static_cast<int32_t>(val);
+		memcpy(base + fixup.offset, &field, sizeof(field));
+	}
+
+	if (mprotect(base, codeSize, PROT_READ | PROT_EXEC) != 0){
+		throw new InternalError("cannot make the program executable");
+	}
+	auto found = symbolIdxs.find(entry);
+	if (found == symbolIdxs.end() || symbols[found->second].section != TEXT){
+		throw new InternalError(("no code for " + entry).c_str());
+	}
+	return reinterpret_cast<void *>(addrs[found->second]);
+}
+
+int IRProgram::run(bool optimize){
+	const std::map<std::string, void *> runtime = {
+		{"printBool", reinterpret_cast<void *>(printBool)},
+		{"printInt", reinterpret_cast<void *>(printInt)},
+		{"printString", reinterpret_cast<void *>(printString)},
+		{"getBool", reinterpret_cast<void *>(getBool)},
+		{"getInt", reinterpret_cast<void *>(getInt)},
+	};
+	ObjectFile obj = toObject(optimize);
+	void * entry = obj.load(runtime, "main");
+	auto cmmMain = reinterpret_cast<int64_t (*)()>(entry);
+	int64_t res = cmmMain();
+	flushOutput();
+	return static_cast<int>(res);
+}
+
+}
@@ -0,0 +1,497 @@
+#include <map>
+#include <set>
+#include "errors.hpp"
+#include "x64.hpp"
+
+namespace cminusminus{
+
+// Peephole optimization over the instructions generated for a
+// procedure. Each rule looks at a short window of straight-line
+// code, and the rules are rerun until none of them applies:
+//
+//  - nops (left by the labels of NopQuads) are dropped
+//  - a jump to the instruction right after it is dropped, as
+//    is code between a jump or return and the next label
+//  - a conditional jump over an unconditional one becomes a
+//    single conditional jump with the opposite condition
+//  - labels that nothing jumps to are dropped, which lets the
+//    next rule see through them
+//  - loads of a value that a register already holds become
+//    register moves (or disappear), and stores of a value
+//    that memory already holds disappear
+//  - a value moved into a register only to be moved on right
+//    away is moved straight to where it goes, as long as
+//    nothing reads the register afterwards
+//
+// Finally, movq $0 into a register becomes the shorter xorl
+// wherever the flags it clobbers are not read.
+
+void X64Code::peephole(){
+	bool changed = true;
+	while (changed){
+		changed = false;
+		changed = dropNops() || changed;
+		changed = dropJumpsToNext() || changed;
+		changed = dropUnreachable() || changed;
+		changed = invertBranchOverJump() || changed;
+		changed = dropUnusedLabels() || changed;
+		changed = forwardValues() || changed;
+		changed = forwardCopies() || changed;
+	}
+	zeroWithXor();
+}
+
+using InstItr = std::list<X64Inst>::iterator;
+
+//The conditional jump taken exactly when the given one is not
+static X64Inst::Op invertJump(X64Inst::Op op){
+	switch (op){
+	case X64Inst::JE: return X64Inst::JNE;
+	case X64Inst::JNE: return X64Inst::JE;
+	case X64Inst::JL: return X64Inst::JGE;
+	case X64Inst::JGE: return X64Inst::JL;
+	case X64Inst::JG: return X64Inst::JLE;
+	case X64Inst::JLE: return X64Inst::JG;
+	default:
+		throw new InternalError("Not a conditional jump");
+	}
+}
+
+//The next instruction or label after itr, skipping comments
+static InstItr nextCode(InstItr itr, InstItr end){
+	++itr;
+	while (itr != end && itr->getKind() == X64Inst::COMMENT){ ++itr; }
+	return itr;
+}
+
+//Whether the labels right at itr (with comments between them)
+// include the given one
+static bool labelsAt(InstItr itr, InstItr end, const std::string& name){
+	while (itr != end && !itr->isInstr()){
+		if (itr->isLabel() && itr->getText() == name){ return true; }
+		++itr;
+	}
+	return false;
+}
+
+static bool isOp(const X64Inst& inst, X64Inst::Op op){
+	return inst.isInstr() && inst.getOp() == op;
+}
+
+//The label a jump goes to
+static const std::string& jumpTarget(const X64Inst& inst){
+	return inst.getOpd(0).getSym();
+}
+
+bool X64Code::dropNops(){
+	size_t before = insts.size();
+	insts.remove_if([](const X64Inst& inst){
+		return isOp(inst, X64Inst::NOP);
+	});
+	return insts.size() != before;
+}
+
+bool X64Code::dropJumpsToNext(){
+	bool changed = false;
+	auto itr = insts.begin();
+	while (itr != insts.end()){
+		if (itr->isJump()
+		  && labelsAt(std::next(itr), insts.end(), jumpTarget(*itr))){
+			itr = insts.erase(itr);
+			changed = true;
+		} else {
+			++itr;
+		}
+	}
+	return changed;
+}
+
+bool X64Code::dropUnreachable(){
+	bool changed = false;
+	bool reachable = true;
+	auto itr = insts.begin();
+	while (itr != insts.end()){
+		if (itr->isLabel()){ reachable = true; }
+		if (!reachable && itr->isInstr()){
+			itr = insts.erase(itr);
+			changed = true;
+			continue;
+		}
+		if (isOp(*itr, X64Inst::JMP) || isOp(*itr, X64Inst::RETQ)){
+			reachable = false;
+		}
+		++itr;
+	}
+	return changed;
+}
+
+bool X64Code::invertBranchOverJump(){
+	bool changed = false;
+	for (auto itr = insts.begin(); itr != insts.end(); ++itr){
+		if (!itr->isCondJump()){ continue; }
+		auto jmp = nextCode(itr, insts.end());
+		if (jmp == insts.end() || !isOp(*jmp, X64Inst::JMP)){ continue; }
+		if (!labelsAt(std::next(jmp), insts.end(), jumpTarget(*itr))){
+			continue;
+		}
+		*itr = X64Inst::instr(invertJump(itr->getOp()), {jmp->getOpd(0)});
+		insts.erase(jmp);
+		changed = true;
+	}
+	return changed;
+}
+
+//The procedure's entry labels (those before its first
+// instruction) are used by callers, so they always stay
+bool X64Code::dropUnusedLabels(){
+	std::set<std::string> targets;
+	for (const X64Inst& inst : insts){
+		if (inst.isJump()){ targets.insert(jumpTarget(inst)); }
+	}
+	bool changed = false;
+	bool inBody = false;
+	auto itr = insts.begin();
+	while (itr != insts.end()){
+		inBody = inBody || itr->isInstr();
+		if (inBody && itr->isLabel() && targets.count(itr->getText()) == 0){
+			itr = insts.erase(itr);
+			changed = true;
+		} else {
+			++itr;
+		}
+	}
+	return changed;
+}
+
+//Stack slots and globals are addressed one way only, so stores
+// to them can only change memory addressed the same way or
+// reached through a pointer
+static bool isDirectMem(const X64Opd& mem){
+	return (mem.getReg() == X64Reg::RBP || mem.getReg() == X64Reg::RIP)
+		&& mem.getIndex() == X64Reg::NONE;
+}
+
+namespace{
+
+//Which registers are known to hold the same value as some
+// memory location
+class KnownValues{
+public:
+	void clear(){ holds.clear(); }
+	//Whether some register holds the value at mem, and if so
+	// which one
+	bool regFor(const X64Opd& mem, X64Reg& reg) const{
+		for (auto entry : holds){
+			if (entry.second == mem){
+				reg = entry.first;
+				return true;
+			}
+		}
+		return false;
+	}
+	bool holdsMem(X64Reg reg, const X64Opd& mem) const{
+		auto found = holds.find(reg);
+		return found != holds.end() && found->second == mem;
+	}
+	//Copy what src is known to hold over to dst
+	void copy(X64Reg src, X64Reg dst){
+		auto found = holds.find(src);
+		killReg(dst);
+		if (found != holds.end()){ set(dst, found->second); }
+	}
+	void set(X64Reg reg, const X64Opd& mem){
+		if (!mem.mentions(reg)){ holds[reg] = mem; }
+	}
+	void killReg(X64Reg reg){
+		holds.erase(reg);
+		for (auto itr = holds.begin(); itr != holds.end(); ){
+			if (itr->second.mentions(reg)){
+				itr = holds.erase(itr);
+			} else {
+				++itr;
+			}
+		}
+	}
+	void killMem(const X64Opd& mem){
+		if (!isDirectMem(mem)){
+			clear();
+			return;
+		}
+		for (auto itr = holds.begin(); itr != holds.end(); ){
+			if (itr->second == mem || !isDirectMem(itr->second)){
+				itr = holds.erase(itr);
+			} else {
+				++itr;
+			}
+		}
+	}
+private:
+	std::map<X64Reg, X64Opd> holds;
+};
+
+}
+
+//Instructions that only write their last operand
+static bool writesLastOpd(X64Inst::Op op){
+	switch (op){
+	case X64Inst::ADDQ: case X64Inst::SUBQ: case X64Inst::IMULQ:
+	case X64Inst::ANDQ: case X64Inst::ORQ: case X64Inst::XORQ:
+	case X64Inst::XORL: case X64Inst::NEGQ: case X64Inst::SHLQ:
+	case X64Inst::SARQ: case X64Inst::SHRQ: case X64Inst::LEAQ:
+	case X64Inst::MOVZBQ: case X64Inst::MOVABSQ:
+	case X64Inst::SETE: case X64Inst::SETNE: case X64Inst::SETL:
+	case X64Inst::SETG: case X64Inst::SETLE: case X64Inst::SETGE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool X64Code::forwardValues(){
+	bool changed = false;
+	KnownValues known;
+	auto itr = insts.begin();
+	while (itr != insts.end()){
+		auto cur = itr++;
+		if (cur->isLabel()){
+			known.clear();
+			continue;
+		}
+		if (!cur->isInstr()){ continue; }
+		X64Inst::Op op = cur->getOp();
+		size_t numOpds = cur->numOpds();
+
+		if (op == X64Inst::MOVQ){
+			const X64Opd src = cur->getOpd(0);
+			const X64Opd dst = cur->getOpd(1);
+			if (dst.isReg() && src.isMem()){
+				X64Reg holder;
+				if (known.regFor(src, holder)){
+					if (holder == dst.getReg()){
+						insts.erase(cur);
+						changed = true;
+						continue;
+					}
+					*cur = X64Inst::instr(X64Inst::MOVQ, {X64Opd::reg(holder), dst});
+					changed = true;
+				}
+				known.killReg(dst.getReg());
+				known.set(dst.getReg(), src);
+			} else if (dst.isReg() && src.isReg()){
+				if (src == dst){
+					insts.erase(cur);
+					changed = true;
+					continue;
+				}
+				known.copy(src.getReg(), dst.getReg());
+			} else if (dst.isReg()){
+				known.killReg(dst.getReg());
+			} else if (src.isReg()){
+				if (known.holdsMem(src.getReg(), dst)){
+					insts.erase(cur);
+					changed = true;
+					continue;
+				}
+				known.killMem(dst);
+				known.set(src.getReg(), dst);
+			} else {
+				known.killMem(dst);
+			}
+		} else if (cur->isJump() || op == X64Inst::CMPQ){
+			//Nothing is written, and state carries on along
+			// the fall-through path
+		} else if (op == X64Inst::CQTO){
+			known.killReg(X64Reg::RDX);
+		} else if (op == X64Inst::IDIVQ || (op == X64Inst::IMULQ && numOpds == 1)){
+			known.killReg(X64Reg::RAX);
+			known.killReg(X64Reg::RDX);
+		} else if (writesLastOpd(op) && numOpds > 0){
+			const X64Opd& dst = cur->getOpd(numOpds - 1);
+			if (dst.isReg()){ known.killReg(dst.getReg()); }
+			else { known.killMem(dst); }
+		} else {
+			//Calls, stack pushes and pops, and anything else
+			known.clear();
+		}
+	}
+	return changed;
+}
+
+//Whether an instruction reads reg. A call reads the argument
+// registers, and writing a byte register reads nothing.
+static bool readsReg(const X64Inst& inst, X64Reg reg){
+	X64Inst::Op op = inst.getOp();
+	size_t numOpds = inst.numOpds();
+	switch (op){
+	case X64Inst::CALLQ:
+		return reg == X64Reg::RDI || reg == X64Reg::RSI || reg == X64Reg::RDX
+			|| reg == X64Reg::RCX || reg == X64Reg::R8 || reg == X64Reg::R9;
+	case X64Inst::RETQ:
+		return true;
+	case X64Inst::CQTO:
+		return reg == X64Reg::RAX;
+	case X64Inst::IDIVQ:
+		return reg == X64Reg::RAX || reg == X64Reg::RDX
+			|| inst.getOpd(0).mentions(reg);
+	case X64Inst::XORL:
+		//Zeroing a register does not depend on it
+		if (inst.getOpd(0) == inst.getOpd(1)){ return false; }
+		break;
+	case X64Inst::MOVQ: case X64Inst::MOVABSQ: case X64Inst::MOVZBQ:
+	case X64Inst::LEAQ: case X64Inst::POPQ:
+	case X64Inst::SETE: case X64Inst::SETNE: case X64Inst::SETL:
+	case X64Inst::SETG: case X64Inst::SETLE: case X64Inst::SETGE:
+		//The last operand is only written, unless it is memory
+		for (size_t i = 0; i < numOpds; i++){
+			const X64Opd& opd = inst.getOpd(i);
+			if ((i + 1 < numOpds || opd.isMem()) && opd.mentions(reg)){
+				return true;
+			}
+		}
+		return false;
+	case X64Inst::IMULQ:
+		if (numOpds == 1 && reg == X64Reg::RAX){ return true; }
+		if (numOpds == 3){
+			return inst.getOpd(0).mentions(reg) || inst.getOpd(1).mentions(reg)
+				|| (inst.getOpd(2).isMem() && inst.getOpd(2).mentions(reg));
+		}
+		break;
+	default:
+		break;
+	}
+	for (size_t i = 0; i < numOpds; i++){
+		if (inst.getOpd(i).mentions(reg)){ return true; }
+	}
+	return false;
+}
+
+//Whether an instruction sets all of reg without reading it
+static bool overwritesReg(const X64Inst& inst, X64Reg reg){
+	X64Inst::Op op = inst.getOp();
+	size_t numOpds = inst.numOpds();
+	switch (op){
+	case X64Inst::CALLQ:
+		return reg == X64Reg::RAX || reg == X64Reg::RCX || reg == X64Reg::RDX
+			|| reg == X64Reg::RSI || reg == X64Reg::RDI || reg == X64Reg::R8
+			|| reg == X64Reg::R9 || reg == X64Reg::R10 || reg == X64Reg::R11;
+	case X64Inst::CQTO:
+		return reg == X64Reg::RDX;
+	case X64Inst::IDIVQ:
+		return reg == X64Reg::RAX || reg == X64Reg::RDX;
+	case X64Inst::IMULQ:
+		if (numOpds == 1){ return reg == X64Reg::RAX || reg == X64Reg::RDX; }
+		break;
+	case X64Inst::XORL:
+		return inst.getOpd(0) == inst.getOpd(1) && inst.getOpd(1).mentions(reg);
+	case X64Inst::MOVQ: case X64Inst::MOVABSQ: case X64Inst::MOVZBQ:
+	case X64Inst::LEAQ: case X64Inst::POPQ:
+		break;
+	default:
+		return false;
+	}
+	const X64Opd& dst = inst.getOpd(numOpds - 1);
+	return dst.isReg() && dst.getReg() == reg && dst.getSize() == 8;
+}
+
+//Whether the value in reg may be read after the instruction at
+// itr. Only straight-line code is followed, so a label or a
+// jump counts as a read.
+static bool regLiveAfter(InstItr itr, InstItr end, X64Reg reg){
+	for (++itr; itr != end; ++itr){
+		if (itr->isLabel()){ return true; }
+		if (!itr->isInstr()){ continue; }
+		if (itr->isJump() || readsReg(*itr, reg)){ return true; }
+		if (overwritesReg(*itr, reg)){ return false; }
+	}
+	return true;
+}
+
+//Whether movq can take src to dst in one instruction. An
+// immediate stored to memory is sign-extended from 32 bits,
+// and a symbol's address is only ever moved into a register.
+static bool movable(const X64Opd& src, const X64Opd& dst){
+	if (src.isMem()){ return !dst.isMem(); }
+	if (src.isImm() && !dst.isReg()){
+		return src.getSym().empty() && src.getVal() >= INT32_MIN
+			&& src.getVal() <= INT32_MAX;
+	}
+	return true;
+}
+
+bool X64Code::forwardCopies(){
+	bool changed = false;
+	auto itr = insts.begin();
+	while (itr != insts.end()){
+		auto cur = itr++;
+		if (!isOp(*cur, X64Inst::MOVQ)){ continue; }
+		const X64Opd src = cur->getOpd(0);
+		const X64Opd tmp = cur->getOpd(1);
+		if (!tmp.isReg()){ continue; }
+		auto next = nextCode(cur, insts.end());
+		if (next == insts.end() || !isOp(*next, X64Inst::MOVQ)
+		  || next->getOpd(0) != tmp){
+			continue;
+		}
+		const X64Opd dst = next->getOpd(1);
+		if (dst.mentions(tmp.getReg()) || !movable(src, dst)
+		  || regLiveAfter(next, insts.end(), tmp.getReg())){
+			continue;
+		}
+		*next = X64Inst::instr(X64Inst::MOVQ, {src, dst});
+		insts.erase(cur);
+		changed = true;
+	}
+	return changed;
+}
+
+//Whether the flags may still be read after the instruction at
+// itr. Flags are never live into a label or across a jump.
+static bool flagsLiveAfter(InstItr itr, InstItr end){
+	for (++itr; itr != end; ++itr){
+		if (itr->isLabel()){ return false; }
+		if (!itr->isInstr()){ continue; }
+		if (itr->isCondJump()){ return true; }
+		switch (itr->getOp()){
+		//Read the flags
+		case X64Inst::SETE: case X64Inst::SETNE: case X64Inst::SETL:
+		case X64Inst::SETG: case X64Inst::SETLE: case X64Inst::SETGE:
+			return true;
+		//Set them, or leave the procedure
+		case X64Inst::CMPQ: case X64Inst::ADDQ: case X64Inst::SUBQ:
+		case X64Inst::IMULQ: case X64Inst::IDIVQ: case X64Inst::ANDQ:
+		case X64Inst::ORQ: case X64Inst::XORQ: case X64Inst::XORL:
+		case X64Inst::NEGQ: case X64Inst::SHLQ: case X64Inst::SARQ:
+		case X64Inst::SHRQ: case X64Inst::JMP: case X64Inst::CALLQ:
+		case X64Inst::RETQ:
+			return false;
+		//Leave them alone
+		case X64Inst::MOVQ: case X64Inst::MOVABSQ: case X64Inst::LEAQ:
+		case X64Inst::MOVZBQ: case X64Inst::CQTO: case X64Inst::PUSHQ:
+		case X64Inst::POPQ: case X64Inst::NOP:
+			break;
+		default:
+			return true;
+		}
+	}
+	return false;
+}
+
+bool X64Code::zeroWithXor(){
+	bool changed = false;
+	for (auto itr = insts.begin(); itr != insts.end(); ++itr){
+		if (!isOp(*itr, X64Inst::MOVQ)){ continue; }
+		const X64Opd& src = itr->getOpd(0);
+		const X64Opd& dst = itr->getOpd(1);
+		if (!src.isImm() || src.getVal() != 0 || !src.getSym().empty()
+		  || !dst.isReg()){
+			continue;
+		}
+		if (flagsLiveAfter(itr, insts.end())){ continue; }
+		X64Opd reg = X64Opd::reg(dst.getReg(), 4);
+		*itr = X64Inst::instr(X64Inst::XORL, {reg, reg});
+		changed = true;
+	}
+	return changed;
+}
+
+}
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "3ac.hpp"
+#include "dataflow.hpp"
+
+namespace cminusminus{
+
+// Linear-scan register allocation (Poletto & Sarkar) over the
+// quads of a single procedure.
+//
+// Quads are numbered in program order, and each quad i covers
+// two positions: its operands are read at 2i and written at
+// 2i+1. A quad that clobbers the caller-saved registers does so
+// at 2i+1, after its reads; the address of an AddrOpd that such
+// a quad stores through is only needed then, too. Each operand
+// gets a single live interval spanning every position at which
+// it may be live, computed from block-level liveness.
+//
+// Intervals that cross a clobber can only live in callee-saved
+// registers. Everything else prefers a caller-saved register,
+// which costs nothing to use. A callee-saved register costs a
+// save and a restore once it is used at all, so one that is
+// already saved is taken over one that is not. %rax, %rcx and
+// %rdx are left out of the pool since quads use them as
+// scratch, and so is %r11, which holds addresses during stores
+// through AddrOpds.
+
+static const Register callerSavedPool[] = { SI, DI, R8, R9, R10 };
+static const Register calleeSavedPool[] = { B, R12, R13, R14, R15 };
+
+namespace{
+
+struct LiveInterval{
+	Opd * opd;
+	size_t start;
+	size_t end;
+	bool crossesClobber;
+	bool hasReg;
+	Register reg;
+};
+
+}
+
+static void setLoc(Opd * opd, const X64Opd& loc){
+	if (SymOpd * sym = opd->asSym()){
+		sym->setMemoryLoc(loc);
+	} else if (AuxOpd * aux = opd->asAux()){
+		aux->setMemoryLoc(loc);
+	} else if (AddrOpd * addr = opd->asAddr()){
+		addr->setMemoryLoc(loc);
+	} else {
+		throw new InternalError("Operand has no location");
+	}
+}
+
+std::set<Opd *> Procedure::allocRegisters(){
+	ControlFlowGraph * graph = getCFG();
+	const std::vector<Quad *>& quads = graph->getQuads();
+
+	//Globals and symbols whose address is taken have to stay
+	// in memory
+	std::vector<Opd *> opds = promotableOpds();
+	for (auto addr : addrOpds){ opds.push_back(addr); }
+	HashMap<Opd *, size_t> opdIdx;
+	for (size_t o = 0; o < opds.size(); o++){ opdIdx[opds[o]] = o; }
+
+	//Per-quad candidate uses and defs, with the position at
+	// which each use happens
+	std::vector<std::vector<std::pair<size_t, size_t>>> uses(quads.size());
+	std::vector<std::vector<size_t>> defs(quads.size());
+	std::vector<size_t> clobbers;
+	for (size_t i = 0; i < quads.size(); i++){
+		Quad * quad = quads[i];
+		bool clobber = quad->clobbersRegs();
+		if (clobber){ clobbers.push_back(2*i + 1); }
+		for (Opd * opd : quad->getUses()){
+			auto found = opdIdx.find(opd);
+			if (found == opdIdx.end()){ continue; }
+			bool late = clobber && opd->asAddr() != nullptr;
+			uses[i].push_back(std::make_pair(found->second,
+				late ? 2*i + 1 : 2*i));
+		}
+		for (Opd * opd : quad->getDefs()){
+			auto found = opdIdx.find(opd);
+			if (found == opdIdx.end()){ continue; }
+			defs[i].push_back(found->second);
+		}
+	}
+
+	const std::vector<BasicBlock>& blocks = graph->getBlocks();
+	Liveness live(graph, opdIdx);
+
+	//Each interval is the hull of every position at which
+	// its operand is touched or live across a block boundary
+	std::vector<LiveInterval> intervals(opds.size());
+	std::vector<bool> touched(opds.size(), false);
+	auto cover = [&](size_t opd, size_t pos){
+		LiveInterval& interval = intervals[opd];
+		if (!touched[opd]){
+			touched[opd] = true;
+			interval.start = pos;
+			interval.end = pos;
+		} else {
+			interval.start = std::min(interval.start, pos);
+			interval.end = std::max(interval.end, pos);
+		}
+	};
+	for (size_t b = 0; b < blocks.size(); b++){
+		size_t first = blocks[b].getFirst();
+		size_t last = blocks[b].getLast();
+		for (size_t o = 0; o < opds.size(); o++){
+			if (live.liveIn(b).get(o)){ cover(o, 2*first); }
+			if (live.liveOut(b).get(o)){ cover(o, 2*last + 1); }
+		}
+	}
+	for (size_t i = 0; i < quads.size(); i++){
+		for (auto use : uses[i]){ cover(use.first, use.second); }
+		for (auto def : defs[i]){ cover(def, 2*i + 1); }
+	}
+
+	std::vector<LiveInterval *> order;
+	for (size_t o = 0; o < opds.size(); o++){
+		if (!touched[o]){ continue; }
+		LiveInterval& interval = intervals[o];
+		interval.opd = opds[o];
+		interval.hasReg = false;
+		auto clobber = std::lower_bound(clobbers.begin(),
+			clobbers.end(), interval.start);
+		interval.crossesClobber = clobber != clobbers.end()
+			&& *clobber <= interval.end;
+		order.push_back(&interval);
+	}
+	std::stable_sort(order.begin(), order.end(),
+		[](LiveInterval * a, LiveInterval * b){
+			return a->start < b->start;
+		});
+
+	std::vector<Register> freeCaller(std::begin(callerSavedPool),
+		std::end(callerSavedPool));
+	std::vector<Register> freeCallee(std::begin(calleeSavedPool),
+		std::end(calleeSavedPool));
+	//Sorted by increasing end
+	std::list<LiveInterval *> active;
+	auto release = [&](LiveInterval * interval){
+		if (RegUtils::isCalleeSaved(interval->reg)){
+			freeCallee.push_back(interval->reg);
+		} else {
+			freeCaller.push_back(interval->reg);
+		}
+	};
+	std::set<Register> usedCallee;
+	auto takeCallee = [&](){
+		auto itr = std::find_if(freeCallee.begin(), freeCallee.end(),
+			[&](Register reg){ return usedCallee.count(reg) > 0; });
+		if (itr == freeCallee.end()){ itr = freeCallee.begin(); }
+		Register reg = *itr;
+		freeCallee.erase(itr);
+		usedCallee.insert(reg);
+		return reg;
+	};
+	auto activate = [&](LiveInterval * interval){
+		auto itr = active.begin();
+		while (itr != active.end() && (*itr)->end <= interval->end){
+			++itr;
+		}
+		active.insert(itr, interval);
+	};
+
+	for (LiveInterval * cur : order){
+		while (!active.empty() && active.front()->end < cur->start){
+			release(active.front());
+			active.pop_front();
+		}
+
+		if (!cur->crossesClobber && !freeCaller.empty()){
+			cur->reg = freeCaller.back();
+			freeCaller.pop_back();
+			cur->hasReg = true;
+		} else if (!freeCallee.empty()){
+			cur->reg = takeCallee();
+			cur->hasReg = true;
+		} else {
+			//Spill whichever usable interval ends last
+			LiveInterval * victim = nullptr;
+			for (LiveInterval * other : active){
+				if (cur->crossesClobber
+				  && !RegUtils::isCalleeSaved(other->reg)){
+					continue;
+				}
+				victim = other;
+			}
+			if (victim == nullptr || victim->end <= cur->end){
+				continue;
+			}
+			cur->reg = victim->reg;
+			cur->hasReg = true;
+			victim->hasReg = false;
+			active.remove(victim);
+		}
+		activate(cur);
+	}
+
+	std::set<Opd *> inRegs;
+	usedCallee.clear();
+	for (LiveInterval * interval : order){
+		if (!interval->hasReg){ continue; }
+		setLoc(interval->opd, X64Opd::reg(RegUtils::x64Reg(interval->reg)));
+		inRegs.insert(interval->opd);
+		if (RegUtils::isCalleeSaved(interval->reg)){
+			usedCallee.insert(interval->reg);
+		}
+	}
+	savedRegs.clear();
+	for (Register reg : calleeSavedPool){
+		if (usedCallee.count(reg) > 0){ savedRegs.push_back(reg); }
+	}
+	return inRegs;
+}
+
+}
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include "3ac.hpp"
+#include "dataflow.hpp"
+
+namespace cminusminus{
+
+// Stack slot sharing. Two operands may use the same frame slot
+// as long as neither is ever written while the other still
+// holds a value that will be read. That is the usual
+// interference relation: walking each block backward, a quad
+// that defines an operand interferes it with everything live
+// just after the quad. Every quad reads all of its operands
+// before it writes any, so a quad's result can reuse the slot
+// of an operand that dies there.
+//
+// Only operands that nothing can reach through memory are
+// candidates. A symbol whose address is taken keeps a slot of
+// its own.
+
+std::vector<std::vector<Opd *>> Procedure::colorSlots(
+  const std::set<Opd *>& inRegs){
+	std::vector<Opd *> opds;
+	for (Opd * opd : promotableOpds()){
+		if (inRegs.count(opd) == 0){ opds.push_back(opd); }
+	}
+	for (auto addr : addrOpds){
+		if (inRegs.count(addr) == 0){ opds.push_back(addr); }
+	}
+	HashMap<Opd *, size_t> opdIdx;
+	for (size_t o = 0; o < opds.size(); o++){ opdIdx[opds[o]] = o; }
+
+	ControlFlowGraph * graph = getCFG();
+	const std::vector<Quad *>& quads = graph->getQuads();
+	Liveness live(graph, opdIdx);
+
+	std::vector<std::vector<size_t>> interferes(opds.size());
+	for (const BasicBlock& block : graph->getBlocks()){
+		BitSet liveNow = live.liveOut(block.getID());
+		size_t i = block.getLast() + 1;
+		while (i-- > block.getFirst()){
+			for (Opd * def : quads[i]->getDefs()){
+				auto found = opdIdx.find(def);
+				if (found == opdIdx.end()){ continue; }
+				size_t d = found->second;
+				liveNow.forEach([&](size_t other){
+					if (other == d){ return; }
+					interferes[d].push_back(other);
+					interferes[other].push_back(d);
+				});
+			}
+			for (Opd * def : quads[i]->getDefs()){
+				auto found = opdIdx.find(def);
+				if (found != opdIdx.end()){ liveNow.reset(found->second); }
+			}
+			for (Opd * use : quads[i]->getUses()){
+				auto found = opdIdx.find(use);
+				if (found != opdIdx.end()){ liveNow.set(found->second); }
+			}
+		}
+	}
+
+	//Greedy coloring, most constrained operands first. The
+	// marks hold o+1 for the operand whose neighbors last
+	// claimed the slot, so they never need to be cleared.
+	std::vector<size_t> order(opds.size());
+	for (size_t o = 0; o < opds.size(); o++){ order[o] = o; }
+	std::stable_sort(order.begin(), order.end(),
+		[&](size_t a, size_t b){
+			return interferes[a].size() > interferes[b].size();
+		});
+	std::vector<size_t> color(opds.size(), BasicBlock::NONE);
+	std::vector<size_t> taken;
+	std::vector<std::vector<Opd *>> slots;
+	for (size_t o : order){
+		for (size_t other : interferes[o]){
+			if (color[other] != BasicBlock::NONE){
+				taken[color[other]] = o + 1;
+			}
+		}
+		size_t c = 0;
+		while (c < slots.size() && taken[c] == o + 1){ c++; }
+		if (c == slots.size()){
+			slots.push_back(std::vector<Opd *>());
+			taken.push_back(0);
+		}
+		color[o] = c;
+		slots[c].push_back(opds[o]);
+	}
+	return slots;
+}
+
+}